@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Benchmark of a representative workload. Also the training run of pgo_generate builds.
+#
+#-------------------------------------------------
+
+TARGET = benchmark
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../common.pri)
+include(../Core/core.pri)
+
+SOURCES += \
+    benchmark.cpp
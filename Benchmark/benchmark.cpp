@@ -0,0 +1,106 @@
+#include "Controller/controller.h"
+#include "Model/bufferpool.h"
+#include "Model/memorytracker.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Representative workload: preprocessing, segmentation and teeth tracing of panoramic images.
+// Prints the time of each step. Also the training run of profile-guided optimization builds.
+// Then times the preprocessing of all images as one batch, parallel across and within images.
+// With DENTALBIOMETRY_MEMORY_STATS set, also prints the memory of each image and stage.
+// Usage: benchmark <iterations> <image> [image...]
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+// Milliseconds elapsed since start
+double ElapsedMs(const Clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+}
+
+int main(int argc, char *argv[])
+{
+    Controller *session;
+    std::vector<cv::Mat> batch;
+    Clock::time_point start, total_start;
+    double preprocessing_ms, segmentation_ms, tracing_ms, across_ms, within_ms;
+    int iterations, i, j;
+
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " <iterations> <image> [image...]" << std::endl;
+        return 1;
+    }
+    iterations = std::atoi(argv[1]);
+    if (iterations < 1) {
+        std::cout << "Invalid number of iterations: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // Buffers are reused between iterations, as in the batch modes
+    BufferPool::install();
+    MemoryTracker::installIfRequested();
+    session = new Controller;
+    total_start = Clock::now();
+
+    for (i = 2; i < argc; i++) {
+        MemoryScope memory_scope(argv[i]);
+        if (!session->setInputImage(argv[i])) {
+            std::cout << "Cannot read " << argv[i] << std::endl;
+            delete session;
+            return 1;
+        }
+        BufferPool::BeginImage();
+
+        preprocessing_ms = segmentation_ms = tracing_ms = 0;
+        for (j = 0; j < iterations; j++) {
+            start = Clock::now();
+            session->resetImageSegmentation();
+            session->applyMedianSegmentation();
+            session->applyBilateralSegmentation();
+            session->resetImageTracing();
+            session->applyMedianTracing();
+            session->applySobelTracing();
+            preprocessing_ms += ElapsedMs(start);
+
+            start = Clock::now();
+            session->runSegmentation();
+            segmentation_ms += ElapsedMs(start);
+
+            start = Clock::now();
+            session->runTeethTracing();
+            tracing_ms += ElapsedMs(start);
+        }
+
+        std::cout << argv[i] << ": preprocessing " << preprocessing_ms / iterations
+                  << " ms, segmentation " << segmentation_ms / iterations
+                  << " ms, tracing " << tracing_ms / iterations << " ms" << std::endl;
+        batch.push_back(session->getInputImage());
+    }
+
+    // Preprocessing of all the images as one batch, with each parallel strategy
+    across_ms = within_ms = 0;
+    for (j = 0; j < iterations; j++) {
+        start = Clock::now();
+        Filters::Bilateral(Filters::Median(batch, 5, Filters::BATCH_ACROSS_IMAGES), 9, Filters::BATCH_ACROSS_IMAGES);
+        across_ms += ElapsedMs(start);
+
+        start = Clock::now();
+        Filters::Bilateral(Filters::Median(batch, 5, Filters::BATCH_WITHIN_IMAGES), 9, Filters::BATCH_WITHIN_IMAGES);
+        within_ms += ElapsedMs(start);
+    }
+    std::cout << "Batch of " << batch.size() << " images on " << ThreadPool::getInstance()->getNumThreads()
+              << " threads: preprocessing across images " << across_ms / iterations
+              << " ms, within images " << within_ms / iterations << " ms" << std::endl;
+
+    std::cout << "Total " << ElapsedMs(total_start) << " ms" << std::endl;
+    if (MemoryTracker::isInstalled())
+        std::cout << "Memory of all images: " << MemoryTracker::FormatUsage(MemoryTracker::getTotal()) << std::endl;
+
+    delete session;
+    ThreadPool::destroy();
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Build an optimized release with link-time and profile-guided optimization.
+# The instrumented build runs the benchmark on the given images to record profiles,
+# then the same build directory is rebuilt with them.
+# Usage: Benchmark/pgo.sh <build directory> <image> [image...]
+
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <build directory> <image> [image...]"
+    exit 1
+fi
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=$1
+PGO_DIR=$(mkdir -p "$BUILD_DIR" && cd "$BUILD_DIR" && pwd)/pgo
+ITERATIONS=${ITERATIONS:-5}
+shift
+
+cd "$BUILD_DIR"
+rm -rf "$PGO_DIR"
+
+# Instrumented build and training run.
+# qmake -r regenerates the Makefiles of every subproject, so a build directory used before picks up the profile flags.
+qmake -r "$SOURCE_DIR/DentalBiometry.pro" CONFIG+=release CONFIG+=ltcg CONFIG+=pgo_generate PGO_DIR="$PGO_DIR"
+make -j"$(nproc)"
+./Benchmark/benchmark "$ITERATIONS" "$@"
+
+# Optimized build. distclean also removes the subproject Makefiles, which a plain clean keeps
+# with the instrumentation flags; the profiles in PGO_DIR are kept.
+make distclean
+qmake -r "$SOURCE_DIR/DentalBiometry.pro" CONFIG+=release CONFIG+=ltcg CONFIG+=pgo_use PGO_DIR="$PGO_DIR"
+make -j"$(nproc)"
+./Benchmark/benchmark "$ITERATIONS" "$@"
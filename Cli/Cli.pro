@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Command line tool without Qt: watch folder, processing service and its test client
+#
+#-------------------------------------------------
+
+TARGET = dentalbiometry-cli
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../common.pri)
+include(../Core/core.pri)
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,14 @@
+#include "Controller/commandline.h"
+
+// Command line tool without Qt, for batch nodes and services
+int main(int argc, char *argv[])
+{
+    int status = RunCommandLine(argc, argv);
+
+    if (status >= 0)
+        return status;
+
+    PrintCommandLineUsage(argv[0]);
+
+    return 1;
+}
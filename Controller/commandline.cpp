@@ -0,0 +1,184 @@
+#include "commandline.h"
+#include "Model/bufferpool.h"
+#include "Model/cpudispatch.h"
+#include "Model/memorytracker.h"
+#include "imagepipeline.h"
+#include "processingservice.h"
+#include "serviceclient.h"
+#include "watchfolder.h"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <opencv2/imgcodecs.hpp>
+
+// Watch folder of the daemon mode, stopped by SIGINT and SIGTERM
+static WatchFolder *watch_folder = 0;
+
+static void stopWatching(int)
+{
+    if (watch_folder != 0)
+        watch_folder->Stop();
+}
+
+// Daemon mode: DentalBiometry --watch <directory> [queue capacity] [workers]
+static int runWatchFolder(int argc, char *argv[])
+{
+    int queue_capacity = (argc > 3) ? std::atoi(argv[3]) : 16;
+    int n_workers = (argc > 4) ? std::atoi(argv[4]) : 2;
+    bool watched;
+
+    watch_folder = new WatchFolder(argv[2], queue_capacity, n_workers);
+    std::signal(SIGINT, stopWatching);
+    std::signal(SIGTERM, stopWatching);
+
+    watched = watch_folder->Run();
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    delete watch_folder;
+    watch_folder = 0;
+    ThreadPool::destroy();
+
+    return watched ? 0 : 1;
+}
+
+// Batch mode: DentalBiometry --batch <image> [image...]
+// Results are written next to each image, as in the daemon mode.
+// Decoding, processing and writing of consecutive images overlap.
+static int runBatch(int argc, char *argv[])
+{
+    std::string path;
+    size_t slash;
+    int n_failed, i;
+
+    {
+        ImagePipeline pipeline;
+        for (i = 2; i < argc; i++) {
+            path = argv[i];
+            slash = path.find_last_of('/');
+            if (slash == std::string::npos)
+                pipeline.Push(path, WatchFolder::ResultName(path));
+            else
+                pipeline.Push(path, path.substr(0, slash + 1) + WatchFolder::ResultName(path.substr(slash + 1)));
+        }
+        pipeline.Finish();
+        n_failed = pipeline.getNumFailed();
+        std::cout << "Processed " << argc - 2 << " images, " << n_failed << " failed" << std::endl;
+    }
+    ThreadPool::destroy();
+
+    return (n_failed == 0) ? 0 : 1;
+}
+
+// Processing service of the service mode, stopped by SIGINT and SIGTERM
+static ProcessingService *processing_service = 0;
+
+static void stopServing(int)
+{
+    if (processing_service != 0)
+        processing_service->Stop();
+}
+
+// Service mode: DentalBiometry --serve <socket path>
+static int runService(char *argv[])
+{
+    bool served;
+
+    processing_service = new ProcessingService(argv[2]);
+    // A client that disconnects while a response is written must not stop the service
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, stopServing);
+    std::signal(SIGTERM, stopServing);
+
+    served = processing_service->Run();
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    delete processing_service;
+    processing_service = 0;
+    ThreadPool::destroy();
+
+    return served ? 0 : 1;
+}
+
+// Test client of the service mode: DentalBiometry --client <socket path> <image> [segment|trace]
+static int runServiceClient(int argc, char *argv[])
+{
+    std::vector< std::vector<cv::Point> > curves;
+    ServiceCommand command = SERVICE_SEGMENT;
+    ServiceClient client;
+    ServiceStatus status;
+    cv::Mat image, frame;
+    int i;
+
+    if (argc > 4 && std::string(argv[4]) == "trace")
+        command = SERVICE_TRACE;
+
+    image = cv::imread(argv[3], cv::IMREAD_GRAYSCALE);
+    if (image.empty()) {
+        std::cout << "Cannot read " << argv[3] << std::endl;
+        return 1;
+    }
+    if (!client.Connect(argv[2]))
+        return 1;
+    frame = client.CreateFrame(image.rows, image.cols);
+    if (frame.empty())
+        return 1;
+    image.copyTo(frame);
+
+    status = client.Process(command, curves);
+    std::cout << "Status " << status << ", " << curves.size() << " curves" << std::endl;
+    for (i = 0; i < (int)curves.size(); i++)
+        std::cout << "Curve " << i << ": " << curves.at(i).size() << " points" << std::endl;
+
+    return (status == SERVICE_OK) ? 0 : 1;
+}
+
+// Test mode of the pixel kernels: DentalBiometry --check-kernels
+// Runs the kernels of every instruction set level this CPU supports and compares them with the scalar ones
+static int runKernelCheck()
+{
+    std::cout << "Active level: " << CpuDispatch::LevelName(CpuDispatch::getLevel())
+              << ", supported level: " << CpuDispatch::LevelName(CpuDispatch::getSupportedLevel()) << std::endl;
+
+    return CpuDispatch::CrossCheck() ? 0 : 1;
+}
+
+// Run the mode selected by the command line arguments
+// INPUT: argc, argv -> arguments of main
+// OUTPUT: exit code of the mode, or -1 if the arguments select no mode
+int RunCommandLine(int argc, char *argv[])
+{
+    // Batch modes process many images of the same size, so their buffers are reused.
+    // Installed before the memory tracker, so the tracker counts buffers taken from the pool.
+    if (argc >= 3 && (std::string(argv[1]) == "--watch" || std::string(argv[1]) == "--batch"
+                      || std::string(argv[1]) == "--serve"))
+        BufferPool::install();
+    // Before any thread allocates images, so every buffer is counted
+    MemoryTracker::installIfRequested();
+
+    if (argc >= 3 && std::string(argv[1]) == "--watch")
+        return runWatchFolder(argc, argv);
+    if (argc >= 3 && std::string(argv[1]) == "--batch")
+        return runBatch(argc, argv);
+    if (argc >= 3 && std::string(argv[1]) == "--serve")
+        return runService(argv);
+    if (argc >= 4 && std::string(argv[1]) == "--client")
+        return runServiceClient(argc, argv);
+    if (argc >= 2 && std::string(argv[1]) == "--check-kernels")
+        return runKernelCheck();
+
+    return -1;
+}
+
+// Print the command line modes
+void PrintCommandLineUsage(const char *program)
+{
+    std::cout << "Usage:" << std::endl
+              << "  " << program << " --watch <directory> [queue capacity] [workers]" << std::endl
+              << "  " << program << " --batch <image> [image...]" << std::endl
+              << "  " << program << " --serve <socket path>" << std::endl
+              << "  " << program << " --client <socket path> <image> [segment|trace]" << std::endl
+              << "  " << program << " --check-kernels" << std::endl;
+}
@@ -0,0 +1,15 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+// Command line modes shared by the GUI and the command line tool:
+//   --watch <directory> [queue capacity] [workers]
+//   --serve <socket path>
+//   --client <socket path> <image> [segment|trace]
+
+// Run the mode selected by the command line arguments. -1 if the arguments select no mode.
+int RunCommandLine(int, char*[]);
+
+// Print the command line modes
+void PrintCommandLineUsage(const char*);
+
+#endif // COMMANDLINE_H
@@ -1,3 +0,0 @@
-#include "controller.h"
-
-Controller *Controller::singleton = 0;
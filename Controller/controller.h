@@ -2,52 +2,197 @@
 #define CONTROLLER_H
 
 #include "Model/segmentation.h"
+#include "Model/dentalarch.h"
+#include "Model/dicomreader.h"
 #include "Model/filters.h"
+#include "Model/threadpool.h"
 #include "Model/tracing.h"
+#include <algorithm>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <vector>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
 
 class Controller
 {
 public:
-    // Get access to Singleton instance
-    static Controller *getInstance() {
-        // Creates the instance at first call
-        if (singleton == 0)
-            singleton = new Controller;
-        return singleton;
-    }
-
-    // Release singleton instance of this controller
-    static void destroy() {
-        if (singleton != 0) {
-            delete singleton;
-            singleton = 0;
-        }
+    // Document session. Sessions of the GUI are owned by DocumentManager.
+    // Processor objects are created at first use, so sessions that never trace (e.g. watch folder workers) skip Tracing.
+    Controller() {
     }
 
+    // What a previewed parameter change affects
+    enum PreviewKind {
+        PREVIEW_MEDIAN_SEGMENTATION,
+        PREVIEW_BILATERAL_SEGMENTATION,
+        PREVIEW_SEGMENTATION,
+        PREVIEW_MEDIAN_TRACING,
+        PREVIEW_BILATERAL_TRACING,
+        PREVIEW_SOBEL_TRACING
+    };
+
     // Delete processor objects created by controller
     ~Controller() {
+        // Background jobs use the processor objects
+        if (pending_preview.valid())
+            pending_preview.wait();
+        if (pending_load.valid())
+            pending_load.wait();
+        if (pending_segmentation.valid())
+            pending_segmentation.wait();
         delete segmentation;
         delete tracing;
     }
 
-    // Read image from file and set as input image
+    // Read image from file and set as input image.
+    // Uncompressed DICOM and raw files are memory-mapped and keep their display window.
     bool setInputImage(const std::string& filename) {
-        input_image = cv::imread(filename, cv::IMREAD_GRAYSCALE);
-        if (!input_image.data)
+        DisplayWindow window;
+        cv::Mat image;
+
+        if (!DicomReader::ReadGrayscale(filename, image, window))
             return false;
-        input_image.copyTo(filtered_image_segmentation);
-        input_image.copyTo(filtered_image_tracing);
+        return commitInputImage(filename, image, DentalArch::FindRegion(image), window);
+    }
+
+    // Set an image decoded elsewhere (e.g. by ImagePipeline) as input image
+    bool setInputImage(const std::string& filename, const cv::Mat& image, const DisplayWindow& window = DisplayWindow()) {
+        if (image.empty())
+            return false;
+        return commitInputImage(filename, image, DentalArch::FindRegion(image), window);
+    }
+
+    // Get name of the document (file name of the input image)
+    std::string getName() {
+        return name;
+    }
+
+
+    //// BACKGROUND JOBS ////
+    // Read image from file on the shared worker pool.
+    // A quarter resolution image is decoded first, so there is something to show while the full image is read.
+    bool startLoading(const std::string& filename) {
+        if (isBusy())
+            return false;
+        loading_filename = filename;
+        loading_preview.release();
+        // Queued first, so it is not stuck behind the full decode when there is a single worker
+        pending_preview = ThreadPool::getInstance()->Submit([filename]() {
+            return cv::imread(filename, cv::IMREAD_REDUCED_GRAYSCALE_4);
+        });
+        // The dental arch region is found in the background too, since it scans the whole image
+        pending_load = ThreadPool::getInstance()->Submit([filename]() {
+            LoadedImage loaded;
+            if (DicomReader::ReadGrayscale(filename, loaded.image, loaded.window))
+                loaded.region = DentalArch::FindRegion(loaded.image);
+            return loaded;
+        });
         return true;
     }
 
+    // Get the reduced resolution image of the image being read. Empty if not decoded yet or not loading.
+    cv::Mat getLoadingPreview() {
+        return loading_preview;
+    }
+
+    // Run segmentation on the shared worker pool
+    bool startSegmentation() {
+        if (input_image.empty() || isBusy())
+            return false;
+        if (segmentation_input.empty())
+            segmentation_input = filtered_image_segmentation;
+
+        segmentation_region = getProcessingRegion();
+        Segmentation *job_segmentation = getSegmentation();
+        cv::Mat job_input = segmentation_input;
+        cv::Rect job_region = segmentation_region;
+        pending_segmentation = ThreadPool::getInstance()->Submit([job_segmentation, job_input, job_region]() {
+            return pasteRegion(job_input, job_segmentation->Process(job_input(job_region)), job_region);
+        });
+        return true;
+    }
+
+    // Check if a background job of this session is running.
+    // The session must not be modified while it is busy.
+    bool isBusy() {
+        return pending_load.valid() || pending_segmentation.valid();
+    }
+
+    // Check if no background job of this session is still running, so it can be deleted without waiting.
+    // Finished results that were never collected do not count.
+    bool isIdle() {
+        return isReady(pending_preview) && isReady(pending_load) && isReady(pending_segmentation);
+    }
+
+    // Commit the results of finished background jobs. Called from the thread that owns the session.
+    // OUTPUT: true if any result was committed
+    bool collectResults() {
+        LoadedImage loaded;
+        bool committed = false;
+
+        if (pending_preview.valid()
+                && pending_preview.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            // Only useful while the full image is still being read
+            if (pending_load.valid()) {
+                loading_preview = pending_preview.get();
+                committed = !loading_preview.empty();
+            } else {
+                pending_preview.get();
+            }
+        }
+        if (pending_load.valid()
+                && pending_load.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            loaded = pending_load.get();
+            if (!commitInputImage(loading_filename, loaded.image, loaded.region, loaded.window))
+                std::cout << "Image loading failed: " << loading_filename << std::endl;
+            loading_preview.release();
+            committed = true;
+        }
+        if (pending_segmentation.valid()
+                && pending_segmentation.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            filtered_image_segmentation = pending_segmentation.get();
+            recordSegmentation();
+            committed = true;
+        }
+
+        return committed;
+    }
+
     // Get original input image
     cv::Mat getInputImage() {
         return input_image;
     }
 
+    // Get display window the input image was mapped to gray levels with (DICOM files)
+    DisplayWindow getInputWindow() {
+        return input_window;
+    }
+
+
+    //// DENTAL ARCH REGION ////
+    // Restrict preprocessing and segmentation to the dental arch region
+    void setArchRegionEnabled(const bool& enabled) {
+        arch_region_enabled = enabled;
+    }
+    // Check if preprocessing and segmentation are restricted to the dental arch region
+    bool getArchRegionEnabled() {
+        return arch_region_enabled;
+    }
+    // Get dental arch region found in the input image
+    cv::Rect getArchRegion() {
+        return arch_region;
+    }
+    // Get region preprocessing and segmentation run on: the dental arch region if enabled, the whole image otherwise
+    cv::Rect getProcessingRegion() {
+        if (arch_region_enabled && arch_region.area() > 0)
+            return arch_region;
+        return cv::Rect(0, 0, input_image.cols, input_image.rows);
+    }
+
 
     //// SEGMENTATION PREPROCESSING ////
     // Get segmentation filtered image
@@ -55,19 +200,21 @@ public:
         return filtered_image_segmentation;
     }
 
-    // Reset segmentation image
+    // Reset segmentation image. It shares the pixels of the input image until the next step.
     void resetImageSegmentation() {
-        input_image.copyTo(filtered_image_segmentation);
+        filtered_image_segmentation = input_image;
+        segmentation_input.release();
+        history_segmentation.clear();
     }
 
     // Apply Median Filter to filtered_image for segmentation
     void applyMedianSegmentation() {
-        filtered_image_segmentation = Filters::Median(filtered_image_segmentation, median_kernel_size_segmentation);
+        applySegmentationStep(makeStep(STEP_MEDIAN, median_kernel_size_segmentation, 0, getProcessingRegion()));
     }
 
     // Apply Bilateral Filter to filtered_image for segmentation
     void applyBilateralSegmentation() {
-        filtered_image_segmentation = Filters::Bilateral(filtered_image_segmentation, bilateral_sigma_segmentation);
+        applySegmentationStep(makeStep(STEP_BILATERAL, bilateral_sigma_segmentation, 0, getProcessingRegion()));
     }
 
     // Set median kernel size for segmentation
@@ -98,57 +245,138 @@ public:
     bool runSegmentation() {
         if (input_image.empty())
             return false;
-        filtered_image_segmentation = segmentation->Process(filtered_image_segmentation);
+        // Re-running segmentation (e.g. after a parameter change) starts from the same preprocessed image,
+        // so only the stages affected by the change are recomputed.
+        if (segmentation_input.empty())
+            segmentation_input = filtered_image_segmentation;
+        // Only the dental arch region is segmented. The rest of the image is kept.
+        segmentation_region = getProcessingRegion();
+        filtered_image_segmentation = pasteRegion(segmentation_input,
+                                                  getSegmentation()->Process(segmentation_input(segmentation_region)),
+                                                  segmentation_region);
+        recordSegmentation();
         return true;
     }
 
     // Set line profiles column spacing of segmentation algorithm
     bool setSegmentationLineProfileColumnSpacing(const int& cs) {
-        return segmentation->setLineProfileColumnSpacing(cs);
+        return getSegmentation()->setLineProfileColumnSpacing(cs);
     }
     // Get line profiles column spacing of segmentation algorithm
     int getSegmentationLineProfileColumnSpacing() {
-        return segmentation->getLineProfileColumnSpacing();
+        return getSegmentation()->getLineProfileColumnSpacing();
     }
     // Set line profiles derivative distance of segmentation algorithm
     bool setSegmentationLineProfileDerivativeDistance(const int& dd) {
-        return segmentation->setLineProfileDerivativeDistance(dd);
+        return getSegmentation()->setLineProfileDerivativeDistance(dd);
     }
     // Get line profiles derivative distance of segmentation algorithm
     int getSegmentationLineProfileDerivativeDistance() {
-        return segmentation->getLineProfileDerivativeDistance();
+        return getSegmentation()->getLineProfileDerivativeDistance();
     }
     // Set Spline curve percentge sample size of segmentation algorithm
     bool setSegmentationSplinePctSampleSize(const float& ss) {
-        return segmentation->setSplinePctSampleSize(ss);
+        return getSegmentation()->setSplinePctSampleSize(ss);
     }
     // Get Spline cruve percentage sample size of segmentation algorithm
     float getSegmentationSplinePctSampleSize() {
-        return segmentation->getSplinePctSampleSize();
+        return getSegmentation()->getSplinePctSampleSize();
     }
     // Set necks curves standard deviation threshold of segmentation algorithm
     bool setSegmentationNecksCurvesStdDevThreshold(const float& thr) {
-        return segmentation->setNecksCurvesStdDevThreshold(thr);
+        return getSegmentation()->setNecksCurvesStdDevThreshold(thr);
     }
     // Get necks curves standard deviation threshold of segmentation algorithm
     float getSegmentationNecksCurvesStdDevThreshold() {
-        return segmentation->getNecksCurvesStdDevThreshold();
+        return getSegmentation()->getNecksCurvesStdDevThreshold();
     }
     // Set crown binarization number of segments of segmentation algorithm
     bool setSegmentationCrownBinarizationNumOfSegments(const int& n) {
-        return segmentation->setCrownBinarizationNumOfSegments(n);
+        return getSegmentation()->setCrownBinarizationNumOfSegments(n);
     }
     // Get crown binarization number of segments of segmentation algorithm
     int getSegmentationCrownBinarizationNumOfSegments() {
-        return segmentation->getCrownBinarizationNumOfSegments();
+        return getSegmentation()->getCrownBinarizationNumOfSegments();
     }
     // Set crown binarization percentage threshold of segmentation algorithm
     bool setSegmentationCrownBinarizationPctThreshold(const float& thr) {
-        return segmentation->setCrownBinarizationPctThreshold(thr);
+        return getSegmentation()->setCrownBinarizationPctThreshold(thr);
     }
     // Get crown binarization percentage threshold of segmentation algorithm
     float getSegmentationCrownBinarizationPctThreshold() {
-        return segmentation->getCrownBinarizationPctThreshold();
+        return getSegmentation()->getCrownBinarizationPctThreshold();
+    }
+    // Set number of pyramid levels of segmentation algorithm
+    bool setSegmentationPyramidLevels(const int& levels) {
+        return getSegmentation()->setPyramidLevels(levels);
+    }
+    // Get number of pyramid levels of segmentation algorithm
+    int getSegmentationPyramidLevels() {
+        return getSegmentation()->getPyramidLevels();
+    }
+
+
+    //// LIVE PREVIEW ////
+    // Make a task that previews the current parameters without applying them.
+    // The task holds its own image headers, parameters and Segmentation copy, so it can run on any thread.
+    // Filters and segmentation are previewed on the processing region only, as they would be applied.
+    // INPUT: kind -> what the changed parameter affects
+    // INPUT: max_width -> width of the proxy image the task runs on. 0 = full resolution.
+    // OUTPUT: preview task, or an empty function if there is no image
+    std::function<cv::Mat()> makePreview(const PreviewKind& kind, const int& max_width) {
+        cv::Mat source;
+        cv::Rect region;
+        std::shared_ptr<Segmentation> preview_segmentation;
+        double scale;
+        int median_kernel_size, bilateral_sigma, sobel_kernel_size, sobel_derivative_type;
+
+        if (kind == PREVIEW_SEGMENTATION && !segmentation_input.empty())
+            source = segmentation_input;
+        else if (kind <= PREVIEW_SEGMENTATION)
+            source = filtered_image_segmentation;
+        else
+            source = filtered_image_tracing;
+        if (source.empty())
+            return std::function<cv::Mat()>();
+
+        scale = (max_width > 0 && source.cols > max_width) ? (double)max_width / source.cols : 1;
+        region = getProcessingRegion();
+        median_kernel_size = (kind == PREVIEW_MEDIAN_TRACING) ? median_kernel_size_tracing : median_kernel_size_segmentation;
+        bilateral_sigma = (kind == PREVIEW_BILATERAL_TRACING) ? bilateral_sigma_tracing : bilateral_sigma_segmentation;
+        sobel_kernel_size = sobel_kernel_size_tracing;
+        sobel_derivative_type = sobel_derivative_type_tracing;
+        if (kind == PREVIEW_SEGMENTATION)
+            preview_segmentation = std::make_shared<Segmentation>(*getSegmentation());
+
+        return [=]() -> cv::Mat {
+            cv::Mat image;
+            cv::Rect image_region;
+
+            // Proxy of the image. Filter parameters are kept, so the proxy is an approximation.
+            if (scale < 1)
+                cv::resize(source, image, cv::Size(), scale, scale, cv::INTER_AREA);
+            else
+                image = source;
+            image_region = cv::Rect(cvRound(region.x * scale), cvRound(region.y * scale),
+                                    cvRound(region.width * scale), cvRound(region.height * scale))
+                    & cv::Rect(0, 0, image.cols, image.rows);
+            if (image_region.area() == 0)
+                image_region = cv::Rect(0, 0, image.cols, image.rows);
+
+            switch (kind) {
+            case PREVIEW_MEDIAN_SEGMENTATION:
+            case PREVIEW_MEDIAN_TRACING:
+                return pasteRegion(image, Filters::Median(image(image_region), median_kernel_size), image_region);
+            case PREVIEW_BILATERAL_SEGMENTATION:
+            case PREVIEW_BILATERAL_TRACING:
+                return pasteRegion(image, Filters::Bilateral(image(image_region), bilateral_sigma), image_region);
+            case PREVIEW_SEGMENTATION:
+                return pasteRegion(image, preview_segmentation->Process(image(image_region)), image_region);
+            case PREVIEW_SOBEL_TRACING:
+                return Filters::Sobel(image, sobel_kernel_size, sobel_derivative_type);
+            }
+            return image;
+        };
     }
 
 
@@ -158,24 +386,25 @@ public:
         return filtered_image_tracing;
     }
 
-    // Reset tracing image
+    // Reset tracing image. It shares the pixels of the input image until the next step.
     void resetImageTracing() {
-        input_image.copyTo(filtered_image_tracing);
+        filtered_image_tracing = input_image;
+        history_tracing.clear();
     }
 
     // Apply Median Filter to tracing filtered_image
     void applyMedianTracing() {
-        filtered_image_tracing = Filters::Median(filtered_image_tracing, median_kernel_size_tracing);
+        applyTracingStep(makeStep(STEP_MEDIAN, median_kernel_size_tracing, 0, getProcessingRegion()));
     }
 
     // Apply Bilateral Filter to tracing filtered_image
     void applyBilateralTracing() {
-        filtered_image_tracing = Filters::Bilateral(filtered_image_tracing, bilateral_sigma_tracing);
+        applyTracingStep(makeStep(STEP_BILATERAL, bilateral_sigma_tracing, 0, getProcessingRegion()));
     }
 
     // Apply Sobel Filter to tracing filtered_image
     void applySobelTracing() {
-        filtered_image_tracing = Filters::Sobel(filtered_image_tracing, sobel_kernel_size_tracing, sobel_derivative_type_tracing);
+        applyTracingStep(makeStep(STEP_SOBEL, sobel_kernel_size_tracing, sobel_derivative_type_tracing, cv::Rect()));
     }
 
     // Set median kernel size for tracing
@@ -228,70 +457,205 @@ public:
     bool runTracing() {
         if (input_image.empty())
             return false;
-        filtered_image_tracing = tracing->Process(filtered_image_tracing);
+        applyTracingStep(makeStep(STEP_TRACING, 0, 0, cv::Rect()));
+        return true;
+    }
+
+    // Trace every tooth region found by segmentation concurrently
+    bool runTeethTracing() {
+        vector<cv::Rect> regions;
+        HistoryStep step;
+        int i, j;
+
+        if (input_image.empty())
+            return false;
+        regions = getSegmentation()->getCrownRegions();
+        if (regions.empty())
+            return false;
+        // Regions are relative to the region segmentation ran on
+        for (i = 0; i < (int)regions.size(); i++)
+            regions.at(i) += segmentation_region.tl();
+
+        tooth_contours = getTracing()->ProcessTeeth(filtered_image_tracing, regions);
+
+        // Draw contours on a copy of the tracing image
+        step = makeStep(STEP_DRAW_CONTOURS, 0, 0, cv::Rect());
+        for (i = 0; i < (int)tooth_contours.size(); i++)
+            for (j = 0; j < (int)tooth_contours.at(i).size(); j++)
+                step.points.push_back(tooth_contours.at(i).at(j));
+        applyTracingStep(step);
         return true;
     }
 
+    // Get contours of the last teeth tracing
+    vector< vector<cv::Point> > getToothContours() {
+        return tooth_contours;
+    }
+
     // Set slope and angle distance measurement.
     bool setTracingSlopeAngleDistance(const int& d) {
-        return tracing->setSlopeAngleDistance(d);
+        return getTracing()->setSlopeAngleDistance(d);
     }
     // Get slope and angle distance measurement.
     int getTracingSlopeAngleDistance() {
-        return tracing->getSlopeAngleDistance();
+        return getTracing()->getSlopeAngleDistance();
     }
     // Set intensity threshold for finding the first pixel of contour.
     bool setTracingFirstPixelIntensityThreshold(const int& thr) {
-        return tracing->setFirstPixelIntensityThreshold(thr);
+        return getTracing()->setFirstPixelIntensityThreshold(thr);
     }
     // Get intensity threshold for finding the first pixel of contour.
     int getTracingFirstPixelIntensityThreshold() {
-        return tracing->getFirstPixelIntensityThreshold();
+        return getTracing()->getFirstPixelIntensityThreshold();
     }
     // Set inner margin for finding the first pixel of contour.
     bool setTracingFirstPixelInnerMargin(const int& m) {
-        return tracing->setFirstPixelInnerMargin(m);
+        return getTracing()->setFirstPixelInnerMargin(m);
     }
     // Get inner margin for finding the first pixel of contour.
     int getTracingFirstPixelInnerMargin() {
-        return tracing->getFirstPixelInnerMargin();
+        return getTracing()->getFirstPixelInnerMargin();
+    }
+    // Set number of candidate first pixels of contour.
+    bool setTracingFirstPixelNumCandidates(const int& n) {
+        return getTracing()->setFirstPixelNumCandidates(n);
+    }
+    // Get number of candidate first pixels of contour.
+    int getTracingFirstPixelNumCandidates() {
+        return getTracing()->getFirstPixelNumCandidates();
     }
     // Set relative max height of crown tracing
     bool setTracingCrownTracingMaxPctHeight(const float& h) {
-        return tracing->setCrownTracingMaxPctHeight(h);
+        return getTracing()->setCrownTracingMaxPctHeight(h);
     }
     // Get relative max height of crown tracing
     float getTracingCrownTracingMaxPctHeight() {
-        return tracing->getCrownTracingMaxPctHeight();
+        return getTracing()->getCrownTracingMaxPctHeight();
     }
     // Set the extrapolation distance for crown tracing
     bool setTracingCrownTracingExtrapolationDistance(const int& d) {
-        return tracing->setCrownTracingExtrapolationDistance(d);
+        return getTracing()->setCrownTracingExtrapolationDistance(d);
     }
     // Get the extrapolation distance for crown tracing
     int getTracingCrownTracingExtrapolationDistance() {
-        return tracing->getCrownTracingExtrapolationDistance();
+        return getTracing()->getCrownTracingExtrapolationDistance();
     }
     // Set mask of fittest pixel finding for crown tracing
     bool setTracingCrownTracingExtrapolationMask(const int& m) {
-        return tracing->setCrownTracingExtrapolationMask(m);
+        return getTracing()->setCrownTracingExtrapolationMask(m);
     }
     // Get mask of fittest pixel finding for crown tracing
     int getTracingCrownTracingExtrapolationMask() {
-        return tracing->getCrownTracingExtrapolationMask();
+        return getTracing()->getCrownTracingExtrapolationMask();
+    }
+    // Set tracing engine (0 = greedy, 1 = minimal path)
+    bool setTracingEngine(const int& e) {
+        return getTracing()->setTracingEngine(e);
+    }
+    // Get tracing engine (0 = greedy, 1 = minimal path)
+    int getTracingEngine() {
+        return getTracing()->getTracingEngine();
+    }
+
+
+    //// HISTORY ////
+    // Undo the last step applied to the segmentation image.
+    // The image before a segmentation is still held, so undoing it is free. Other steps are undone
+    // by replaying the rest of the history from the input image.
+    // OUTPUT: false if there is nothing to undo or a background job is running
+    bool undoSegmentation() {
+        HistoryStep step;
+
+        if (history_segmentation.empty() || isBusy())
+            return false;
+        step = history_segmentation.back();
+        history_segmentation.pop_back();
+
+        if (step.kind == STEP_SEGMENTATION && !segmentation_input.empty())
+            filtered_image_segmentation = segmentation_input;
+        else
+            filtered_image_segmentation = replayHistory(history_segmentation);
+        // Only valid while the last step is a segmentation
+        if (history_segmentation.empty() || history_segmentation.back().kind != STEP_SEGMENTATION)
+            segmentation_input.release();
+        return true;
+    }
+
+    // Undo the last step applied to the tracing image.
+    // Drawn contours are undone by restoring the pixels they overwrote. Other steps are undone
+    // by replaying the rest of the history from the image after the last tracing, or from the input image.
+    // OUTPUT: false if there is nothing to undo or a background job is running
+    bool undoTracing() {
+        HistoryStep step;
+        int i;
+
+        if (history_tracing.empty() || isBusy())
+            return false;
+        step = history_tracing.back();
+        history_tracing.pop_back();
+
+        if (step.kind == STEP_DRAW_CONTOURS) {
+            // Restored backwards, so pixels drawn twice get their value from before the first time
+            filtered_image_tracing = filtered_image_tracing.clone();
+            for (i = (int)step.points.size() - 1; i >= 0; i--)
+                filtered_image_tracing.at<uchar>(step.points.at(i)) = step.values.at(i);
+            tooth_contours.clear();
+        } else {
+            filtered_image_tracing = replayHistory(history_tracing);
+        }
+        return true;
+    }
+
+    // Get number of steps that can be undone on the segmentation image
+    int getSegmentationHistorySize() {
+        return (int)history_segmentation.size();
+    }
+
+    // Get number of steps that can be undone on the tracing image
+    int getTracingHistorySize() {
+        return (int)history_tracing.size();
     }
 private:
     //// INTERNAL OBJECTS ////
-    // Pointer to singleton
-    static Controller *singleton;
-    // Segmentation class instance
-    Segmentation *segmentation;
-    // Tracing class instance
-    Tracing *tracing;
+    // Name of the document
+    std::string name;
+    // Reduced resolution image being read in the background
+    std::future<cv::Mat> pending_preview;
+    // Reduced resolution image of the image being read
+    cv::Mat loading_preview;
+    // Image read in the background
+    struct LoadedImage {
+        cv::Mat image;
+        // Dental arch region of image
+        cv::Rect region;
+        // Display window of a DICOM file
+        DisplayWindow window;
+    };
+    // Image being read in the background
+    std::future<LoadedImage> pending_load;
+    // File name of the image being read in the background
+    std::string loading_filename;
+    // Segmentation running in the background
+    std::future<cv::Mat> pending_segmentation;
+    // Segmentation class instance. Created at first use.
+    Segmentation *segmentation = 0;
+    // Tracing class instance. Created at first use.
+    Tracing *tracing = 0;
     // Original input image
     cv::Mat input_image;
+    // Display window of the input image
+    DisplayWindow input_window;
     // Filtered image for segmentation algorithm
     cv::Mat filtered_image_segmentation;
+    // Preprocessed image the last segmentation ran on
+    cv::Mat segmentation_input;
+    // Region of segmentation_input the last segmentation ran on
+    cv::Rect segmentation_region;
+    // Dental arch region of the input image
+    cv::Rect arch_region;
+    // Flag to restrict preprocessing and segmentation to arch_region. Off by default, so results match
+    // whole-image processing unless the user opts in.
+    bool arch_region_enabled = false;
     // Median Filter kernel size for segmentation algorithm
     int median_kernel_size_segmentation = 5;
     // Bilateral Filter sigma size/color for segmentation algorithm
@@ -306,14 +670,196 @@ private:
     int sobel_kernel_size_tracing = 1;
     // Sobel filter type for tracing algorithm
     int sobel_derivative_type_tracing = 0;
+    // Contours of the last teeth tracing
+    vector< vector<cv::Point> > tooth_contours;
+
+    //// HISTORY ////
+    // Operations of the preprocessing histories
+    enum StepKind {
+        STEP_MEDIAN,            // parameters: kernel size
+        STEP_BILATERAL,         // parameters: sigma
+        STEP_SOBEL,             // parameters: kernel size, derivative type
+        STEP_SEGMENTATION,
+        STEP_TRACING,
+        STEP_DRAW_CONTOURS      // points: contour pixels
+    };
+    // Step of a preprocessing history: the recipe to redo it, and the pixels it overwrote if it only draws.
+    // Only tracings keep their output image, so a long history costs almost no memory.
+    struct HistoryStep {
+        StepKind kind;
+        int parameters[2];
+        // Region the step ran on. Empty for steps on the whole image.
+        cv::Rect region;
+        // Pixels drawn by the step
+        vector<cv::Point> points;
+        // Values of those pixels before the step
+        vector<uchar> values;
+        // Image after the step, for tracings. They are never replayed, since they display their progress.
+        cv::Mat output;
+    };
+    // Steps applied to the segmentation image since it was reset
+    vector<HistoryStep> history_segmentation;
+    // Steps applied to the tracing image since it was reset
+    vector<HistoryStep> history_tracing;
 
 
     //// METHODS ////
-    // Private constructor
-    Controller() {
-        // Setting up the application
-        segmentation = new Segmentation();
-        tracing = new Tracing();
+    // Get segmentation class instance, creating it at first call
+    Segmentation *getSegmentation() {
+        if (segmentation == 0)
+            segmentation = new Segmentation();
+        return segmentation;
+    }
+
+    // Get tracing class instance, creating it at first call
+    Tracing *getTracing() {
+        if (tracing == 0)
+            tracing = new Tracing();
+        return tracing;
+    }
+
+    // Set a decoded image, its dental arch region and its display window as input image.
+    // The filtered images share the pixels of the input image: every step makes a new image
+    // instead of writing in place, so an image is only copied when it is first changed.
+    bool commitInputImage(const std::string& filename, const cv::Mat& image, const cv::Rect& region,
+                          const DisplayWindow& window) {
+        if (!image.data)
+            return false;
+        input_image = image;
+        input_window = window;
+        arch_region = region;
+        filtered_image_segmentation = input_image;
+        filtered_image_tracing = input_image;
+        segmentation_input.release();
+        history_segmentation.clear();
+        history_tracing.clear();
+        name = filename.substr(filename.find_last_of("/\\") + 1);
+        return true;
+    }
+
+    // Make a step of a history
+    static HistoryStep makeStep(const StepKind& kind, const int& parameter0, const int& parameter1, const cv::Rect& region) {
+        HistoryStep step;
+        step.kind = kind;
+        step.parameters[0] = parameter0;
+        step.parameters[1] = parameter1;
+        step.region = region;
+        return step;
+    }
+
+    // Run a step on an image. The output is a new image, since images are shared and never written in place.
+    // INPUT: image -> image before the step
+    // INPUT: step -> step to run. The values of the pixels it draws are recorded in it.
+    // OUTPUT: image after the step
+    cv::Mat runStep(const cv::Mat& image, HistoryStep& step) {
+        cv::Mat output;
+        int k = step.parameters[0];
+        int i;
+
+        switch (step.kind) {
+        case STEP_MEDIAN:
+            return filterRegion(image, step.region, [k](const cv::Mat& region_image) {
+                return Filters::Median(region_image, k);
+            });
+        case STEP_BILATERAL:
+            return filterRegion(image, step.region, [k](const cv::Mat& region_image) {
+                return Filters::Bilateral(region_image, k);
+            });
+        case STEP_SOBEL:
+            return Filters::Sobel(image, k, step.parameters[1]);
+        case STEP_SEGMENTATION:
+            segmentation_input = image;
+            segmentation_region = step.region;
+            return pasteRegion(image, getSegmentation()->Process(image(step.region)), step.region);
+        case STEP_TRACING:
+            step.output = getTracing()->Process(image);
+            return step.output;
+        case STEP_DRAW_CONTOURS:
+            output = image.clone();
+            step.values.resize(step.points.size());
+            for (i = 0; i < (int)step.points.size(); i++) {
+                step.values.at(i) = output.at<uchar>(step.points.at(i));
+                output.at<uchar>(step.points.at(i)) = 255;
+            }
+            return output;
+        }
+        return image;
+    }
+
+    // Rebuild an image by running a history on the input image.
+    // Replay starts after the last step that kept its output image.
+    cv::Mat replayHistory(vector<HistoryStep>& history) {
+        cv::Mat image = input_image;
+        int i, first;
+
+        first = 0;
+        for (i = (int)history.size() - 1; i >= 0 && first == 0; i--)
+            if (!history.at(i).output.empty())
+                first = i + 1;
+        if (first > 0)
+            image = history.at(first - 1).output;
+
+        for (i = first; i < (int)history.size(); i++)
+            image = runStep(image, history.at(i));
+        return image;
+    }
+
+    // Run a step on the segmentation image and record it
+    void applySegmentationStep(HistoryStep step) {
+        filtered_image_segmentation = runStep(filtered_image_segmentation, step);
+        history_segmentation.push_back(step);
+        segmentation_input.release();
+    }
+
+    // Run a step on the tracing image and record it
+    void applyTracingStep(HistoryStep step) {
+        filtered_image_tracing = runStep(filtered_image_tracing, step);
+        history_tracing.push_back(step);
+    }
+
+    // Record a segmentation of segmentation_input. A re-run starts from the same image, so it replaces the last one.
+    void recordSegmentation() {
+        if (!history_segmentation.empty() && history_segmentation.back().kind == STEP_SEGMENTATION)
+            history_segmentation.pop_back();
+        history_segmentation.push_back(makeStep(STEP_SEGMENTATION, 0, 0, segmentation_region));
+    }
+
+    // Apply a filter only within a region. Pixels outside the region are kept.
+    // The filtered region is pasted in place when no other image shares the input, e.g. from the second step of a
+    // history on, and into a copy otherwise, since the input may be shared with a preview or the last segmentation.
+    // The caller replaces the input with the output.
+    cv::Mat filterRegion(const cv::Mat& image, const cv::Rect& region, const std::function<cv::Mat(const cv::Mat&)>& filter) {
+        cv::Mat filtered, output;
+        if (region == cv::Rect(0, 0, image.cols, image.rows))
+            return filter(image);
+        // Filtered before anything is written, since filters read the pixels around the region for its border
+        filtered = filter(image(region));
+        output = writableImage(image);
+        filtered.copyTo(output(region));
+        return output;
+    }
+
+    // Get an image whose pixels can be written: the image itself if no other image shares its pixels, a copy otherwise
+    static cv::Mat writableImage(const cv::Mat& image) {
+        if (image.u != 0 && image.u->refcount == 1 && !image.isSubmatrix())
+            return image;
+        return image.clone();
+    }
+
+    // Check if a background job is done or was never started
+    template<class T>
+    static bool isReady(const std::future<T>& job) {
+        return !job.valid() || job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // Get a copy of an image with a region replaced by another image
+    static cv::Mat pasteRegion(const cv::Mat& image, const cv::Mat& region_image, const cv::Rect& region) {
+        cv::Mat output;
+        if (region == cv::Rect(0, 0, image.cols, image.rows))
+            return region_image;
+        output = image.clone();
+        region_image.copyTo(output(region));
+        return output;
     }
 };
 
@@ -0,0 +1,73 @@
+#include "documentmanager.h"
+#include <algorithm>
+
+DocumentManager::DocumentManager() :
+    _active_session(0) {
+}
+
+// Wait for the background jobs of every session, open or closed, and delete them
+DocumentManager::~DocumentManager() {
+    int i;
+
+    // The destructor of a session waits for its jobs
+    for (i = 0; i < (int)_sessions.size(); i++)
+        delete _sessions.at(i);
+    for (i = 0; i < (int)_closed_sessions.size(); i++)
+        delete _closed_sessions.at(i);
+}
+
+// Get the active session. Creates the first one at first call.
+Controller *DocumentManager::getActiveSession() {
+    if (_active_session == 0)
+        createSession();
+    return _active_session;
+}
+
+// Make an open session the active one
+void DocumentManager::setActiveSession(Controller *session) {
+    if (std::find(_sessions.begin(), _sessions.end(), session) != _sessions.end())
+        _active_session = session;
+}
+
+// Create a new session and make it the active one
+Controller *DocumentManager::createSession() {
+    Controller *session = new Controller;
+
+    _sessions.push_back(session);
+    _active_session = session;
+
+    return session;
+}
+
+// Close a session without waiting for its background jobs.
+// It is deleted right away if it is idle, or by a later collectClosedSessions otherwise.
+void DocumentManager::closeSession(Controller *session) {
+    std::vector<Controller*>::iterator it;
+
+    it = std::find(_sessions.begin(), _sessions.end(), session);
+    if (it == _sessions.end())
+        return;
+    _sessions.erase(it);
+    if (_active_session == session)
+        _active_session = _sessions.empty() ? 0 : _sessions.back();
+
+    _closed_sessions.push_back(session);
+    collectClosedSessions();
+}
+
+// Delete closed sessions whose background jobs are done
+// OUTPUT: true if some closed session is still waiting for its jobs
+bool DocumentManager::collectClosedSessions() {
+    std::vector<Controller*> waiting;
+    int i;
+
+    for (i = 0; i < (int)_closed_sessions.size(); i++) {
+        if (_closed_sessions.at(i)->isIdle())
+            delete _closed_sessions.at(i);
+        else
+            waiting.push_back(_closed_sessions.at(i));
+    }
+    _closed_sessions.swap(waiting);
+
+    return !_closed_sessions.empty();
+}
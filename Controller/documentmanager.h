@@ -0,0 +1,54 @@
+#ifndef DOCUMENTMANAGER_H
+#define DOCUMENTMANAGER_H
+
+#include "controller.h"
+#include <vector>
+
+// Document sessions open in the GUI, and the one it works on.
+// Closed sessions may still have background jobs using their images and processor objects,
+// so they are kept aside and deleted once their jobs are done, instead of waiting on the GUI thread.
+class DocumentManager
+{
+public:
+    DocumentManager();
+
+    // Wait for the background jobs of every session, open or closed, and delete them
+    ~DocumentManager();
+
+    // Get the active session. Creates the first one at first call.
+    Controller *getActiveSession();
+
+    // Make an open session the active one
+    void setActiveSession(Controller*);
+
+    // Get open sessions in creation order
+    std::vector<Controller*> getSessions() {
+        return _sessions;
+    }
+
+    // Create a new session and make it the active one
+    Controller *createSession();
+
+    // Close a session without waiting for its background jobs.
+    // If it was the active one, the last remaining session becomes active.
+    void closeSession(Controller*);
+
+    // Delete closed sessions whose background jobs are done
+    // OUTPUT: true if some closed session is still waiting for its jobs
+    bool collectClosedSessions();
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Open sessions
+    std::vector<Controller*> _sessions;
+    // Closed sessions waiting for their background jobs
+    std::vector<Controller*> _closed_sessions;
+    // Session the GUI works on
+    Controller *_active_session;
+
+    // Not copyable, since it owns the sessions
+    DocumentManager(const DocumentManager&);
+    DocumentManager& operator=(const DocumentManager&);
+};
+
+#endif // DOCUMENTMANAGER_H
@@ -0,0 +1,201 @@
+#include "imagepipeline.h"
+#include "Model/bufferpool.h"
+#include "Model/memorytracker.h"
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <opencv2/imgcodecs.hpp>
+
+namespace {
+// Time between checks of the cancel flag of Push while the decoding queue is full
+const std::chrono::milliseconds CANCEL_INTERVAL(500);
+}
+
+// Pipeline with at most capacity images waiting to be decoded, processing up to n_sessions at once
+ImagePipeline::ImagePipeline(const int& capacity, const int& n_sessions) :
+    _to_decode(capacity),
+    _to_process(n_sessions),
+    _to_write(n_sessions),
+    _finished(false),
+    _n_written(0),
+    _n_failed(0) {
+    int i;
+
+    for (i = 0; i < std::max(1, n_sessions); i++)
+        _sessions.push_back(new Controller);
+    _idle_sessions = _sessions;
+
+    _decoder = std::thread(&ImagePipeline::DecodeLoop, this);
+    _writer = std::thread(&ImagePipeline::WriteLoop, this);
+}
+
+// Finish the pushed images and close the sessions
+ImagePipeline::~ImagePipeline() {
+    int i;
+
+    Finish();
+    for (i = 0; i < (int)_sessions.size(); i++)
+        delete _sessions.at(i);
+}
+
+// Queue an image to process. Blocks while the decoding queue is full,
+// so a burst of images waits in the file system instead of piling up in memory.
+// INPUT: input_path -> path of the input image
+// INPUT: result_path -> path the segmentation result is written to
+// INPUT: cancelled -> flag making Push give up waiting for room, e.g. a stop flag set by a signal handler
+// OUTPUT: false if the pipeline is finished or Push was cancelled
+bool ImagePipeline::Push(const std::string& input_path, const std::string& result_path,
+                         const std::atomic<bool>* cancelled) {
+    Item item;
+
+    item.input_path = input_path;
+    item.result_path = result_path;
+
+    if (_to_decode.getSize() >= _to_decode.getCapacity())
+        std::cout << "Queue full (" << _to_decode.getCapacity() << " images). Waiting before queueing "
+                  << input_path << std::endl;
+    if (cancelled != 0 ? !_to_decode.Push(item, *cancelled, CANCEL_INTERVAL) : !_to_decode.Push(item))
+        return false;
+    std::cout << "Queued " << input_path << std::endl;
+
+    return true;
+}
+
+// Wait until every pushed image is written or failed. No image can be pushed after.
+// Stages are closed in order, each once the previous one has emptied its queue.
+void ImagePipeline::Finish() {
+    if (_finished)
+        return;
+    _finished = true;
+
+    _to_decode.Close();
+    _decoder.join();
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _session_idle.wait(lock, [this]() {
+            return _idle_sessions.size() == _sessions.size() && _to_process.getSize() == 0;
+        });
+    }
+    _to_process.Close();
+
+    _to_write.Close();
+    _writer.join();
+}
+
+// Decode queued images and queue them for processing.
+// If a session is idle, a task is started on the shared pool to process the queue with it.
+void ImagePipeline::DecodeLoop() {
+    Controller *session;
+    Item item;
+
+    while (_to_decode.Pop(item)) {
+        if (!DicomReader::ReadGrayscale(item.input_path, item.image, item.window)) {
+            Fail(item);
+            continue;
+        }
+        if (!_to_process.Push(item))
+            return;
+
+        // Queued before a session is looked for, so a session going idle meanwhile is woken here
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_idle_sessions.empty())
+            continue;
+        session = _idle_sessions.back();
+        _idle_sessions.pop_back();
+        lock.unlock();
+
+        ThreadPool::getInstance()->Submit([this, session]() { Drain(session); });
+    }
+}
+
+// Process decoded images with a session until none is left, then leave the session idle.
+// Runs on the shared pool, so the parallel stages of each image share its threads with the other images.
+void ImagePipeline::Drain(Controller* session) {
+    Item item;
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            // Notified under the lock, since Finish may destroy the pipeline as soon as the last session is idle
+            if (!_to_process.TryPop(item)) {
+                _idle_sessions.push_back(session);
+                _session_idle.notify_all();
+                return;
+            }
+        }
+
+        // A corrupt image may make OpenCV throw. The session must go back to idle whatever happens,
+        // or Finish would wait for it forever.
+        try {
+            if (!ProcessImage(session, item) || !_to_write.Push(item))
+                Fail(item);
+        } catch (const std::exception& e) {
+            std::cout << "Error processing " << item.input_path << ": " << e.what() << std::endl;
+            Fail(item);
+        } catch (...) {
+            Fail(item);
+        }
+    }
+}
+
+// Write results until the writing queue is closed and empty
+void ImagePipeline::WriteLoop() {
+    Item item;
+
+    while (_to_write.Pop(item)) {
+        if (!WriteResult(item)) {
+            Fail(item);
+            continue;
+        }
+        _n_written++;
+        std::cout << "Wrote " << item.result_path << std::endl;
+    }
+}
+
+// Run preprocessing and segmentation on a decoded image
+// INPUT: session -> idle document session
+// INPUT: item -> decoded image. Its image is replaced by the result.
+// OUTPUT: true if segmentation succeeded
+bool ImagePipeline::ProcessImage(Controller* session, Item& item) {
+    // Memory of the processing of the study; the decoded image is counted in the total only
+    MemoryScope memory_scope(item.input_path.substr(item.input_path.find_last_of('/') + 1));
+
+    if (!session->setInputImage(item.input_path, item.image, item.window))
+        return false;
+    BufferPool::BeginImage();
+
+    session->applyMedianSegmentation();
+    session->applyBilateralSegmentation();
+    if (!session->runSegmentation())
+        return false;
+    item.image = session->getFilteredImageSegmentation();
+
+    return true;
+}
+
+// Write a result under a hidden name and rename it, so it appears complete or not at all
+bool ImagePipeline::WriteResult(const Item& item) {
+    std::string temporary_path;
+    size_t slash;
+
+    slash = item.result_path.find_last_of('/');
+    temporary_path = (slash == std::string::npos) ? "." + item.result_path
+            : item.result_path.substr(0, slash + 1) + "." + item.result_path.substr(slash + 1);
+
+    if (!cv::imwrite(temporary_path, item.image))
+        return false;
+    if (std::rename(temporary_path.c_str(), item.result_path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Count a failed image
+void ImagePipeline::Fail(const Item& item) {
+    _n_failed++;
+    std::cout << "Failed to process " << item.input_path << std::endl;
+}
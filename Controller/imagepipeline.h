@@ -0,0 +1,104 @@
+#ifndef IMAGEPIPELINE_H
+#define IMAGEPIPELINE_H
+
+#include "controller.h"
+#include "Model/boundedqueue.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Batch processing of images in three overlapped stages: decoding, processing (preprocessing and
+// segmentation) and writing the result. Stages are connected by bounded queues, so image N+1 is
+// decoded and image N-1 written while image N is processed, and a slow stage holds back the others
+// instead of letting images pile up in memory. Queued paths are cheap; decoded images and results
+// waiting for the next stage are limited to one per session.
+// Decoding and writing run on a thread each, since they mostly wait for storage.
+// Processing runs on the shared pool, with a document session per image processed at once.
+class ImagePipeline
+{
+public:
+    // Pipeline with at most capacity images waiting to be decoded, processing up to n_sessions at once
+    ImagePipeline(const int& = 16, const int& = 2);
+
+    // Finish the pushed images and close the sessions
+    ~ImagePipeline();
+
+    // Queue an image to process. Blocks while the decoding queue is full, unless cancelled is set.
+    bool Push(const std::string&, const std::string&, const std::atomic<bool>* = 0);
+
+    // Wait until every pushed image is written or failed. No image can be pushed after.
+    void Finish();
+
+    // Get number of images written
+    int getNumWritten() {
+        return _n_written;
+    }
+
+    // Get number of images that failed
+    int getNumFailed() {
+        return _n_failed;
+    }
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Image on its way through the stages
+    struct Item {
+        // Path of the input image
+        std::string input_path;
+        // Path of the result
+        std::string result_path;
+        // Decoded input image, then result
+        cv::Mat image;
+        // Display window of a DICOM input
+        DisplayWindow window;
+    };
+    // Images waiting to be decoded
+    BoundedQueue<Item> _to_decode;
+    // Images waiting to be processed
+    BoundedQueue<Item> _to_process;
+    // Results waiting to be written
+    BoundedQueue<Item> _to_write;
+    // Thread of the decoding stage
+    std::thread _decoder;
+    // Thread of the writing stage
+    std::thread _writer;
+    // Document sessions, one per image processed at once
+    std::vector<Controller*> _sessions;
+    // Sessions not processing an image
+    std::vector<Controller*> _idle_sessions;
+    // Guards _idle_sessions, so an image queued for processing always finds a session
+    std::mutex _mutex;
+    // Wakes Finish when a session becomes idle
+    std::condition_variable _session_idle;
+    // Flag set by Finish
+    bool _finished;
+    // Number of images written
+    std::atomic<int> _n_written;
+    // Number of images that failed
+    std::atomic<int> _n_failed;
+
+    //// METHODS ////
+    // Decode queued images and queue them for processing
+    void DecodeLoop();
+
+    // Process decoded images with a session until none is left. Runs on the shared pool.
+    void Drain(Controller*);
+
+    // Write results until the writing queue is closed and empty
+    void WriteLoop();
+
+    // Run preprocessing and segmentation on a decoded image
+    bool ProcessImage(Controller*, Item&);
+
+    // Write a result under a hidden name and rename it
+    static bool WriteResult(const Item&);
+
+    // Count a failed image
+    void Fail(const Item&);
+};
+
+#endif // IMAGEPIPELINE_H
@@ -0,0 +1,303 @@
+#include "processingservice.h"
+#include "Model/bufferpool.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+// Time between checks of the stop flag while waiting, in ms
+const int WAIT_INTERVAL = 500;
+
+// Read-only mapping of a frame in a shared memory object. Unmapped when destroyed.
+struct SharedFrame {
+    SharedFrame() : data(MAP_FAILED), size(0) {}
+    ~SharedFrame() {
+        if (data != MAP_FAILED)
+            munmap(data, size);
+    }
+    void *data;
+    size_t size;
+};
+}
+
+// Serve clients until Stop is called. Each client is served by its own thread.
+// OUTPUT: false if the socket cannot be created
+bool ProcessingService::Run() {
+    struct sockaddr_un address;
+    struct pollfd pfd;
+    std::list<Client>::iterator client;
+    int listen_fd, client_fd;
+
+    if (_socket_path.size() >= sizeof(address.sun_path)) {
+        std::cout << "Socket path too long: " << _socket_path << std::endl;
+        return false;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        std::perror("socket");
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, _socket_path.c_str());
+    // A socket file left by a previous run
+    unlink(_socket_path.c_str());
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd, 8) < 0) {
+        std::perror(_socket_path.c_str());
+        close(listen_fd);
+        return false;
+    }
+
+    std::cout << "Processing service listening on " << _socket_path << std::endl;
+
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+    while (!_stop) {
+        // A long running service sees many short connections, so their threads are joined as they end
+        JoinFinishedClients();
+        if (poll(&pfd, 1, WAIT_INTERVAL) <= 0)
+            continue;
+        client_fd = accept(listen_fd, 0, 0);
+        if (client_fd < 0)
+            continue;
+        client = _clients.emplace(_clients.end());
+        client->thread = std::thread(&ProcessingService::HandleClient, this, client_fd, &client->finished);
+    }
+
+    close(listen_fd);
+    unlink(_socket_path.c_str());
+    for (client = _clients.begin(); client != _clients.end(); ++client)
+        client->thread.join();
+    _clients.clear();
+
+    std::cout << "Processing service stopped." << std::endl;
+
+    return true;
+}
+
+// Read and answer requests of a client until it disconnects.
+// A request that throws (e.g. OpenCV on a corrupt frame) is answered with SERVICE_ERROR,
+// so neither the client nor the service is brought down by it.
+// INPUT: fd -> socket of the client. Closed on return.
+// INPUT: finished -> flag set on return, so Run can join the thread
+void ProcessingService::HandleClient(int fd, std::atomic<bool>* finished) {
+    std::vector< std::vector<cv::Point> > curves;
+    std::vector<char> message;
+    ServiceRequest request;
+    ServiceResponse response;
+    bool connected;
+
+    connected = true;
+    while (connected && ReadFully(fd, &request, sizeof(request))) {
+        curves.clear();
+        response.magic = SERVICE_MAGIC;
+        try {
+            response.status = HandleRequest(request, curves);
+        } catch (const std::exception& e) {
+            std::cout << "Error processing request: " << e.what() << std::endl;
+            curves.clear();
+            response.status = SERVICE_ERROR;
+        } catch (...) {
+            curves.clear();
+            response.status = SERVICE_ERROR;
+        }
+        response.n_curves = curves.size();
+
+        message = SerializeResponse(response, curves);
+        connected = WriteFully(fd, message.data(), message.size());
+    }
+
+    close(fd);
+    *finished = true;
+}
+
+// Join the threads of clients that disconnected
+void ProcessingService::JoinFinishedClients() {
+    std::list<Client>::iterator client;
+
+    for (client = _clients.begin(); client != _clients.end();) {
+        if (!client->finished) {
+            ++client;
+            continue;
+        }
+        client->thread.join();
+        client = _clients.erase(client);
+    }
+}
+
+// Lay out a response header and its curves in one buffer, so a response takes one write
+// instead of one per point
+std::vector<char> ProcessingService::SerializeResponse(const ServiceResponse& response,
+                                                       const std::vector< std::vector<cv::Point> >& curves) {
+    std::vector<char> message;
+    size_t size, offset;
+    uint32_t n;
+    int32_t xy[2];
+    int i, j;
+
+    size = sizeof(response);
+    for (i = 0; i < (int)curves.size(); i++)
+        size += sizeof(n) + curves.at(i).size() * sizeof(xy);
+    message.resize(size);
+
+    std::memcpy(message.data(), &response, sizeof(response));
+    offset = sizeof(response);
+    for (i = 0; i < (int)curves.size(); i++) {
+        n = curves.at(i).size();
+        std::memcpy(message.data() + offset, &n, sizeof(n));
+        offset += sizeof(n);
+        for (j = 0; j < (int)n; j++) {
+            xy[0] = curves.at(i).at(j).x;
+            xy[1] = curves.at(i).at(j).y;
+            std::memcpy(message.data() + offset, xy, sizeof(xy));
+            offset += sizeof(xy);
+        }
+    }
+
+    return message;
+}
+
+// Run a request on its frame.
+// The frame is mapped read-only and wrapped in a cv::Mat header, so pixels are neither decoded nor copied.
+// INPUT: request -> request read from the client
+// OUTPUT: curves -> curves of the response
+// OUTPUT: status of the response
+ServiceStatus ProcessingService::HandleRequest(const ServiceRequest& request, std::vector< std::vector<cv::Point> >& curves) {
+    SharedFrame frame;
+    std::string name;
+    struct stat info;
+    cv::Mat image;
+    pair<Curve, Curve> crowns, necks;
+    vector<cv::Rect> regions;
+    int fd, i;
+
+    if (request.magic != SERVICE_MAGIC
+            || (request.command != SERVICE_SEGMENT && request.command != SERVICE_TRACE))
+        return SERVICE_BAD_REQUEST;
+
+    // Every request runs on fresh copies: cached stages would not notice new pixels at a reused mapping address
+    std::unique_lock<std::mutex> lock(_parameters_mutex);
+    Segmentation segmentation(_segmentation);
+    Tracing tracing(_tracing);
+    lock.unlock();
+
+    if (!segmentation.setLineProfileColumnSpacing(request.column_spacing)
+            || !segmentation.setLineProfileDerivativeDistance(request.derivative_distance)
+            || !segmentation.setSplinePctSampleSize(request.spline_pct_sample_size)
+            || !segmentation.setNecksCurvesStdDevThreshold(request.neck_sd_threshold)
+            || !segmentation.setCrownBinarizationNumOfSegments(request.n_segments)
+            || !segmentation.setCrownBinarizationPctThreshold(request.binarization_pct_threshold)
+            || !segmentation.setPyramidLevels(request.pyramid_levels))
+        return SERVICE_BAD_REQUEST;
+
+    // Map the frame
+    name.assign(request.frame_name, strnlen(request.frame_name, sizeof(request.frame_name)));
+    if (request.rows == 0 || request.cols == 0 || request.step < request.cols)
+        return SERVICE_BAD_FRAME;
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return SERVICE_BAD_FRAME;
+    frame.size = (size_t)request.rows * request.step;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < frame.size) {
+        close(fd);
+        return SERVICE_BAD_FRAME;
+    }
+    frame.data = mmap(0, frame.size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (frame.data == MAP_FAILED)
+        return SERVICE_BAD_FRAME;
+
+    // Segmentation never writes to its input
+    image = cv::Mat(request.rows, request.cols, CV_8U, frame.data, request.step);
+    BufferPool::BeginImage();
+    segmentation.Process(image);
+
+    if (request.command == SERVICE_SEGMENT) {
+        crowns = segmentation.getCrownCurves();
+        necks = segmentation.getNecksCurves();
+        curves.push_back(crowns.first.ToPoints());
+        curves.push_back(crowns.second.ToPoints());
+        curves.push_back(necks.first.ToPoints());
+        curves.push_back(necks.second.ToPoints());
+        return SERVICE_OK;
+    }
+
+    regions = segmentation.getCrownRegions();
+    if (regions.empty())
+        return SERVICE_FAILED;
+    curves = tracing.ProcessTeeth(image, regions);
+    for (i = 0; i < (int)curves.size(); i++)
+        if (!curves.at(i).empty())
+            return SERVICE_OK;
+
+    return SERVICE_FAILED;
+}
+
+// Wait until a socket is readable or the service stops
+bool ProcessingService::WaitReadable(int fd) {
+    struct pollfd pfd;
+    int ready;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!_stop) {
+        ready = poll(&pfd, 1, WAIT_INTERVAL);
+        if (ready > 0)
+            return true;
+        if (ready < 0 && errno != EINTR)
+            return false;
+    }
+
+    return false;
+}
+
+// Read exactly n bytes from a socket
+// OUTPUT: false if the client disconnected or the service stopped
+bool ProcessingService::ReadFully(int fd, void* buffer, size_t n) {
+    char *p = (char*)buffer;
+    ssize_t length;
+
+    while (n > 0) {
+        if (!WaitReadable(fd))
+            return false;
+        length = read(fd, p, n);
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            return false;
+        p += length;
+        n -= length;
+    }
+
+    return true;
+}
+
+// Write exactly n bytes to a socket. SIGPIPE must be ignored, or a client that disconnects stops the process.
+// OUTPUT: false if the client disconnected
+bool ProcessingService::WriteFully(int fd, const void* buffer, size_t n) {
+    const char *p = (const char*)buffer;
+    ssize_t length;
+
+    while (n > 0) {
+        length = write(fd, p, n);
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            return false;
+        p += length;
+        n -= length;
+    }
+
+    return true;
+}
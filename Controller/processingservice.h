@@ -0,0 +1,86 @@
+#ifndef PROCESSINGSERVICE_H
+#define PROCESSINGSERVICE_H
+
+#include "serviceprotocol.h"
+#include "Model/segmentation.h"
+#include "Model/tracing.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+
+class ProcessingService
+{
+public:
+    // Service listening on a Unix domain socket path
+    ProcessingService(const std::string& socket_path) : _socket_path(socket_path),
+        _stop(false) {
+    }
+
+    // Serve clients until Stop is called
+    bool Run();
+
+    // Ask Run to return. Safe to call from a signal handler.
+    void Stop() {
+        _stop = true;
+    }
+
+    // Get segmentation parameters used for requests
+    Segmentation& getSegmentation() {
+        return _segmentation;
+    }
+
+    // Get tracing parameters used for requests
+    Tracing& getTracing() {
+        return _tracing;
+    }
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Thread serving a connected client
+    struct Client {
+        Client() : finished(false) {}
+        std::thread thread;
+        // Set by the thread when the client disconnects
+        std::atomic<bool> finished;
+    };
+    // Path of the Unix domain socket
+    std::string _socket_path;
+    // Flag telling the accept loop and the clients to finish
+    std::atomic<bool> _stop;
+    // Clients not joined yet. A list, so each thread keeps a valid pointer to its flag.
+    std::list<Client> _clients;
+    // Default parameters of segmentation. Each request runs on its own copy.
+    Segmentation _segmentation;
+    // Parameters of tracing. Each request runs on its own copy.
+    Tracing _tracing;
+    // Guards copies of _segmentation and _tracing
+    std::mutex _parameters_mutex;
+
+    //// METHODS ////
+    // Read and answer requests of a client until it disconnects
+    void HandleClient(int, std::atomic<bool>*);
+
+    // Join the threads of clients that disconnected
+    void JoinFinishedClients();
+
+    // Run a request on its frame
+    ServiceStatus HandleRequest(const ServiceRequest&, std::vector< std::vector<cv::Point> >&);
+
+    // Lay out a response header and its curves in one buffer
+    static std::vector<char> SerializeResponse(const ServiceResponse&, const std::vector< std::vector<cv::Point> >&);
+
+    // Wait until a socket is readable or the service stops
+    bool WaitReadable(int);
+
+    // Read exactly n bytes from a socket
+    bool ReadFully(int, void*, size_t);
+
+    // Write exactly n bytes to a socket
+    static bool WriteFully(int, const void*, size_t);
+};
+
+#endif // PROCESSINGSERVICE_H
@@ -0,0 +1,191 @@
+#include "serviceclient.h"
+#include "Model/segmentation.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+// Frames created by this process, so every frame of every client gets its own name
+std::atomic<unsigned> n_frames(0);
+}
+
+// Client with default segmentation parameters
+ServiceClient::ServiceClient() : _fd(-1),
+    _frame_data(MAP_FAILED),
+    _frame_size(0) {
+    Segmentation defaults;
+
+    std::memset(&_request, 0, sizeof(_request));
+    _request.magic = SERVICE_MAGIC;
+    _request.column_spacing = defaults.getLineProfileColumnSpacing();
+    _request.derivative_distance = defaults.getLineProfileDerivativeDistance();
+    _request.spline_pct_sample_size = defaults.getSplinePctSampleSize();
+    _request.neck_sd_threshold = defaults.getNecksCurvesStdDevThreshold();
+    _request.n_segments = defaults.getCrownBinarizationNumOfSegments();
+    _request.binarization_pct_threshold = defaults.getCrownBinarizationPctThreshold();
+    _request.pyramid_levels = defaults.getPyramidLevels();
+}
+
+// Disconnect and release the frame
+ServiceClient::~ServiceClient() {
+    ReleaseFrame();
+    if (_fd >= 0)
+        close(_fd);
+}
+
+// Connect to a service listening on a Unix domain socket path
+bool ServiceClient::Connect(const std::string& socket_path) {
+    struct sockaddr_un address;
+
+    if (socket_path.size() >= sizeof(address.sun_path))
+        return false;
+
+    _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_fd < 0) {
+        std::perror("socket");
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socket_path.c_str());
+    if (connect(_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        std::perror(socket_path.c_str());
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+// Get a frame in shared memory to write pixels to, so they reach the service without copies.
+// The frame stays valid until the next call or until the client is destroyed.
+// Frames are named after the process and a counter, so clients of one process and of several processes
+// never share a name. A frame of that name can only be left by a crashed process that had the same pid,
+// so it is removed and created again.
+// INPUT: rows, cols -> size of the 8-bit grayscale frame
+// OUTPUT: frame, or an empty image if shared memory is not available
+cv::Mat ServiceClient::CreateFrame(const int& rows, const int& cols) {
+    int fd;
+
+    ReleaseFrame();
+
+    std::snprintf(_request.frame_name, sizeof(_request.frame_name), "/dentalbiometry-%d-%u", (int)getpid(),
+                  n_frames++);
+    _request.rows = rows;
+    _request.cols = cols;
+    _request.step = cols;
+    _frame_size = (size_t)rows * cols;
+
+    fd = shm_open(_request.frame_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        std::cout << "Removing stale frame " << _request.frame_name << std::endl;
+        shm_unlink(_request.frame_name);
+        fd = shm_open(_request.frame_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        std::perror(_request.frame_name);
+        return cv::Mat();
+    }
+    if (ftruncate(fd, _frame_size) != 0) {
+        close(fd);
+        shm_unlink(_request.frame_name);
+        return cv::Mat();
+    }
+    _frame_data = mmap(0, _frame_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_frame_data == MAP_FAILED) {
+        shm_unlink(_request.frame_name);
+        return cv::Mat();
+    }
+
+    return cv::Mat(rows, cols, CV_8U, _frame_data, _request.step);
+}
+
+// Send the frame and get the resulting curves
+// INPUT: command -> what to run on the frame
+// OUTPUT: curves -> curves of the response
+// OUTPUT: status of the response. SERVICE_BAD_REQUEST if the service cannot be reached.
+ServiceStatus ServiceClient::Process(const ServiceCommand& command, std::vector< std::vector<cv::Point> >& curves) {
+    ServiceResponse response;
+    uint32_t i, j, n;
+    int32_t xy[2];
+
+    curves.clear();
+    if (_fd < 0 || _frame_data == MAP_FAILED)
+        return SERVICE_BAD_REQUEST;
+
+    _request.command = command;
+    if (!WriteFully(&_request, sizeof(_request)))
+        return SERVICE_BAD_REQUEST;
+    if (!ReadFully(&response, sizeof(response)) || response.magic != SERVICE_MAGIC)
+        return SERVICE_BAD_REQUEST;
+
+    for (i = 0; i < response.n_curves; i++) {
+        if (!ReadFully(&n, sizeof(n)))
+            return SERVICE_BAD_REQUEST;
+        curves.push_back(std::vector<cv::Point>());
+        curves.back().reserve(n);
+        for (j = 0; j < n; j++) {
+            if (!ReadFully(xy, sizeof(xy)))
+                return SERVICE_BAD_REQUEST;
+            curves.back().push_back(cv::Point(xy[0], xy[1]));
+        }
+    }
+
+    return (ServiceStatus)response.status;
+}
+
+// Unmap and remove the frame
+void ServiceClient::ReleaseFrame() {
+    if (_frame_data == MAP_FAILED)
+        return;
+    munmap(_frame_data, _frame_size);
+    shm_unlink(_request.frame_name);
+    _frame_data = MAP_FAILED;
+    _frame_size = 0;
+}
+
+// Read exactly n bytes from the socket
+bool ServiceClient::ReadFully(void* buffer, size_t n) {
+    char *p = (char*)buffer;
+    ssize_t length;
+
+    while (n > 0) {
+        length = read(_fd, p, n);
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            return false;
+        p += length;
+        n -= length;
+    }
+
+    return true;
+}
+
+// Write exactly n bytes to the socket. A write may be cut short by a signal or a full socket buffer.
+bool ServiceClient::WriteFully(const void* buffer, size_t n) {
+    const char *p = (const char*)buffer;
+    ssize_t length;
+
+    while (n > 0) {
+        length = write(_fd, p, n);
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            return false;
+        p += length;
+        n -= length;
+    }
+
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef SERVICECLIENT_H
+#define SERVICECLIENT_H
+
+#include "serviceprotocol.h"
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+class ServiceClient
+{
+public:
+    // Client with default segmentation parameters
+    ServiceClient();
+
+    // Disconnect and release the frame
+    ~ServiceClient();
+
+    // Connect to a service listening on a Unix domain socket path
+    bool Connect(const std::string&);
+
+    // Get a frame in shared memory to write pixels to, so they reach the service without copies
+    cv::Mat CreateFrame(const int&, const int&);
+
+    // Send the frame and get the resulting curves
+    ServiceStatus Process(const ServiceCommand&, std::vector< std::vector<cv::Point> >&);
+
+    // Get the request sent by Process, to change its parameters
+    ServiceRequest& getRequest() {
+        return _request;
+    }
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Socket connected to the service
+    int _fd;
+    // Next request. Holds the frame layout and the parameters.
+    ServiceRequest _request;
+    // Mapping of the frame
+    void *_frame_data;
+    // Size of the mapping of the frame
+    size_t _frame_size;
+
+    //// METHODS ////
+    // Unmap and remove the frame
+    void ReleaseFrame();
+
+    // Read exactly n bytes from the socket
+    bool ReadFully(void*, size_t);
+
+    // Write exactly n bytes to the socket
+    bool WriteFully(const void*, size_t);
+};
+
+#endif // SERVICECLIENT_H
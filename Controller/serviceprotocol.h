@@ -0,0 +1,56 @@
+#ifndef SERVICEPROTOCOL_H
+#define SERVICEPROTOCOL_H
+
+#include <cstdint>
+
+// Messages of the local processing service.
+// Both ends run on the same machine, so messages are sent as they are laid out in memory.
+// Pixels never go through the socket: they are in a POSIX shared memory object named in the request.
+
+// First field of every message
+const uint32_t SERVICE_MAGIC = 0x50494244;
+
+// Commands of a request
+enum ServiceCommand {
+    SERVICE_SEGMENT = 1,    // Segmentation. Response curves: upper crowns, lower crowns, upper necks, lower necks.
+    SERVICE_TRACE = 2       // Segmentation and teeth tracing. Response curves: contour of each tooth.
+};
+
+// Status of a response
+enum ServiceStatus {
+    SERVICE_OK = 0,
+    SERVICE_BAD_REQUEST = 1,    // Unknown command or invalid parameters
+    SERVICE_BAD_FRAME = 2,      // Shared memory object missing or smaller than the frame
+    SERVICE_FAILED = 3,         // Processing found nothing
+    SERVICE_ERROR = 4           // Processing failed with an error, e.g. on a corrupt frame
+};
+
+// Request: an 8-bit grayscale frame in a shared memory object and the segmentation parameters
+struct ServiceRequest {
+    uint32_t magic;
+    uint32_t command;
+    // Name of the shared memory object, e.g. "/dentalbiometry-frame"
+    char frame_name[64];
+    // Frame layout in the shared memory object
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t step;
+    // Segmentation parameters
+    int32_t column_spacing;
+    int32_t derivative_distance;
+    float spline_pct_sample_size;
+    float neck_sd_threshold;
+    int32_t n_segments;
+    float binarization_pct_threshold;
+    int32_t pyramid_levels;
+};
+
+// Response header. It is followed by n_curves curves,
+// each one an uint32_t number of points and that many int32_t x, y pairs.
+struct ServiceResponse {
+    uint32_t magic;
+    uint32_t status;
+    uint32_t n_curves;
+};
+
+#endif // SERVICEPROTOCOL_H
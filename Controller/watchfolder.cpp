@@ -0,0 +1,182 @@
+#include "watchfolder.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <set>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Suffix of the result written next to each input image
+const std::string RESULT_SUFFIX = "_segmentation.png";
+// Time between checks of the stop flag while waiting
+const std::chrono::milliseconds WAIT_INTERVAL(500);
+}
+
+// Watch a directory with a queue of at most queue_capacity images, processing up to n_workers at once.
+// Each image being processed has a document session of its own, so the pipeline uses the default parameters of a new document.
+WatchFolder::WatchFolder(const std::string& directory, const int& queue_capacity, const int& n_workers) :
+    _directory(directory),
+    _n_workers(std::max(1, n_workers)),
+    _pipeline(queue_capacity, _n_workers),
+    _stop(false) {
+}
+
+// Watch the directory and process new images until Stop is called.
+// Images already in the directory are not processed.
+// OUTPUT: false if the directory cannot be watched
+bool WatchFolder::Run() {
+    bool watched;
+
+    std::cout << "Watching " << _directory << ", processing up to " << _n_workers << " images at once on "
+              << ThreadPool::getInstance()->getNumThreads() << " threads." << std::endl;
+
+    watched = Watch();
+
+    // Let the pipeline finish the queued images
+    Stop();
+    _pipeline.Finish();
+
+    std::cout << "Stopped watching " << _directory << std::endl;
+
+    return watched;
+}
+
+// Check if a file name is an input image (and not a result of this daemon).
+// Hidden files are skipped, since results are written under a hidden name first.
+bool WatchFolder::IsInputImage(const std::string& name) {
+    std::string extension;
+    size_t dot;
+
+    if (name.empty() || name[0] == '.')
+        return false;
+    if (name.size() >= RESULT_SUFFIX.size()
+            && name.compare(name.size() - RESULT_SUFFIX.size(), RESULT_SUFFIX.size(), RESULT_SUFFIX) == 0)
+        return false;
+
+    dot = name.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    extension = name.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    return extension == "png" || extension == "jpg" || extension == "jpeg"
+            || extension == "bmp" || extension == "tif" || extension == "tiff"
+            || extension == "dcm" || extension == "dicom" || extension == "raw";
+}
+
+// Get the file name of the result of an input image
+std::string WatchFolder::ResultName(const std::string& name) {
+    return name.substr(0, name.find_last_of('.')) + RESULT_SUFFIX;
+}
+
+// Queue an image of the directory. Blocks while the queue is full, so a burst of new images
+// waits in the file system instead of piling up in memory.
+// Its result is written next to it, under a hidden name first.
+// Gives up when the watcher is stopped while waiting.
+// OUTPUT: false if the image cannot be queued
+bool WatchFolder::Enqueue(const std::string& name) {
+    return _pipeline.Push(_directory + "/" + name, _directory + "/" + ResultName(name), &_stop);
+}
+
+#if defined(__linux__)
+// Wait for new images in the directory and queue them.
+// Uses inotify: an image is queued when its writer closes it or when it is moved into the directory.
+bool WatchFolder::Watch() {
+    // Room for several events at once, aligned as inotify expects
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    struct pollfd pfd;
+    ssize_t length;
+    char *p;
+    int fd;
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        std::perror("inotify_init1");
+        return false;
+    }
+    if (inotify_add_watch(fd, _directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::perror(_directory.c_str());
+        close(fd);
+        return false;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!_stop) {
+        if (poll(&pfd, 1, WAIT_INTERVAL.count()) <= 0)
+            continue;
+
+        length = read(fd, buffer, sizeof(buffer));
+        for (p = buffer; length > 0 && p < buffer + length; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event*)p;
+            // Events dropped by the kernel while the queue was full are lost
+            if (event->mask & IN_Q_OVERFLOW)
+                std::cout << "Too many new files. Some images were not queued." << std::endl;
+            if (event->len > 0 && !(event->mask & IN_ISDIR) && IsInputImage(event->name))
+                Enqueue(event->name);
+        }
+    }
+
+    close(fd);
+
+    return true;
+}
+#else
+// Wait for new images in the directory and queue them.
+// Without inotify the directory is scanned every WAIT_INTERVAL.
+// An image is queued when its size did not change between two scans.
+bool WatchFolder::Watch() {
+    std::set<std::string> seen;
+    std::map<std::string, off_t> growing;
+    std::string name, path;
+    struct dirent *entry;
+    struct stat info;
+    bool first_scan;
+    DIR *dir;
+
+    first_scan = true;
+    while (!_stop) {
+        dir = opendir(_directory.c_str());
+        if (dir == 0) {
+            std::perror(_directory.c_str());
+            return false;
+        }
+
+        while ((entry = readdir(dir)) != 0) {
+            name = entry->d_name;
+            path = _directory + "/" + name;
+            if (!IsInputImage(name) || seen.count(name) || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+                continue;
+
+            // Images already in the directory are not processed
+            if (first_scan) {
+                seen.insert(name);
+            } else if (growing.count(name) && growing[name] == info.st_size) {
+                growing.erase(name);
+                seen.insert(name);
+                Enqueue(name);
+            } else {
+                growing[name] = info.st_size;
+            }
+        }
+        closedir(dir);
+
+        first_scan = false;
+        std::this_thread::sleep_for(WAIT_INTERVAL);
+    }
+
+    return true;
+}
+#endif
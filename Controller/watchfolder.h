@@ -0,0 +1,47 @@
+#ifndef WATCHFOLDER_H
+#define WATCHFOLDER_H
+
+#include "imagepipeline.h"
+#include <atomic>
+#include <string>
+
+class WatchFolder
+{
+public:
+    // Watch a directory with a queue of at most queue_capacity images, processing up to n_workers at once
+    WatchFolder(const std::string&, const int& = 16, const int& = 2);
+
+    // Watch the directory and process new images until Stop is called
+    bool Run();
+
+    // Ask Run to return once the queued images are processed. Safe to call from a signal handler.
+    void Stop() {
+        _stop = true;
+    }
+
+    // Check if a file name is an input image (and not a result of this daemon)
+    static bool IsInputImage(const std::string&);
+
+    // Get the file name of the result of an input image
+    static std::string ResultName(const std::string&);
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Watched directory
+    std::string _directory;
+    // Max number of images processed at once
+    int _n_workers;
+    // Pipeline decoding, processing and writing the queued images
+    ImagePipeline _pipeline;
+    // Flag telling the watcher to finish
+    std::atomic<bool> _stop;
+
+    //// METHODS ////
+    // Queue an image of the directory. Blocks while the queue is full, until the watcher is stopped.
+    bool Enqueue(const std::string&);
+
+    // Wait for new images in the directory and queue them
+    bool Watch();
+};
+
+#endif // WATCHFOLDER_H
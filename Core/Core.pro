@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Core library: image processing without Qt
+#
+#-------------------------------------------------
+
+TARGET = dentalbiometrycore
+TEMPLATE = lib
+
+CONFIG += staticlib
+CONFIG -= qt
+
+include(../common.pri)
+include(sources.pri)
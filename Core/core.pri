@@ -0,0 +1,10 @@
+# Link the core library. Included by the projects that use it.
+
+INCLUDEPATH += $$PWD/..
+
+CORE_DIR = $$shadowed($$PWD)
+LIBS += -L$$CORE_DIR -ldentalbiometrycore
+PRE_TARGETDEPS += $$CORE_DIR/libdentalbiometrycore.a
+
+# POSIX shared memory of the processing service
+unix:!macx: LIBS += -lrt
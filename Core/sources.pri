@@ -0,0 +1,51 @@
+# Sources of the core library: the Model and Controller layers, without Qt
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+    $$PWD/../Controller/commandline.cpp \
+    $$PWD/../Controller/documentmanager.cpp \
+    $$PWD/../Controller/imagepipeline.cpp \
+    $$PWD/../Controller/processingservice.cpp \
+    $$PWD/../Controller/serviceclient.cpp \
+    $$PWD/../Controller/watchfolder.cpp \
+    $$PWD/../Model/bufferpool.cpp \
+    $$PWD/../Model/cpudispatch.cpp \
+    $$PWD/../Model/curve.cpp \
+    $$PWD/../Model/dentalarch.cpp \
+    $$PWD/../Model/dicomreader.cpp \
+    $$PWD/../Model/filters.cpp \
+    $$PWD/../Model/helpers.cpp \
+    $$PWD/../Model/histogram.cpp \
+    $$PWD/../Model/livewire.cpp \
+    $$PWD/../Model/memorytracker.cpp \
+    $$PWD/../Model/segmentation.cpp \
+    $$PWD/../Model/threadpool.cpp \
+    $$PWD/../Model/tracing.cpp \
+    $$PWD/../Model/visualizationhelpers.cpp
+
+HEADERS += \
+    $$PWD/../Controller/commandline.h \
+    $$PWD/../Controller/controller.h \
+    $$PWD/../Controller/documentmanager.h \
+    $$PWD/../Controller/imagepipeline.h \
+    $$PWD/../Controller/processingservice.h \
+    $$PWD/../Controller/serviceclient.h \
+    $$PWD/../Controller/serviceprotocol.h \
+    $$PWD/../Controller/watchfolder.h \
+    $$PWD/../Model/boundedqueue.h \
+    $$PWD/../Model/bufferpool.h \
+    $$PWD/../Model/cpudispatch.h \
+    $$PWD/../Model/curve.h \
+    $$PWD/../Model/dentalarch.h \
+    $$PWD/../Model/dicomreader.h \
+    $$PWD/../Model/filters.h \
+    $$PWD/../Model/helpers.h \
+    $$PWD/../Model/histogram.h \
+    $$PWD/../Model/livewire.h \
+    $$PWD/../Model/memorytracker.h \
+    $$PWD/../Model/segmentation.h \
+    $$PWD/../Model/spline.h \
+    $$PWD/../Model/threadpool.h \
+    $$PWD/../Model/tracing.h \
+    $$PWD/../Model/visualizationhelpers.h
@@ -0,0 +1,125 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// First in, first out queue between two stages of a pipeline, holding at most a fixed number of items.
+// A producer that gets ahead blocks instead of piling up items in memory.
+template<class T>
+class BoundedQueue
+{
+public:
+    // Queue of at most capacity items (at least one)
+    explicit BoundedQueue(const int& capacity) : _capacity(std::max(1, capacity)),
+        _closed(false) {
+    }
+
+    // Add an item. Blocks while the queue is full.
+    // OUTPUT: false if the queue is closed
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _not_full.wait(lock, [this]() { return _closed || (int)_items.size() < _capacity; });
+        if (_closed)
+            return false;
+        _items.push_back(std::move(item));
+        lock.unlock();
+        _not_empty.notify_one();
+
+        return true;
+    }
+
+    // Add an item. Blocks while the queue is full, checking a cancel flag every interval,
+    // so a producer stopped from a signal handler does not wait for room forever.
+    // OUTPUT: false if the queue is closed or cancelled was set
+    bool Push(T item, const std::atomic<bool>& cancelled, const std::chrono::milliseconds& interval) {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (!_closed && (int)_items.size() >= _capacity) {
+            if (cancelled)
+                return false;
+            _not_full.wait_for(lock, interval);
+        }
+        if (_closed)
+            return false;
+        _items.push_back(std::move(item));
+        lock.unlock();
+        _not_empty.notify_one();
+
+        return true;
+    }
+
+    // Take the oldest item. Blocks while the queue is empty and open.
+    // OUTPUT: false if the queue is closed and empty
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _not_empty.wait(lock, [this]() { return _closed || !_items.empty(); });
+        if (_items.empty())
+            return false;
+        item = std::move(_items.front());
+        _items.pop_front();
+        lock.unlock();
+        _not_full.notify_one();
+
+        return true;
+    }
+
+    // Take the oldest item without blocking
+    // OUTPUT: false if the queue is empty
+    bool TryPop(T& item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        if (_items.empty())
+            return false;
+        item = std::move(_items.front());
+        _items.pop_front();
+        lock.unlock();
+        _not_full.notify_one();
+
+        return true;
+    }
+
+    // Refuse new items. Items already queued can still be taken.
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+        }
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+
+    // Get number of queued items
+    int getSize() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return (int)_items.size();
+    }
+
+    // Get max number of queued items
+    int getCapacity() const {
+        return _capacity;
+    }
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Max number of items
+    int _capacity;
+    // Queued items, oldest first
+    std::deque<T> _items;
+    // Flag refusing new items
+    bool _closed;
+    // Guards _items and _closed
+    std::mutex _mutex;
+    // Wakes producers when an item is taken or the queue is closed
+    std::condition_variable _not_full;
+    // Wakes consumers when an item is added or the queue is closed
+    std::condition_variable _not_empty;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,282 @@
+#include "bufferpool.h"
+
+BufferPool *BufferPool::singleton = 0;
+
+namespace {
+// Buffers below this size are not pooled
+const size_t MIN_POOLED_BYTES = 64 * 1024;
+// Size classes split each power of two in this many steps, so at most 1/8 of a buffer is wasted
+const size_t CLASS_STEPS = 8;
+// Default max bytes kept in the shared lists
+const size_t DEFAULT_MAX_CACHED_BYTES = (size_t)1024 * 1024 * 1024;
+// Max buffers of each size class kept by each thread
+const size_t THREAD_CACHE_BUFFERS = 4;
+// Size classes not used during this many images are released. Above the number of images
+// processed at once, so a session does not lose its buffers to the images of other sessions.
+const unsigned long IDLE_IMAGES = 8;
+}
+
+// Free buffers kept by a thread. Returned to the shared lists when the thread exits.
+struct ThreadCache {
+    ThreadCache() : generation(0), swept(0) {}
+
+    ~ThreadCache() {
+        Flush(true);
+    }
+
+    // Give every buffer back to the shared lists, or free them if out of date
+    void Flush(const bool& keep) {
+        std::unordered_map< size_t, std::vector<void*> >::iterator it;
+        size_t i;
+
+        for (it = lists.begin(); it != lists.end(); ++it)
+            for (i = 0; i < it->second.size(); i++) {
+                if (keep)
+                    BufferPool::singleton->GiveShared(it->second.at(i), it->first, generation);
+                else
+                    cv::fastFree(it->second.at(i));
+            }
+        lists.clear();
+        last_used.clear();
+    }
+
+    // Drop buffers cached before the last BufferPool::Release, and size classes this thread did not use recently
+    void Refresh() {
+        std::unordered_map< size_t, std::vector<void*> >::iterator it;
+        unsigned current = BufferPool::singleton->_generation;
+        unsigned long n_images = BufferPool::singleton->_n_images;
+        size_t i;
+
+        if (generation != current) {
+            Flush(false);
+            generation = current;
+        }
+        if (swept == n_images)
+            return;
+        swept = n_images;
+        for (it = lists.begin(); it != lists.end();) {
+            if (n_images - last_used[it->first] <= IDLE_IMAGES) {
+                ++it;
+                continue;
+            }
+            for (i = 0; i < it->second.size(); i++)
+                cv::fastFree(it->second.at(i));
+            last_used.erase(it->first);
+            it = lists.erase(it);
+        }
+    }
+
+    // Record a use of a size class by this thread
+    void Use(const size_t& size_class) {
+        last_used[size_class] = swept;
+    }
+
+    // Free buffers by size class
+    std::unordered_map< size_t, std::vector<void*> > lists;
+    // Number of the image during which this thread last used each size class
+    std::unordered_map< size_t, unsigned long > last_used;
+    // Generation of the pool the buffers belong to
+    unsigned generation;
+    // Number of images begun at the last Refresh
+    unsigned long swept;
+};
+
+namespace {
+thread_local ThreadCache thread_cache;
+}
+
+// Make the pool the default allocator of cv::Mat
+void BufferPool::install() {
+    if (singleton != 0)
+        return;
+    singleton = new BufferPool(cv::Mat::getDefaultAllocator());
+    cv::Mat::setDefaultAllocator(singleton);
+}
+
+// Tell the pool a new image of a batch starts.
+// Size classes are kept while any image uses them, instead of emptying the pool when the size of the image
+// changes, since sessions of different sizes run at once. Thread caches drop their idle classes at their next Refresh.
+void BufferPool::BeginImage() {
+    std::unordered_map< size_t, std::vector<void*> >::iterator it;
+    unsigned long n_images;
+    size_t i;
+
+    if (singleton == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(singleton->_mutex);
+    n_images = ++singleton->_n_images;
+    for (it = singleton->_lists.begin(); it != singleton->_lists.end();) {
+        if (n_images - singleton->_last_used[it->first] <= IDLE_IMAGES) {
+            ++it;
+            continue;
+        }
+        for (i = 0; i < it->second.size(); i++)
+            cv::fastFree(it->second.at(i));
+        singleton->_cached_bytes -= it->second.size() * it->first;
+        singleton->_last_used.erase(it->first);
+        it = singleton->_lists.erase(it);
+    }
+}
+
+// Release every cached buffer
+void BufferPool::Release() {
+    std::unordered_map< size_t, std::vector<void*> >::iterator it;
+    size_t i;
+
+    if (singleton == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(singleton->_mutex);
+        singleton->_generation++;
+        for (it = singleton->_lists.begin(); it != singleton->_lists.end(); ++it)
+            for (i = 0; i < it->second.size(); i++)
+                cv::fastFree(it->second.at(i));
+        singleton->_lists.clear();
+        singleton->_last_used.clear();
+        singleton->_cached_bytes = 0;
+    }
+    thread_cache.Refresh();
+}
+
+// Set max bytes kept in the shared lists
+bool BufferPool::setMaxCachedBytes(const size_t& bytes) {
+    if (singleton == 0)
+        return false;
+    std::lock_guard<std::mutex> lock(singleton->_mutex);
+    singleton->_max_cached_bytes = bytes;
+    return true;
+}
+
+// Get bytes kept in the shared lists
+size_t BufferPool::getCachedBytes() {
+    if (singleton == 0)
+        return 0;
+    std::lock_guard<std::mutex> lock(singleton->_mutex);
+    return singleton->_cached_bytes;
+}
+
+// Allocate a buffer the way the standard allocator does, but from the pool.
+// Buffers with user data and small buffers are left to the base allocator.
+cv::UMatData* BufferPool::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                   int flags, cv::UMatUsageFlags usage_flags) const {
+    cv::UMatData *u;
+    size_t total;
+    int i;
+
+    if (data != 0)
+        return _base->allocate(dims, sizes, type, data, step, flags, usage_flags);
+
+    total = CV_ELEM_SIZE(type);
+    for (i = dims - 1; i >= 0; i--)
+        total *= sizes[i];
+    if (total < MIN_POOLED_BYTES)
+        return _base->allocate(dims, sizes, type, data, step, flags, usage_flags);
+
+    // Continuous rows, as the standard allocator does
+    total = CV_ELEM_SIZE(type);
+    for (i = dims - 1; i >= 0; i--) {
+        if (step != 0)
+            step[i] = total;
+        total *= sizes[i];
+    }
+
+    u = new cv::UMatData(this);
+    u->data = u->origdata = (uchar*)Take(SizeClass(total));
+    u->size = total;
+
+    return u;
+}
+
+// Allocate device memory of a buffer
+bool BufferPool::allocate(cv::UMatData* u, int access_flags, cv::UMatUsageFlags usage_flags) const {
+    return _base->allocate(u, access_flags, usage_flags);
+}
+
+// Keep a released buffer for reuse
+void BufferPool::deallocate(cv::UMatData* u) const {
+    if (u == 0)
+        return;
+    if ((u->flags & cv::UMatData::USER_ALLOCATED) || u->size < MIN_POOLED_BYTES) {
+        _base->deallocate(u);
+        return;
+    }
+
+    Give(u->origdata, SizeClass(u->size));
+    delete u;
+}
+
+// Private constructor
+BufferPool::BufferPool(cv::MatAllocator* base) : _base(base),
+    _cached_bytes(0),
+    _max_cached_bytes(DEFAULT_MAX_CACHED_BYTES),
+    _n_images(0),
+    _generation(0) {
+}
+
+// Get a buffer of a size class, from the cache of this thread, the shared lists or a new allocation
+void *BufferPool::Take(const size_t& size_class) const {
+    std::unordered_map< size_t, std::vector<void*> >::iterator it;
+    void *buffer;
+
+    thread_cache.Refresh();
+    thread_cache.Use(size_class);
+    it = thread_cache.lists.find(size_class);
+    if (it != thread_cache.lists.end() && !it->second.empty()) {
+        buffer = it->second.back();
+        it->second.pop_back();
+        return buffer;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _last_used[size_class] = _n_images;
+        it = _lists.find(size_class);
+        if (it != _lists.end() && !it->second.empty()) {
+            buffer = it->second.back();
+            it->second.pop_back();
+            _cached_bytes -= size_class;
+            return buffer;
+        }
+    }
+
+    return cv::fastMalloc(size_class);
+}
+
+// Return a buffer of a size class to the cache of this thread, the shared lists, or free it
+void BufferPool::Give(void* buffer, const size_t& size_class) const {
+    thread_cache.Refresh();
+    thread_cache.Use(size_class);
+    std::vector<void*>& list = thread_cache.lists[size_class];
+
+    if (list.size() < THREAD_CACHE_BUFFERS) {
+        list.push_back(buffer);
+        return;
+    }
+    GiveShared(buffer, size_class, thread_cache.generation);
+}
+
+// Return a buffer to the shared lists, or free it if they are full or out of date
+void BufferPool::GiveShared(void* buffer, const size_t& size_class, const unsigned& generation) const {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (generation == _generation && _cached_bytes + size_class <= _max_cached_bytes) {
+            _last_used[size_class] = _n_images;
+            _lists[size_class].push_back(buffer);
+            _cached_bytes += size_class;
+            return;
+        }
+    }
+    cv::fastFree(buffer);
+}
+
+// Get the size class of a buffer: its size rounded up to a step of 1/8 of the power of two below it
+size_t BufferPool::SizeClass(const size_t& size) {
+    size_t power = 1;
+
+    while (power <= size / 2)
+        power *= 2;
+
+    return (size + power / CLASS_STEPS - 1) / (power / CLASS_STEPS) * (power / CLASS_STEPS);
+}
@@ -0,0 +1,91 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// cv::Mat allocator that keeps released image buffers for reuse.
+// Images in a batch almost always have the same size, so after the first image every
+// Filters call, Segmentation and Tracing get their buffers back from the pool instead of
+// allocating (and page faulting) fresh ones.
+// Buffers are grouped in size classes. Each thread keeps a few buffers of each class of its own,
+// so most allocations take no lock; the rest are shared by all threads.
+// Classes unused for a few images are freed, so sessions processing images of different sizes
+// at once each keep the buffers of their own size.
+// Small buffers are left to the allocator that was the default one when the pool was installed.
+class BufferPool : public cv::MatAllocator
+{
+public:
+    // Make the pool the default allocator of cv::Mat. Call before any thread allocates images.
+    static void install();
+
+    // Check if the pool is installed
+    static bool isInstalled() {
+        return singleton != 0;
+    }
+
+    // Tell the pool a new image of a batch starts.
+    // Cached buffers of size classes no image used recently are released.
+    static void BeginImage();
+
+    // Release every cached buffer. Buffers cached by other threads are released
+    // the next time those threads allocate or release an image, or when they exit.
+    // Buffers still held by images are pooled again when those images are released.
+    static void Release();
+
+    // Set max bytes kept in the shared lists. Buffers released above it are freed.
+    static bool setMaxCachedBytes(const size_t&);
+
+    // Get bytes kept in the shared lists
+    static size_t getCachedBytes();
+
+    //// cv::MatAllocator ////
+    cv::UMatData* allocate(int, const int*, int, void*, size_t*, int, cv::UMatUsageFlags) const;
+    bool allocate(cv::UMatData*, int, cv::UMatUsageFlags) const;
+    void deallocate(cv::UMatData*) const;
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Pointer to singleton. Never deleted, since buffers may outlive any owner.
+    static BufferPool *singleton;
+    // Allocator of small buffers
+    cv::MatAllocator *_base;
+    // Guards the shared lists, _cached_bytes and _last_used
+    mutable std::mutex _mutex;
+    // Free buffers shared by all threads, by size class
+    mutable std::unordered_map< size_t, std::vector<void*> > _lists;
+    // Number of the image during which each size class was last taken or given in the shared lists
+    mutable std::unordered_map< size_t, unsigned long > _last_used;
+    // Bytes in _lists
+    mutable size_t _cached_bytes;
+    // Max bytes in _lists
+    size_t _max_cached_bytes;
+    // Number of images begun
+    std::atomic<unsigned long> _n_images;
+    // Incremented by Release, so thread caches know their buffers must go
+    std::atomic<unsigned> _generation;
+
+    //// METHODS ////
+    // Private constructor
+    BufferPool(cv::MatAllocator*);
+
+    // Get a buffer of a size class, from the cache of this thread, the shared lists or a new allocation
+    void *Take(const size_t&) const;
+
+    // Return a buffer of a size class to the cache of this thread, the shared lists, or free it
+    void Give(void*, const size_t&) const;
+
+    // Return a buffer to the shared lists, or free it if they are full or out of date
+    void GiveShared(void*, const size_t&, const unsigned&) const;
+
+    // Get the size class of a buffer
+    static size_t SizeClass(const size_t&);
+
+    friend struct ThreadCache;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,724 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "cpudispatch.h"
+
+// Kernels above the scalar level are compiled with function target attributes,
+// so the rest of the project keeps the baseline instruction set.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPUDISPATCH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+namespace {
+// Name of the environment variable that forces a level
+const char *LEVEL_VARIABLE = "DENTALBIOMETRY_CPU_LEVEL";
+// Names of the levels, as accepted by LEVEL_VARIABLE
+const char *LEVEL_NAMES[CpuDispatch::N_LEVELS] = {"scalar", "sse4.2", "avx2", "avx512"};
+// Blocks of 16-bit derivatives summed into 32-bit lanes before they can overflow
+const int DERIVATIVE_BLOCKS = 4096;
+
+// Kernels of the active level
+std::atomic<const CpuDispatch::Kernels*> active_kernels(0);
+
+//// SCALAR KERNELS ////
+// Also the reference of the cross check, so they are kept as simple as possible.
+
+// Sum the first derivatives of a profile, which are taken from the first value (see Helpers::DeriveVector).
+// OUTPUT: index of the first derivative taken at distance d
+int DerivativePrefix(const uchar* p, const int& n, const int& d, int64_t& sum, int64_t& sum_of_squares) {
+    int i, diff;
+
+    for (i = 1; i < n && i <= d; i++) {
+        diff = p[i] - p[0];
+        sum += diff;
+        sum_of_squares += diff * diff;
+    }
+
+    return i;
+}
+
+// Sum the derivatives at distance d from index i to n
+void DerivativeTail(const uchar* p, const int& n, const int& d, int i, int64_t& sum, int64_t& sum_of_squares) {
+    int diff;
+
+    for (; i < n; i++) {
+        diff = p[i] - p[i - d];
+        sum += diff;
+        sum_of_squares += diff * diff;
+    }
+}
+
+// Population standard deviation from the sums: sqrt(E[x^2] - E[x]^2). The derivative at 0 is 0.
+double DerivativeResult(const int& n, const int64_t& sum, const int64_t& sum_of_squares) {
+    return std::sqrt((double)(n * sum_of_squares - sum * sum) / ((double)n * n));
+}
+
+double DerivativeStandardDeviationScalar(const uchar* p, int n, int d) {
+    int64_t sum = 0, sum_of_squares = 0;
+
+    if (n == 0)
+        return 0;
+    DerivativeTail(p, n, d, DerivativePrefix(p, n, d, sum, sum_of_squares), sum, sum_of_squares);
+
+    return DerivativeResult(n, sum, sum_of_squares);
+}
+
+int FirstIndexAboveThresholdScalar(const uchar* row, int n, uchar thr) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (row[i] >= thr)
+            return i;
+
+    return -1;
+}
+
+void HistogramScalar(const uchar* values, int n, int* hist) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        hist[values[i]]++;
+}
+
+void MaskedHistogramScalar(const uchar* values, const uchar* mask, int n, int* hist) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (mask[i] != 0)
+            hist[values[i]]++;
+}
+
+void GatherScalar(const uchar* data, size_t step, size_t, const cv::Point* p, int n, uchar* out) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        out[i] = data[p[i].y * step + p[i].x];
+}
+
+int WindowSumScalar(const uchar* top_left, size_t step, int k) {
+    int sum = 0;
+    int x, y;
+
+    for (y = 0; y < k; y++)
+        for (x = 0; x < k; x++)
+            sum += top_left[y * step + x];
+
+    return sum;
+}
+
+#if defined(CPUDISPATCH_X86)
+//// SHARED X86 HELPERS ////
+
+// Histograms do not vectorize: every value is an increment at a scattered address.
+// Levels above scalar spread consecutive values over four sub-histograms instead,
+// so runs of equal values do not wait on each other's increments.
+void HistogramUnrolled(const uchar* values, int n, int* hist) {
+    int sub[4][256];
+    int i;
+
+    // Not worth clearing and merging the sub-histograms
+    if (n < 4096) {
+        HistogramScalar(values, n, hist);
+        return;
+    }
+
+    std::memset(sub, 0, sizeof(sub));
+    for (i = 0; i + 4 <= n; i += 4) {
+        sub[0][values[i]]++;
+        sub[1][values[i + 1]]++;
+        sub[2][values[i + 2]]++;
+        sub[3][values[i + 3]]++;
+    }
+    for (; i < n; i++)
+        sub[0][values[i]]++;
+
+    for (i = 0; i < 256; i++)
+        hist[i] += sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
+}
+
+// Add the values of a block whose mask bits are set. Bit i stands for values[i].
+inline void HistogramOfBits(const uchar* values, uint64_t bits, int* hist) {
+    while (bits != 0) {
+        hist[values[__builtin_ctzll(bits)]]++;
+        bits &= bits - 1;
+    }
+}
+
+//// SSE4.2 KERNELS ////
+
+TARGET_SSE42 double DerivativeStandardDeviationSse42(const uchar* p, int n, int d) {
+    int64_t sum = 0, sum_of_squares = 0;
+    int32_t lanes[4];
+    int i, blocks = 0;
+
+    if (n == 0)
+        return 0;
+    i = DerivativePrefix(p, n, d, sum, sum_of_squares);
+
+    // 8 derivatives at a time in 16-bit lanes, summed into 32-bit lanes
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i lane_sum = _mm_setzero_si128();
+    __m128i lane_sum_of_squares = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i current = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(p + i)));
+        __m128i previous = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(p + i - d)));
+        __m128i diffs = _mm_sub_epi16(current, previous);
+        lane_sum = _mm_add_epi32(lane_sum, _mm_madd_epi16(diffs, ones));
+        lane_sum_of_squares = _mm_add_epi32(lane_sum_of_squares, _mm_madd_epi16(diffs, diffs));
+
+        if (++blocks == DERIVATIVE_BLOCKS || i + 16 > n) {
+            _mm_storeu_si128((__m128i*)lanes, lane_sum);
+            sum += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            _mm_storeu_si128((__m128i*)lanes, lane_sum_of_squares);
+            sum_of_squares += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            lane_sum = _mm_setzero_si128();
+            lane_sum_of_squares = _mm_setzero_si128();
+            blocks = 0;
+        }
+    }
+    DerivativeTail(p, n, d, i, sum, sum_of_squares);
+
+    return DerivativeResult(n, sum, sum_of_squares);
+}
+
+TARGET_SSE42 int FirstIndexAboveThresholdSse42(const uchar* row, int n, uchar thr) {
+    const __m128i thr16 = _mm_set1_epi8((char)thr);
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + i));
+        // Unsigned v >= thr is the same as max(v, thr) == v
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, thr16), v));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++)
+        if (row[i] >= thr)
+            return i;
+
+    return -1;
+}
+
+// Skips blocks of 16 masked out values, and takes blocks of 16 masked in values without testing each one
+TARGET_SSE42 void MaskedHistogramSse42(const uchar* values, const uchar* mask, int n, int* hist) {
+    const __m128i zero = _mm_setzero_si128();
+    unsigned outside;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+        if (_mm_testz_si128(m, m))
+            continue;
+        outside = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero));
+        if (outside == 0)
+            HistogramScalar(values + i, 16, hist);
+        else
+            HistogramOfBits(values + i, ~outside & 0xFFFF, hist);
+    }
+    MaskedHistogramScalar(values + i, mask + i, n - i, hist);
+}
+
+TARGET_SSE42 int WindowSumSse42(const uchar* top_left, size_t step, int k) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    int sum = 0;
+    int x, y;
+
+    for (y = 0; y < k; y++) {
+        const uchar *row = top_left + y * step;
+        // Sum of absolute differences with 0 adds 8 pixels into each 64-bit half
+        for (x = 0; x + 16 <= k; x += 16)
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(row + x)), zero));
+        for (; x < k; x++)
+            sum += row[x];
+    }
+
+    return sum + _mm_cvtsi128_si32(sums) + _mm_extract_epi32(sums, 2);
+}
+
+//// AVX2 KERNELS ////
+
+TARGET_AVX2 double DerivativeStandardDeviationAvx2(const uchar* p, int n, int d) {
+    int64_t sum = 0, sum_of_squares = 0;
+    int32_t lanes[8];
+    int i, j, blocks = 0;
+
+    if (n == 0)
+        return 0;
+    i = DerivativePrefix(p, n, d, sum, sum_of_squares);
+
+    // 16 derivatives at a time in 16-bit lanes, summed into 32-bit lanes
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i lane_sum = _mm256_setzero_si256();
+    __m256i lane_sum_of_squares = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        __m256i current = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + i)));
+        __m256i previous = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + i - d)));
+        __m256i diffs = _mm256_sub_epi16(current, previous);
+        lane_sum = _mm256_add_epi32(lane_sum, _mm256_madd_epi16(diffs, ones));
+        lane_sum_of_squares = _mm256_add_epi32(lane_sum_of_squares, _mm256_madd_epi16(diffs, diffs));
+
+        if (++blocks == DERIVATIVE_BLOCKS || i + 32 > n) {
+            _mm256_storeu_si256((__m256i*)lanes, lane_sum);
+            for (j = 0; j < 8; j++)
+                sum += lanes[j];
+            _mm256_storeu_si256((__m256i*)lanes, lane_sum_of_squares);
+            for (j = 0; j < 8; j++)
+                sum_of_squares += lanes[j];
+            lane_sum = _mm256_setzero_si256();
+            lane_sum_of_squares = _mm256_setzero_si256();
+            blocks = 0;
+        }
+    }
+    DerivativeTail(p, n, d, i, sum, sum_of_squares);
+
+    return DerivativeResult(n, sum, sum_of_squares);
+}
+
+TARGET_AVX2 int FirstIndexAboveThresholdAvx2(const uchar* row, int n, uchar thr) {
+    const __m256i thr32 = _mm256_set1_epi8((char)thr);
+    int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(row + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v, thr32), v));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++)
+        if (row[i] >= thr)
+            return i;
+
+    return -1;
+}
+
+TARGET_AVX2 void MaskedHistogramAvx2(const uchar* values, const uchar* mask, int n, int* hist) {
+    const __m256i zero = _mm256_setzero_si256();
+    unsigned outside;
+    int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i m = _mm256_loadu_si256((const __m256i*)(mask + i));
+        if (_mm256_testz_si256(m, m))
+            continue;
+        outside = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(m, zero));
+        if (outside == 0)
+            HistogramScalar(values + i, 32, hist);
+        else
+            HistogramOfBits(values + i, ~outside, hist);
+    }
+    MaskedHistogramScalar(values + i, mask + i, n - i, hist);
+}
+
+// 8 points at a time: offsets y * step + x are computed in 32-bit lanes and the pixels gathered as 32-bit words.
+// Points whose word would fall outside the image are read one by one. Offsets are compared unsigned,
+// so negative ones take that path too instead of being gathered from before the image.
+TARGET_AVX2 void GatherAvx2(const uchar* data, size_t step, size_t size, const cv::Point* p, int n, uchar* out) {
+    const __m256i steps = _mm256_set1_epi32((int)step);
+    // Byte 0 of each 32-bit word, into the first 4 bytes of each 128-bit lane
+    const __m256i low_bytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                               0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m256i limit, first, second, xs, ys, offsets, words;
+    int i;
+
+    // Offsets must fit in 32-bit lanes
+    if (size < 4 || size > (size_t)INT_MAX) {
+        GatherScalar(data, step, size, p, n, out);
+        return;
+    }
+    limit = _mm256_set1_epi32((int)(size - 4));
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        // x0 y0 x1 y1 x2 y2 x3 y3 | x4 y4 x5 y5 x6 y6 x7 y7
+        first = _mm256_loadu_si256((const __m256i*)(p + i));
+        second = _mm256_loadu_si256((const __m256i*)(p + i + 4));
+        // x0 x1 x4 x5 x2 x3 x6 x7, and the same for y
+        xs = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(first), _mm256_castsi256_ps(second), _MM_SHUFFLE(2, 0, 2, 0)));
+        ys = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(first), _mm256_castsi256_ps(second), _MM_SHUFFLE(3, 1, 3, 1)));
+        offsets = _mm256_permute4x64_epi64(_mm256_add_epi32(_mm256_mullo_epi32(ys, steps), xs), _MM_SHUFFLE(3, 1, 2, 0));
+        // Unsigned offsets <= limit are those where max(offsets, limit) == limit
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_max_epu32(offsets, limit), limit)) != -1) {
+            GatherScalar(data, step, size, p + i, 8, out + i);
+            continue;
+        }
+        words = _mm256_i32gather_epi32((const int*)data, offsets, 1);
+        words = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, low_bytes), _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+        _mm_storel_epi64((__m128i*)(out + i), _mm256_castsi256_si128(words));
+    }
+    GatherScalar(data, step, size, p + i, n - i, out + i);
+}
+
+TARGET_AVX2 int WindowSumAvx2(const uchar* top_left, size_t step, int k) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sums = zero;
+    int64_t lanes[4];
+    int sum = 0;
+    int x, y;
+
+    for (y = 0; y < k; y++) {
+        const uchar *row = top_left + y * step;
+        for (x = 0; x + 32 <= k; x += 32)
+            sums = _mm256_add_epi64(sums, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(row + x)), zero));
+        for (; x < k; x++)
+            sum += row[x];
+    }
+    _mm256_storeu_si256((__m256i*)lanes, sums);
+
+    return sum + (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+//// AVX-512 KERNELS ////
+
+// Sum of 16 32-bit lanes, widened first since the sum of the lanes may not fit in 32 bits
+TARGET_AVX512 inline int64_t SumOfLanesAvx512(const __m512i& lanes) {
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(lanes)),
+                                                    _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(lanes, 1))));
+}
+
+TARGET_AVX512 double DerivativeStandardDeviationAvx512(const uchar* p, int n, int d) {
+    int64_t sum = 0, sum_of_squares = 0;
+    int i, blocks = 0;
+
+    if (n == 0)
+        return 0;
+    i = DerivativePrefix(p, n, d, sum, sum_of_squares);
+
+    // 32 derivatives at a time in 16-bit lanes, summed into 32-bit lanes
+    const __m512i ones = _mm512_set1_epi16(1);
+    __m512i lane_sum = _mm512_setzero_si512();
+    __m512i lane_sum_of_squares = _mm512_setzero_si512();
+    for (; i + 32 <= n; i += 32) {
+        __m512i current = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(p + i)));
+        __m512i previous = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(p + i - d)));
+        __m512i diffs = _mm512_sub_epi16(current, previous);
+        lane_sum = _mm512_add_epi32(lane_sum, _mm512_madd_epi16(diffs, ones));
+        lane_sum_of_squares = _mm512_add_epi32(lane_sum_of_squares, _mm512_madd_epi16(diffs, diffs));
+
+        if (++blocks == DERIVATIVE_BLOCKS || i + 64 > n) {
+            sum += SumOfLanesAvx512(lane_sum);
+            sum_of_squares += SumOfLanesAvx512(lane_sum_of_squares);
+            lane_sum = _mm512_setzero_si512();
+            lane_sum_of_squares = _mm512_setzero_si512();
+            blocks = 0;
+        }
+    }
+    DerivativeTail(p, n, d, i, sum, sum_of_squares);
+
+    return DerivativeResult(n, sum, sum_of_squares);
+}
+
+TARGET_AVX512 int FirstIndexAboveThresholdAvx512(const uchar* row, int n, uchar thr) {
+    const __m512i thr64 = _mm512_set1_epi8((char)thr);
+    __mmask64 mask;
+    int i;
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        mask = _mm512_cmpge_epu8_mask(_mm512_loadu_si512((const void*)(row + i)), thr64);
+        if (mask != 0)
+            return i + __builtin_ctzll(mask);
+    }
+    // The tail is read with a mask, so nothing past the row is touched
+    if (i < n) {
+        mask = _mm512_cmpge_epu8_mask(_mm512_maskz_loadu_epi8(~0ULL >> (64 - (n - i)), row + i), thr64)
+                & (~0ULL >> (64 - (n - i)));
+        if (mask != 0)
+            return i + __builtin_ctzll(mask);
+    }
+
+    return -1;
+}
+
+TARGET_AVX512 void MaskedHistogramAvx512(const uchar* values, const uchar* mask, int n, int* hist) {
+    __mmask64 inside;
+    int i;
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        __m512i m = _mm512_loadu_si512((const void*)(mask + i));
+        inside = _mm512_test_epi8_mask(m, m);
+        if (inside == 0)
+            continue;
+        if (inside == ~0ULL)
+            HistogramScalar(values + i, 64, hist);
+        else
+            HistogramOfBits(values + i, inside, hist);
+    }
+    MaskedHistogramScalar(values + i, mask + i, n - i, hist);
+}
+
+// 16 points at a time, as GatherAvx2
+TARGET_AVX512 void GatherAvx512(const uchar* data, size_t step, size_t size, const cv::Point* p, int n, uchar* out) {
+    const __m512i steps = _mm512_set1_epi32((int)step);
+    const __m512i x_index = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i y_index = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    __m512i limit, first, second, offsets, words;
+    int i;
+
+    if (size < 4 || size > (size_t)INT_MAX) {
+        GatherScalar(data, step, size, p, n, out);
+        return;
+    }
+    limit = _mm512_set1_epi32((int)(size - 4));
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        first = _mm512_loadu_si512((const void*)(p + i));
+        second = _mm512_loadu_si512((const void*)(p + i + 8));
+        offsets = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_permutex2var_epi32(first, y_index, second), steps),
+                                   _mm512_permutex2var_epi32(first, x_index, second));
+        if (_mm512_cmpgt_epu32_mask(offsets, limit) != 0) {
+            GatherScalar(data, step, size, p + i, 16, out + i);
+            continue;
+        }
+        words = _mm512_i32gather_epi32(offsets, (const void*)data, 1);
+        // Keep byte 0 of each word
+        _mm_storeu_si128((__m128i*)(out + i), _mm512_cvtepi32_epi8(words));
+    }
+    GatherScalar(data, step, size, p + i, n - i, out + i);
+}
+
+TARGET_AVX512 int WindowSumAvx512(const uchar* top_left, size_t step, int k) {
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i sums = zero;
+    int sum = 0;
+    int x, y;
+
+    for (y = 0; y < k; y++) {
+        const uchar *row = top_left + y * step;
+        for (x = 0; x + 64 <= k; x += 64)
+            sums = _mm512_add_epi64(sums, _mm512_sad_epu8(_mm512_loadu_si512((const void*)(row + x)), zero));
+        for (; x < k; x++)
+            sum += row[x];
+    }
+
+    return sum + (int)_mm512_reduce_add_epi64(sums);
+}
+
+//// DETECTION ////
+
+// Get the highest level supported by the CPU and enabled by the OS
+CpuDispatch::Level DetectLevel() {
+    unsigned eax, ebx, ecx, edx;
+    unsigned xcr0_low, xcr0_high;
+    bool sse42, avx2, avx512, ymm_enabled, zmm_enabled;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return CpuDispatch::LEVEL_SCALAR;
+    sse42 = (ecx & bit_SSE4_2) != 0;
+
+    // Registers wider than 128 bits are only usable if the OS saves them (OSXSAVE and XCR0)
+    ymm_enabled = zmm_enabled = false;
+    if ((ecx & bit_OSXSAVE) != 0 && (ecx & bit_AVX) != 0) {
+        __asm__ ("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+        ymm_enabled = (xcr0_low & 0x06) == 0x06;
+        zmm_enabled = (xcr0_low & 0xE6) == 0xE6;
+    }
+
+    avx2 = avx512 = false;
+    if (__get_cpuid_max(0, 0) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        avx2 = ymm_enabled && (ebx & (1u << 5)) != 0;
+        avx512 = zmm_enabled && (ebx & (1u << 16)) != 0 && (ebx & (1u << 30)) != 0;
+    }
+
+    if (avx2 && avx512)
+        return CpuDispatch::LEVEL_AVX512;
+    if (avx2)
+        return CpuDispatch::LEVEL_AVX2;
+    if (sse42)
+        return CpuDispatch::LEVEL_SSE42;
+    return CpuDispatch::LEVEL_SCALAR;
+}
+#else
+// Only the scalar kernels are built for other architectures
+CpuDispatch::Level DetectLevel() {
+    return CpuDispatch::LEVEL_SCALAR;
+}
+#endif
+
+// Kernels of each level
+const CpuDispatch::Kernels KERNELS[CpuDispatch::N_LEVELS] = {
+    {DerivativeStandardDeviationScalar, FirstIndexAboveThresholdScalar, HistogramScalar,
+     MaskedHistogramScalar, GatherScalar, WindowSumScalar},
+#if defined(CPUDISPATCH_X86)
+    // SSE4.2 has no gather instruction
+    {DerivativeStandardDeviationSse42, FirstIndexAboveThresholdSse42, HistogramUnrolled,
+     MaskedHistogramSse42, GatherScalar, WindowSumSse42},
+    {DerivativeStandardDeviationAvx2, FirstIndexAboveThresholdAvx2, HistogramUnrolled,
+     MaskedHistogramAvx2, GatherAvx2, WindowSumAvx2},
+    {DerivativeStandardDeviationAvx512, FirstIndexAboveThresholdAvx512, HistogramUnrolled,
+     MaskedHistogramAvx512, GatherAvx512, WindowSumAvx512}
+#else
+    {DerivativeStandardDeviationScalar, FirstIndexAboveThresholdScalar, HistogramScalar,
+     MaskedHistogramScalar, GatherScalar, WindowSumScalar},
+    {DerivativeStandardDeviationScalar, FirstIndexAboveThresholdScalar, HistogramScalar,
+     MaskedHistogramScalar, GatherScalar, WindowSumScalar},
+    {DerivativeStandardDeviationScalar, FirstIndexAboveThresholdScalar, HistogramScalar,
+     MaskedHistogramScalar, GatherScalar, WindowSumScalar}
+#endif
+};
+
+// Compare a result of a level with the scalar one and report a mismatch
+template <typename T>
+bool CheckResult(const char *kernel, const CpuDispatch::Level& level, const int& n, const T& expected, const T& result) {
+    if (expected == result)
+        return true;
+    std::cout << "Kernel " << kernel << " at level " << LEVEL_NAMES[level] << " differs from scalar for n = " << n
+              << std::endl;
+    return false;
+}
+}
+
+// Get pointer to kernels of the active level, selecting it at first call
+const CpuDispatch::Kernels *CpuDispatch::active() {
+    const Kernels *kernels = active_kernels.load(std::memory_order_acquire);
+    const char *forced;
+    Level level;
+    int i;
+
+    if (kernels != 0)
+        return kernels;
+
+    level = getSupportedLevel();
+    forced = std::getenv(LEVEL_VARIABLE);
+    if (forced != 0) {
+        for (i = 0; i < N_LEVELS && std::string(forced) != LEVEL_NAMES[i]; i++);
+        if (i == N_LEVELS)
+            std::cout << "Unknown " << LEVEL_VARIABLE << ": " << forced << std::endl;
+        else if (i > level)
+            std::cout << "CPU does not support " << LEVEL_VARIABLE << "=" << forced << std::endl;
+        else
+            level = (Level)i;
+    }
+
+    // Concurrent first calls select the same level, so any of them can win
+    kernels = &KERNELS[level];
+    active_kernels.store(kernels, std::memory_order_release);
+
+    return kernels;
+}
+
+// Get the active level
+CpuDispatch::Level CpuDispatch::getLevel() {
+    return (Level)(active() - KERNELS);
+}
+
+// Get the highest level this CPU supports
+CpuDispatch::Level CpuDispatch::getSupportedLevel() {
+    static const Level level = DetectLevel();
+    return level;
+}
+
+// Force a level. Fails if the CPU does not support it.
+bool CpuDispatch::setLevel(const Level& level) {
+    if (level < LEVEL_SCALAR || level > getSupportedLevel())
+        return false;
+    active_kernels.store(&KERNELS[level], std::memory_order_release);
+    return true;
+}
+
+// Get kernels of a level
+const CpuDispatch::Kernels& CpuDispatch::getKernels(const Level& level) {
+    return KERNELS[level];
+}
+
+// Get name of a level
+const char *CpuDispatch::LevelName(const Level& level) {
+    return LEVEL_NAMES[level];
+}
+
+// Run the kernels of every supported level on random data and compare them with the scalar ones.
+// Sizes cover empty input, lengths shorter than a vector, and tails of every length.
+// OUTPUT: true if every level gives the scalar results
+bool CpuDispatch::CrossCheck() {
+    const int rows = 67, cols = 131;
+    const Kernels& scalar = KERNELS[LEVEL_SCALAR];
+    std::mt19937 random(1234);
+    std::vector<uchar> image(rows * cols), mask(rows * cols), zeros(rows * cols, 0);
+    std::vector<cv::Point> points;
+    std::vector<uchar> expected_values, values;
+    std::vector<int> expected_hist(256), hist(256);
+    bool ok = true;
+    int level, n, d, k, thr;
+
+    for (n = 0; n < (int)image.size(); n++) {
+        image[n] = (uchar)random();
+        // Runs of masked in and masked out values, like a polygon mask
+        mask[n] = ((n / 37) % 3 == 0 || random() % 8 == 0) ? 255 : 0;
+    }
+    for (n = 0; n < 200; n++)
+        points.push_back(cv::Point(random() % cols, random() % rows));
+    // Corner pixels, whose 32-bit words would reach past the end of the image
+    points.push_back(cv::Point(cols - 1, rows - 1));
+    points.push_back(cv::Point(cols - 2, rows - 1));
+
+    for (level = LEVEL_SSE42; level <= getSupportedLevel(); level++) {
+        const Kernels& kernels = KERNELS[level];
+
+        for (n = 0; n <= 300; n++) {
+            for (d = 1; d <= 9; d += 4)
+                ok &= CheckResult("derivative_standard_deviation", (Level)level, n,
+                                  scalar.derivative_standard_deviation(image.data(), n, d),
+                                  kernels.derivative_standard_deviation(image.data(), n, d));
+            thr = 200 + n % 56;
+            ok &= CheckResult("first_index_above_threshold", (Level)level, n,
+                              scalar.first_index_above_threshold(image.data(), n, (uchar)thr),
+                              kernels.first_index_above_threshold(image.data(), n, (uchar)thr));
+            ok &= CheckResult("first_index_above_threshold", (Level)level, n, -1,
+                              kernels.first_index_above_threshold(zeros.data(), n, 1));
+
+            std::fill(expected_hist.begin(), expected_hist.end(), 0);
+            std::fill(hist.begin(), hist.end(), 0);
+            scalar.histogram(image.data(), n, expected_hist.data());
+            kernels.histogram(image.data(), n, hist.data());
+            ok &= CheckResult("histogram", (Level)level, n, expected_hist, hist);
+
+            std::fill(expected_hist.begin(), expected_hist.end(), 0);
+            std::fill(hist.begin(), hist.end(), 0);
+            scalar.masked_histogram(image.data(), mask.data(), n, expected_hist.data());
+            kernels.masked_histogram(image.data(), mask.data(), n, hist.data());
+            ok &= CheckResult("masked_histogram", (Level)level, n, expected_hist, hist);
+        }
+
+        // Whole image, to cover blocks of every width and the sub-histograms
+        std::fill(expected_hist.begin(), expected_hist.end(), 0);
+        std::fill(hist.begin(), hist.end(), 0);
+        scalar.histogram(image.data(), (int)image.size(), expected_hist.data());
+        kernels.histogram(image.data(), (int)image.size(), hist.data());
+        ok &= CheckResult("histogram", (Level)level, (int)image.size(), expected_hist, hist);
+        std::fill(expected_hist.begin(), expected_hist.end(), 0);
+        std::fill(hist.begin(), hist.end(), 0);
+        scalar.masked_histogram(image.data(), mask.data(), (int)image.size(), expected_hist.data());
+        kernels.masked_histogram(image.data(), mask.data(), (int)image.size(), hist.data());
+        ok &= CheckResult("masked_histogram", (Level)level, (int)image.size(), expected_hist, hist);
+
+        for (n = 0; n <= (int)points.size(); n++) {
+            expected_values.assign(n, 0);
+            values.assign(n, 0);
+            // The corner points are at the end of the last block of every size
+            scalar.gather(image.data(), cols, image.size(), points.data() + points.size() - n, n, expected_values.data());
+            kernels.gather(image.data(), cols, image.size(), points.data() + points.size() - n, n, values.data());
+            ok &= CheckResult("gather", (Level)level, n, expected_values, values);
+        }
+
+        for (k = 1; k <= 66; k++)
+            ok &= CheckResult("window_sum", (Level)level, k,
+                              scalar.window_sum(image.data(), cols, k),
+                              kernels.window_sum(image.data(), cols, k));
+    }
+
+    std::cout << "Pixel kernels cross check " << (ok ? "passed" : "FAILED") << " up to level "
+              << LEVEL_NAMES[getSupportedLevel()] << std::endl;
+
+    return ok;
+}
@@ -0,0 +1,70 @@
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+// Pixel kernels of the project, with one implementation per instruction set level.
+// The level is selected at startup from CPUID, so one binary is fast on old and new CPUs.
+// Setting DENTALBIOMETRY_CPU_LEVEL (scalar, sse4.2, avx2, avx512) forces a lower level.
+class CpuDispatch
+{
+public:
+    // Instruction set levels, from lowest to highest
+    enum Level {
+        LEVEL_SCALAR,
+        LEVEL_SSE42,
+        LEVEL_AVX2,
+        LEVEL_AVX512,   // AVX-512 F and BW
+        N_LEVELS
+    };
+
+    // Kernels of one level. Every level gives the same results.
+    struct Kernels {
+        // Standard deviation of the derivatives of n pixel values at distance d (see Helpers::DerivativeStandardDeviation)
+        double (*derivative_standard_deviation)(const uchar*, int, int);
+        // Index of the first of n pixel values >= thr, or -1
+        int (*first_index_above_threshold)(const uchar*, int, uchar);
+        // Add n pixel values to a 256 bin histogram
+        void (*histogram)(const uchar*, int, int*);
+        // Add the n pixel values whose mask value is not 0 to a 256 bin histogram
+        void (*masked_histogram)(const uchar*, const uchar*, int, int*);
+        // Read the pixels of an image of size bytes at n points. Rows are step bytes apart.
+        void (*gather)(const uchar*, size_t, size_t, const cv::Point*, int, uchar*);
+        // Sum of a k x k window of pixels starting at its top left pixel. Rows are step bytes apart.
+        int (*window_sum)(const uchar*, size_t, int);
+    };
+
+    // Get kernels of the active level
+    static const Kernels& get() {
+        return *active();
+    }
+
+    // Get the active level
+    static Level getLevel();
+
+    // Get the highest level this CPU supports
+    static Level getSupportedLevel();
+
+    // Force a level. Fails if the CPU does not support it.
+    static bool setLevel(const Level&);
+
+    // Get kernels of a level. Only call them if the CPU supports the level.
+    static const Kernels& getKernels(const Level&);
+
+    // Get name of a level
+    static const char *LevelName(const Level&);
+
+    // Run the kernels of every supported level on random data and compare them with the scalar ones
+    static bool CrossCheck();
+
+private:
+    // Disallow creating an instance of this object
+    CpuDispatch() {}
+
+    // Get pointer to kernels of the active level, selecting it at first call
+    static const Kernels *active();
+};
+
+#endif // CPUDISPATCH_H
@@ -1,10 +1,25 @@
 #include "cqtopencvviewergl.h"
+#include "threadpool.h"
+#include <QMouseEvent>
 
+// Half size of the window around a seed the livewire tree grows over.
+// Segments are traced click by click, so paths never need to reach across the whole image.
+static const int LIVEWIRE_RADIUS = 256;
 
 CQtOpenCVViewerGl::CQtOpenCVViewerGl(QWidget *parent) :
-QOpenGLWidget(parent)
+QOpenGLWidget(parent),
+mLiveWireEnabled(false)
 {
     mBgColor = QColor::fromRgb(150, 150, 150);
+
+    // ~60 fps refresh of the preview while the shortest-path tree grows
+    mLiveWireTimer.setInterval(16);
+    connect(&mLiveWireTimer, SIGNAL(timeout()), this, SLOT(updateLiveWirePreview()));
+}
+
+CQtOpenCVViewerGl::~CQtOpenCVViewerGl()
+{
+    stopLiveWireGrowth();
 }
 
 void CQtOpenCVViewerGl::initializeGL()
@@ -49,6 +64,9 @@ void CQtOpenCVViewerGl::paintGL()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     renderImage();
+
+    if (mLiveWireEnabled)
+        renderLiveWire();
 }
 
 void CQtOpenCVViewerGl::renderImage()
@@ -114,8 +132,30 @@ void CQtOpenCVViewerGl::recalculatePosition()
 
 bool CQtOpenCVViewerGl::showImage(const cv::Mat& image)
 {
+    // Livewire follows the shown grayscale image. A new pixel version of the same document (e.g. a live
+    // preview) keeps the traced contour and regrows the tree from its last point; another size is another image.
+    if (mLiveWireEnabled && !image.empty() && image.channels() == 1)
+    {
+        if (image.size() != mLiveWireGradient.size())
+            clearLiveWire();
+        mLiveWireGradient = image;
+        mLiveWirePreview.clear();
+        if (!mLiveWireContour.empty())
+            startLiveWireGrowth(mLiveWireContour.back());
+    }
+
     drawMutex.lock();
-    if (image.channels() == 3)
+    if (image.empty())
+    {
+        // Nothing to show
+        mOrigImage = cv::Mat();
+        mRenderQtImg = QImage();
+        mResizedImg = QImage();
+        updateScene();
+        drawMutex.unlock();
+        return true;
+    }
+    else if (image.channels() == 3)
         cvtColor(image, mOrigImage, CV_BGR2RGBA);
     else if (image.channels() == 1)
         cvtColor(image, mOrigImage, CV_GRAY2RGBA);
@@ -133,3 +173,182 @@ bool CQtOpenCVViewerGl::showImage(const cv::Mat& image)
     drawMutex.unlock();
     return true;
 }
+
+void CQtOpenCVViewerGl::setLiveWireEnabled(bool enabled)
+{
+    stopLiveWireGrowth();
+    mLiveWireEnabled = enabled;
+    setMouseTracking(enabled);
+    mLiveWireContour.clear();
+    mLiveWirePreview.clear();
+
+    if (enabled && !mOrigImage.empty())
+        cv::cvtColor(mOrigImage, mLiveWireGradient, CV_RGBA2GRAY);
+    else
+        mLiveWireGradient = cv::Mat();
+
+    updateScene();
+}
+
+void CQtOpenCVViewerGl::clearLiveWire()
+{
+    stopLiveWireGrowth();
+    mLiveWireContour.clear();
+    mLiveWirePreview.clear();
+    updateScene();
+}
+
+std::vector<cv::Point> CQtOpenCVViewerGl::liveWireContour() const
+{
+    return mLiveWireContour;
+}
+
+bool CQtOpenCVViewerGl::widgetToImage(const QPoint& widgetPos, cv::Point& imagePos)
+{
+    if (mOrigImage.empty() || mRenderWidth <= 0 || mRenderHeight <= 0)
+        return false;
+
+    imagePos.x = (widgetPos.x() - mRenderPosX) * mOrigImage.cols / mRenderWidth;
+    imagePos.y = (widgetPos.y() + mRenderPosY) * mOrigImage.rows / mRenderHeight;
+
+    return imagePos.x >= 0 && imagePos.y >= 0
+            && imagePos.x < mOrigImage.cols && imagePos.y < mOrigImage.rows;
+}
+
+void CQtOpenCVViewerGl::mousePressEvent(QMouseEvent *event)
+{
+    cv::Point seed;
+
+    if (!mLiveWireEnabled)
+        return QOpenGLWidget::mousePressEvent(event);
+
+    if (event->button() == Qt::RightButton)
+    {
+        // Discard the traced contour
+        clearLiveWire();
+        return;
+    }
+
+    if (event->button() != Qt::LeftButton || !widgetToImage(event->pos(), seed))
+        return;
+
+    // Commit the previewed path and start a new tree from the clicked pixel
+    updateLiveWirePreview();
+    if (!mLiveWirePreview.empty())
+        mLiveWireContour.insert(mLiveWireContour.end(), mLiveWirePreview.begin() + 1, mLiveWirePreview.end());
+    else
+        mLiveWireContour.push_back(seed);
+    mLiveWirePreview.clear();
+
+    startLiveWireGrowth(seed);
+    updateScene();
+}
+
+void CQtOpenCVViewerGl::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!mLiveWireEnabled || !widgetToImage(event->pos(), mLiveWireCursor))
+        return QOpenGLWidget::mouseMoveEvent(event);
+
+    updateLiveWirePreview();
+}
+
+void CQtOpenCVViewerGl::updateLiveWirePreview()
+{
+    std::vector<cv::Point> path;
+
+    if (!mLiveWireGrowth)
+        return;
+
+    // Only backtracking happens here, the tree is grown by the background task.
+    // Outside the window of the seed there is no path, and the last one is kept.
+    {
+        std::lock_guard<std::mutex> lock(mLiveWireGrowth->mutex);
+        path = mLiveWireGrowth->livewire.GetPath(mLiveWireCursor);
+    }
+    if (!path.empty())
+        mLiveWirePreview.swap(path);
+
+    // Stop refreshing once the tree is complete
+    if (mLiveWireGrowth->done)
+        mLiveWireTimer.stop();
+
+    updateScene();
+}
+
+void CQtOpenCVViewerGl::startLiveWireGrowth(const cv::Point& seed)
+{
+    std::shared_ptr<LiveWireGrowth> growth;
+
+    stopLiveWireGrowth();
+    if (mLiveWireGradient.empty())
+        return;
+
+    // The tree is not shared with a task yet, so no lock is needed
+    growth = std::make_shared<LiveWireGrowth>();
+    growth->livewire.SetImage(mLiveWireGradient, cv::Rect(seed.x - LIVEWIRE_RADIUS, seed.y - LIVEWIRE_RADIUS,
+                                                          2 * LIVEWIRE_RADIUS + 1, 2 * LIVEWIRE_RADIUS + 1));
+    if (!growth->livewire.SetSeed(seed))
+        return;
+    mLiveWireGrowth = growth;
+
+    // Grow in small batches so previews near the seed are available within a frame.
+    // The future is not kept: nothing ever waits for the task.
+    ThreadPool::getInstance()->Submit([growth]() {
+        bool growing = true;
+        while (growing && !growth->cancel)
+        {
+            std::lock_guard<std::mutex> lock(growth->mutex);
+            growing = growth->livewire.GrowTree(4096);
+        }
+        growth->done = true;
+    });
+
+    mLiveWireTimer.start();
+}
+
+void CQtOpenCVViewerGl::stopLiveWireGrowth()
+{
+    mLiveWireTimer.stop();
+
+    // The task sees the flag at its next batch and releases the tree
+    if (mLiveWireGrowth)
+    {
+        mLiveWireGrowth->cancel = true;
+        mLiveWireGrowth.reset();
+    }
+}
+
+void CQtOpenCVViewerGl::renderLiveWire()
+{
+    size_t i;
+    float sx, sy;
+
+    if (mOrigImage.empty())
+        return;
+
+    // Image pixel -> render area. Y grows downwards from mRenderPosY (see resizeGL).
+    sx = (float)mRenderWidth / mOrigImage.cols;
+    sy = (float)mRenderHeight / mOrigImage.rows;
+
+    glLoadIdentity();
+    glLineWidth(2.0f);
+
+    // Committed contour
+    glColor3f(1.0f, 1.0f, 0.0f);
+    glBegin(GL_LINE_STRIP);
+    for (i = 0; i < mLiveWireContour.size(); i++)
+        glVertex2f(mRenderPosX + (mLiveWireContour[i].x + 0.5f) * sx,
+                   mRenderPosY - (mLiveWireContour[i].y + 0.5f) * sy);
+    glEnd();
+
+    // Preview from seed to cursor
+    glColor3f(0.0f, 1.0f, 0.0f);
+    glBegin(GL_LINE_STRIP);
+    for (i = 0; i < mLiveWirePreview.size(); i++)
+        glVertex2f(mRenderPosX + (mLiveWirePreview[i].x + 0.5f) * sx,
+                   mRenderPosY - (mLiveWirePreview[i].y + 0.5f) * sy);
+    glEnd();
+
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glFlush();
+}
@@ -3,15 +3,25 @@
 
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions_2_0>
+#include <QTimer>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <vector>
+#include "livewire.h"
 
 class CQtOpenCVViewerGl : public QOpenGLWidget, protected QOpenGLFunctions_2_0
 {
     Q_OBJECT
 public:
     explicit CQtOpenCVViewerGl(QWidget *parent = 0);
+    ~CQtOpenCVViewerGl();
+
+    void    setLiveWireEnabled(bool enabled); /// Used to turn interactive livewire tracing on and off
+    std::vector<cv::Point> liveWireContour() const; /// Contour traced so far with the livewire
+    void    clearLiveWire(); /// Discard the traced contour, e.g. when another document is shown
 
 signals:
     void    imageSizeChanged( int outW, int outH ); /// Used to resize the image outside the widget
@@ -26,6 +36,13 @@ protected:
 
     void    updateScene();
     void    renderImage();
+    void    renderLiveWire(); /// Draw livewire contour and preview over the image
+
+    void    mousePressEvent(QMouseEvent *event); /// Left click sets a livewire seed, right click clears
+    void    mouseMoveEvent(QMouseEvent *event); /// Livewire preview follows the cursor
+
+private slots:
+    void    updateLiveWirePreview(); /// Backtrack preview path from the cursor
 
 private:
 
@@ -43,8 +60,29 @@ private:
     int mRenderPosY;
 
     void recalculatePosition();
+    bool widgetToImage(const QPoint& widgetPos, cv::Point& imagePos); /// Map widget coordinates to image pixel
+    void startLiveWireGrowth(const cv::Point& seed); /// Grow the shortest-path tree in the background
+    void stopLiveWireGrowth(); /// Cancel the growth task without waiting for it
+
+    /// Shortest-path tree shared with its growth task. The task holds it until it returns,
+    /// so the GUI drops a tree without waiting for a pool worker to reach the task.
+    struct LiveWireGrowth {
+        LiveWireGrowth() : cancel(false), done(false) {}
+        LiveWire            livewire;   /// Tree from the seed, over a window around it
+        std::mutex          mutex;      /// Guards livewire between GUI and growth task
+        std::atomic<bool>   cancel;     /// Stops the growth task
+        std::atomic<bool>   done;       /// Set when the task returns
+    };
 
     std::mutex drawMutex;
+
+    bool                    mLiveWireEnabled;
+    cv::Mat                 mLiveWireGradient;   /// Image the livewire costs are derived from
+    std::shared_ptr<LiveWireGrowth> mLiveWireGrowth; /// Tree of the current seed and its growth state
+    QTimer                  mLiveWireTimer;      /// Refreshes the preview while the tree grows
+    cv::Point               mLiveWireCursor;     /// Last cursor position in image coordinates
+    std::vector<cv::Point>  mLiveWireContour;    /// Committed contour
+    std::vector<cv::Point>  mLiveWirePreview;    /// Path from the seed to the cursor
 };
 
 #endif // CQTOPENCVVIEWERGL_H
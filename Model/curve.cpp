@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <climits>
+#include "cpudispatch.h"
+#include "curve.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+// Points built on the stack for each call of the gather kernel
+const int GATHER_CHUNK = 256;
+}
+
+// Translate every row by dy and clamp it to [min_y, max_y].
+// Works on 8 rows at a time with saturated 16-bit adds, so there is no bounds branch per element.
+// INPUT: dy -> rows to translate. Negative is upwards.
+// INPUT: min_y -> first valid row
+// INPUT: max_y -> last valid row
+void Curve::Translate(const int& dy, const int& min_y, const int& max_y) {
+    short d, lo, hi;
+    int i, n;
+
+    d = (short)std::max(SHRT_MIN, std::min(SHRT_MAX, dy));
+    lo = (short)std::max(SHRT_MIN, std::min(SHRT_MAX, min_y));
+    hi = (short)std::max(SHRT_MIN, std::min(SHRT_MAX, max_y));
+    n = _y.size();
+    i = 0;
+
+#if defined(__SSE2__)
+    const __m128i d8 = _mm_set1_epi16(d);
+    const __m128i lo8 = _mm_set1_epi16(lo);
+    const __m128i hi8 = _mm_set1_epi16(hi);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&_y[i]);
+        v = _mm_min_epi16(_mm_max_epi16(_mm_adds_epi16(v, d8), lo8), hi8);
+        _mm_storeu_si128((__m128i*)&_y[i], v);
+    }
+#endif
+
+    // Remaining rows
+    for (; i < n; i++)
+        _y[i] = (short)std::min((int)hi, std::max((int)lo, _y[i] + d));
+}
+
+// Clamp every row to [min_y, max_y]
+void Curve::Clamp(const int& min_y, const int& max_y) {
+    Translate(0, min_y, max_y);
+}
+
+// Get the pixel values of an image under the curve.
+// Rows of valid elements must be inside the image. Invalid elements are skipped.
+// INPUT: img -> grayscale image
+// OUTPUT: values -> pixel value of each valid element, in column order
+void Curve::Gather(const cv::Mat& img, vector<uchar>& values) const {
+    values.resize(_y.size());
+    values.resize(Gather(img, values.data()));
+}
+
+// Write the pixel values of an image under the curve to a buffer.
+// Without a mask, the points are read by the dispatched gather kernel, a chunk at a time.
+// Rows of valid elements must be inside the image. Invalid elements are skipped.
+// INPUT: img -> grayscale image
+// INPUT: values -> buffer of at least size() values
+// OUTPUT: number of values written
+int Curve::Gather(const cv::Mat& img, uchar* values) const {
+    cv::Point points[GATHER_CHUNK];
+    const uchar *column;
+    ptrdiff_t step;
+    int i, j, n, k, m;
+
+    n = _y.size();
+    column = img.data + _x0;
+    step = (ptrdiff_t)img.step[0];
+
+    if (_valid.empty()) {
+        for (i = 0; i < n; i += GATHER_CHUNK) {
+            m = std::min(GATHER_CHUNK, n - i);
+            for (j = 0; j < m; j++)
+                points[j] = cv::Point(_x0 + i + j, _y[i + j]);
+            CpuDispatch::get().gather(img.data, img.step, img.dataend - img.data, points, m, values + i);
+        }
+        return n;
+    }
+
+    k = 0;
+    for (i = 0; i < n; i++)
+        if (_valid[i])
+            values[k++] = column[_y[i] * step + i];
+
+    return k;
+}
+
+// Get the curve as a vector of points
+vector<cv::Point> Curve::ToPoints() const {
+    vector<cv::Point> points;
+    int i;
+
+    points.reserve(_y.size());
+    for (i = 0; i < (int)_y.size(); i++)
+        points.push_back(point(i));
+
+    return points;
+}
@@ -0,0 +1,101 @@
+#ifndef CURVE_H
+#define CURVE_H
+
+#include <iostream>
+#include <vector>
+#include <opencv2/core.hpp>
+
+using namespace std;
+
+// Curve that is a function of x: one row per column, stored as a dense array of y values.
+// The column of element i is x0 + i, so x is never stored.
+class Curve
+{
+public:
+    // Empty default constructor
+    Curve() : _x0(0) {
+    }
+
+    // Curve of n columns starting at column x0, all at row 0
+    Curve(const int& x0, const int& n) : _x0(x0),
+        _y(n, 0) {
+    }
+
+    // Get number of columns
+    int size() const {
+        return (int)_y.size();
+    }
+
+    // Check if the curve has no columns
+    bool empty() const {
+        return _y.empty();
+    }
+
+    // Get column of the first element
+    int getFirstColumn() const {
+        return _x0;
+    }
+
+    // Get row of element i
+    int y(const int& i) const {
+        return _y[i];
+    }
+
+    // Set row of element i
+    void setY(const int& i, const int& y) {
+        _y[i] = (short)y;
+    }
+
+    // Get element i as a point in image coordinates
+    cv::Point point(const int& i) const {
+        return cv::Point(_x0 + i, _y[i]);
+    }
+
+    // Check if element i holds a valid row. Every element is valid if there is no mask.
+    bool isValid(const int& i) const {
+        return _valid.empty() || _valid[i] != 0;
+    }
+
+    // Set validity of element i. The mask is created at the first call.
+    void setValid(const int& i, const bool& valid) {
+        if (_valid.empty())
+            _valid.assign(_y.size(), 1);
+        _valid[i] = valid ? 1 : 0;
+    }
+
+    // Check if the curve has a validity mask
+    bool hasMask() const {
+        return !_valid.empty();
+    }
+
+    // Get pointer to the rows
+    const short *data() const {
+        return _y.data();
+    }
+
+    // Translate every row by dy and clamp it to [min_y, max_y]
+    void Translate(const int&, const int&, const int&);
+
+    // Clamp every row to [min_y, max_y]
+    void Clamp(const int&, const int&);
+
+    // Get the pixel values of an image under the curve
+    void Gather(const cv::Mat&, vector<uchar>&) const;
+
+    // Write the pixel values of an image under the curve to a buffer
+    int Gather(const cv::Mat&, uchar*) const;
+
+    // Get the curve as a vector of points
+    vector<cv::Point> ToPoints() const;
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Column of the first element
+    int _x0;
+    // Row of each column
+    vector<short> _y;
+    // Validity of each column (1 valid, 0 invalid). Empty means every column is valid.
+    vector<uchar> _valid;
+};
+
+#endif // CURVE_H
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <iostream>
+#include <opencv2/imgproc.hpp>
+#include "dentalarch.h"
+
+namespace {
+// Rows and columns darker than this mean value are border or background
+const float BORDER_INTENSITY = 20;
+// Columns of the arch keep this fraction of the peak vertical gradient energy
+const float COLUMN_ENERGY_FRACTION = 0.5;
+// Rows of the arch keep this fraction of the peak vertical gradient energy
+const float ROW_ENERGY_FRACTION = 0.3;
+// Padding added to the region, as a fraction of the image size. Rows get more room for the roots.
+const float COLUMN_PADDING = 0.05;
+const float ROW_PADDING = 0.15;
+// Regions smaller than this fraction of the image are not trusted
+const float MIN_AREA_FRACTION = 0.1;
+}
+
+// Find the tooth-bearing region of a panoramic image.
+// Works on row and column projections of a decimated image:
+// black borders are trimmed by mean intensity, then the arch is the span of columns and rows
+// around the peak of vertical gradient energy (crown edges and the gap between the jaws).
+// INPUT: image -> grayscale panoramic image
+// INPUT: decimation -> factor the image is shrunk by before the projections
+// OUTPUT: region in image coordinates. The whole image if no region is found.
+cv::Rect DentalArch::FindRegion(const cv::Mat& image, const int& decimation) {
+    cv::Mat small, gradient;
+    cv::Rect full, content, region;
+    cv::Range columns, rows;
+    std::vector<float> column_energy, row_energy, column_mean, row_mean;
+    const uchar *row;
+    int x, y, seed, scale;
+
+    full = cv::Rect(0, 0, image.cols, image.rows);
+    scale = std::max(1, decimation);
+    if (image.empty() || image.cols / scale < 16 || image.rows / scale < 16)
+        return full;
+
+    cv::resize(image, small, cv::Size(image.cols / scale, image.rows / scale), 0, 0, cv::INTER_AREA);
+
+    // Trim black borders and background with the mean intensity of rows and columns
+    column_mean.assign(small.cols, 0);
+    row_mean.assign(small.rows, 0);
+    for (y = 0; y < small.rows; y++) {
+        row = small.ptr<uchar>(y);
+        for (x = 0; x < small.cols; x++) {
+            column_mean[x] += row[x];
+            row_mean[y] += row[x];
+        }
+    }
+    content = cv::Rect(0, 0, small.cols, small.rows);
+    for (x = 0; x < small.cols; x++)
+        column_mean[x] /= small.rows;
+    for (y = 0; y < small.rows; y++)
+        row_mean[y] /= small.cols;
+    while (content.width > 1 && column_mean[content.x] < BORDER_INTENSITY) {
+        content.x++;
+        content.width--;
+    }
+    while (content.width > 1 && column_mean[content.x + content.width - 1] < BORDER_INTENSITY)
+        content.width--;
+    while (content.height > 1 && row_mean[content.y] < BORDER_INTENSITY) {
+        content.y++;
+        content.height--;
+    }
+    while (content.height > 1 && row_mean[content.y + content.height - 1] < BORDER_INTENSITY)
+        content.height--;
+    if (content.width < 8 || content.height < 8)
+        return full;
+
+    // Vertical gradient magnitude. Teeth have strong horizontal edges, the spine and the ramus do not.
+    cv::absdiff(small(cv::Rect(content.x, content.y + 1, content.width, content.height - 1)),
+                small(cv::Rect(content.x, content.y, content.width, content.height - 1)),
+                gradient);
+
+    // Columns: span around the peak in the middle half of the image
+    column_energy.assign(gradient.cols, 0);
+    for (y = 0; y < gradient.rows; y++) {
+        row = gradient.ptr<uchar>(y);
+        for (x = 0; x < gradient.cols; x++)
+            column_energy[x] += row[x];
+    }
+    column_energy = Smooth(column_energy, std::max(1, gradient.cols / 10));
+    seed = std::max_element(column_energy.begin() + gradient.cols / 4, column_energy.begin() + (3 * gradient.cols) / 4)
+            - column_energy.begin();
+    columns = Span(column_energy, seed, COLUMN_ENERGY_FRACTION);
+
+    // Rows: span around the peak within the columns of the arch
+    row_energy.assign(gradient.rows, 0);
+    for (y = 0; y < gradient.rows; y++) {
+        row = gradient.ptr<uchar>(y);
+        for (x = columns.start; x < columns.end; x++)
+            row_energy[y] += row[x];
+    }
+    row_energy = Smooth(row_energy, std::max(1, gradient.rows / 20));
+    seed = std::max_element(row_energy.begin(), row_energy.end()) - row_energy.begin();
+    rows = Span(row_energy, seed, ROW_ENERGY_FRACTION);
+
+    // Back to image coordinates, with padding
+    region = cv::Rect((content.x + columns.start) * scale,
+                      (content.y + rows.start) * scale,
+                      (columns.end - columns.start) * scale,
+                      (rows.end - rows.start + 1) * scale);
+    region.x -= (int)(image.cols * COLUMN_PADDING);
+    region.width += 2 * (int)(image.cols * COLUMN_PADDING);
+    region.y -= (int)(image.rows * ROW_PADDING);
+    region.height += 2 * (int)(image.rows * ROW_PADDING);
+    region &= full;
+
+    if (region.area() < full.area() * MIN_AREA_FRACTION) {
+        std::cout << "Dental arch not found. Using the whole image." << std::endl;
+        return full;
+    }
+
+    std::cout << "Dental arch region: " << region.x << ", " << region.y << ", "
+              << region.width << "x" << region.height << std::endl;
+
+    return region;
+}
+
+// Get the span of a projection around a seed where the values stay above a fraction of the seed value
+// INPUT: v -> projection
+// INPUT: seed -> index of the peak
+// INPUT: fraction -> fraction of the peak value
+// OUTPUT: range of indices [start, end)
+cv::Range DentalArch::Span(const std::vector<float>& v, const int& seed, const float& fraction) {
+    float thr;
+    int start, end;
+
+    thr = v[seed] * fraction;
+    start = seed;
+    end = seed + 1;
+    while (start > 0 && v[start - 1] >= thr)
+        start--;
+    while (end < (int)v.size() && v[end] >= thr)
+        end++;
+
+    return cv::Range(start, end);
+}
+
+// Smooth a projection with a moving average
+// INPUT: v -> projection
+// INPUT: k -> window size
+// OUTPUT: smoothed projection
+std::vector<float> DentalArch::Smooth(const std::vector<float>& v, const int& k) {
+    std::vector<float> smoothed(v.size(), 0);
+    double sum;
+    int i, first, last, n;
+
+    n = v.size();
+    sum = 0;
+    first = 0;
+    last = -1;
+    for (i = 0; i < n; i++) {
+        // Window [i - k/2, i + k/2] clamped to the projection
+        while (last < std::min(n - 1, i + k / 2))
+            sum += v[++last];
+        while (first < i - k / 2)
+            sum -= v[first++];
+        smoothed[i] = sum / (last - first + 1);
+    }
+
+    return smoothed;
+}
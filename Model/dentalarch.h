@@ -0,0 +1,24 @@
+#ifndef DENTALARCH_H
+#define DENTALARCH_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+class DentalArch
+{
+public:
+    // Find the tooth-bearing region of a panoramic image
+    static cv::Rect FindRegion(const cv::Mat&, const int& = 8);
+
+private:
+    // Disallow creating an instance of this object
+    DentalArch() {}
+
+    // Get the span of a projection around a seed where the values stay above a fraction of the seed value
+    static cv::Range Span(const std::vector<float>&, const int&, const float&);
+
+    // Smooth a projection with a moving average
+    static std::vector<float> Smooth(const std::vector<float>&, const int&);
+};
+
+#endif // DENTALARCH_H
@@ -0,0 +1,490 @@
+#include "dicomreader.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <opencv2/imgcodecs.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Size of the preamble before the "DICM" prefix
+const size_t PREAMBLE_SIZE = 128;
+// Transfer syntaxes of uncompressed little-endian pixels
+const std::string IMPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2";
+const std::string EXPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2.1";
+// Environment variable with the layout of raw frames: <width>x<height>x<bits>, e.g. 2880x1504x16
+const char *RAW_FORMAT_VARIABLE = "DENTALBIOMETRY_RAW_FORMAT";
+// Length of sequences and items delimited by an end tag
+const uint32_t UNDEFINED_LENGTH = 0xFFFFFFFF;
+// Max nesting of sequences skipped, so a malformed file cannot exhaust the stack
+const int MAX_NESTING = 32;
+
+// Tags used, as group << 16 | element
+const uint32_t TAG_TRANSFER_SYNTAX = 0x00020010;
+const uint32_t TAG_SAMPLES_PER_PIXEL = 0x00280002;
+const uint32_t TAG_PHOTOMETRIC_INTERPRETATION = 0x00280004;
+const uint32_t TAG_ROWS = 0x00280010;
+const uint32_t TAG_COLUMNS = 0x00280011;
+const uint32_t TAG_BITS_ALLOCATED = 0x00280100;
+const uint32_t TAG_PIXEL_REPRESENTATION = 0x00280103;
+const uint32_t TAG_WINDOW_CENTER = 0x00281050;
+const uint32_t TAG_WINDOW_WIDTH = 0x00281051;
+const uint32_t TAG_RESCALE_INTERCEPT = 0x00281052;
+const uint32_t TAG_RESCALE_SLOPE = 0x00281053;
+const uint32_t TAG_PIXEL_DATA = 0x7FE00010;
+const uint32_t TAG_ITEM = 0xFFFEE000;
+const uint32_t TAG_ITEM_END = 0xFFFEE00D;
+const uint32_t TAG_SEQUENCE_END = 0xFFFEE0DD;
+
+// Header of a data element
+struct Element {
+    uint32_t tag;
+    uint32_t length;
+    // Offset of the value in the file
+    size_t value;
+};
+
+uint16_t ReadUInt16(const uchar *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t ReadUInt32(const uchar *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Check if a value representation has a 4 byte length in explicit VR
+bool HasLongLength(const uchar *vr) {
+    static const char *long_vrs[] = {"OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV"};
+    size_t i;
+
+    for (i = 0; i < sizeof(long_vrs) / sizeof(long_vrs[0]); i++)
+        if (vr[0] == long_vrs[i][0] && vr[1] == long_vrs[i][1])
+            return true;
+    return false;
+}
+
+// Read the header of the element at offset.
+// The file meta group is always explicit VR; items and delimiters have no VR.
+bool ReadElement(const uchar *data, const size_t& size, const size_t& offset, const bool& explicit_vr, Element& element) {
+    if (offset + 8 > size)
+        return false;
+
+    element.tag = ((uint32_t)ReadUInt16(data + offset) << 16) | ReadUInt16(data + offset + 2);
+    if ((element.tag >> 16) == 0xFFFE || (!explicit_vr && (element.tag >> 16) != 0x0002)) {
+        element.length = ReadUInt32(data + offset + 4);
+        element.value = offset + 8;
+    } else if (HasLongLength(data + offset + 4)) {
+        if (offset + 12 > size)
+            return false;
+        element.length = ReadUInt32(data + offset + 8);
+        element.value = offset + 12;
+    } else {
+        element.length = ReadUInt16(data + offset + 6);
+        element.value = offset + 8;
+    }
+
+    return element.length == UNDEFINED_LENGTH || element.length <= size - element.value;
+}
+
+// Skip elements up to an end tag: the items of a sequence of undefined length, or the elements of such an item
+// OUTPUT: end -> offset after the end tag
+bool SkipTo(const uchar *data, const size_t& size, size_t offset, const bool& explicit_vr,
+            const uint32_t& end_tag, const int& depth, size_t& end) {
+    Element element;
+
+    if (depth > MAX_NESTING)
+        return false;
+
+    while (ReadElement(data, size, offset, explicit_vr, element)) {
+        if (element.tag == end_tag) {
+            end = element.value;
+            return true;
+        }
+        if (element.length != UNDEFINED_LENGTH) {
+            offset = element.value + element.length;
+        } else if (!SkipTo(data, size, element.value, explicit_vr,
+                           (element.tag == TAG_ITEM) ? TAG_ITEM_END : TAG_SEQUENCE_END, depth + 1, offset)) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// Get a text value, without padding
+std::string ReadText(const uchar *data, const Element& element) {
+    if (element.length == UNDEFINED_LENGTH)
+        return std::string();
+
+    std::string text((const char*)data + element.value, element.length);
+    size_t last = text.find_last_not_of(std::string(" \0", 2));
+
+    return (last == std::string::npos) ? std::string() : text.substr(0, last + 1);
+}
+
+// Get an unsigned short value, or a default value if the element is too short to hold one
+int ReadShort(const uchar *data, const Element& element, const int& default_value) {
+    if (element.length == UNDEFINED_LENGTH || element.length < 2)
+        return default_value;
+    return ReadUInt16(data + element.value);
+}
+
+// Get the first number of a decimal string, which may hold several separated by a backslash.
+// Parsed in the C locale, since decimal strings always use a period whatever the locale of the user.
+double ReadNumber(const uchar *data, const Element& element, const double& default_value) {
+    std::istringstream stream(ReadText(data, element));
+    double value;
+
+    stream.imbue(std::locale::classic());
+    if (!(stream >> value))
+        return default_value;
+    return value;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Allocator of mapped files. It allocates nothing: it unmaps a file when the last image sharing it is released.
+class MappedFileAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(int, const int*, int, void*, size_t*, int, cv::UMatUsageFlags) const {
+        return 0;
+    }
+
+    bool allocate(cv::UMatData*, int, cv::UMatUsageFlags) const {
+        return false;
+    }
+
+    void deallocate(cv::UMatData* u) const {
+        if (u == 0)
+            return;
+        munmap(u->origdata, u->size);
+        delete u;
+    }
+};
+
+// Allocator of every mapping. Never deleted, since images may outlive any owner.
+cv::MatAllocator *MappedFiles() {
+    static MappedFileAllocator *allocator = new MappedFileAllocator;
+    return allocator;
+}
+#endif
+}
+
+// Check if a file starts with the DICOM preamble and prefix
+bool DicomReader::IsDicom(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    char prefix[4];
+
+    if (!file.seekg(PREAMBLE_SIZE) || !file.read(prefix, sizeof(prefix)))
+        return false;
+
+    return prefix[0] == 'D' && prefix[1] == 'I' && prefix[2] == 'C' && prefix[3] == 'M';
+}
+
+// Check if a file name is a raw frame (.raw)
+bool DicomReader::IsRaw(const std::string& path) {
+    std::string extension;
+    size_t dot;
+
+    dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    return extension == "raw";
+}
+
+// Read the first frame of a DICOM file.
+// Only uncompressed little-endian files are read, in explicit or implicit VR, with one sample per pixel.
+// INPUT: path -> path of the file
+// OUTPUT: pixels -> stored values, CV_8U, CV_16U or CV_16S, sharing the mapped file
+// OUTPUT: window -> display window and modality rescale of the header
+// OUTPUT: false if the file cannot be read
+bool DicomReader::Read(const std::string& path, cv::Mat& pixels, DisplayWindow& window) {
+    std::string transfer_syntax = IMPLICIT_VR_LITTLE_ENDIAN;
+    int rows = 0, cols = 0, bits_allocated = 0, samples = 1, pixel_representation = 0;
+    size_t size, offset, pixel_offset = 0, frame_bytes = 0;
+    Element element;
+    const uchar *data;
+    bool explicit_vr, found;
+    cv::Mat bytes;
+
+    if (!MapFile(path, bytes))
+        return false;
+    data = bytes.data;
+    size = bytes.total();
+    if (size < PREAMBLE_SIZE + 4 || std::string((const char*)data + PREAMBLE_SIZE, 4) != "DICM") {
+        std::cout << path << " is not a DICOM file" << std::endl;
+        return false;
+    }
+
+    window = DisplayWindow();
+    offset = PREAMBLE_SIZE + 4;
+    explicit_vr = false;
+    found = false;
+    while (!found && ReadElement(data, size, offset, explicit_vr, element)) {
+        switch (element.tag) {
+        case TAG_TRANSFER_SYNTAX:
+            transfer_syntax = ReadText(data, element);
+            if (transfer_syntax != IMPLICIT_VR_LITTLE_ENDIAN && transfer_syntax != EXPLICIT_VR_LITTLE_ENDIAN) {
+                std::cout << path << ": transfer syntax " << transfer_syntax
+                          << " is not supported. Only uncompressed little-endian files are read." << std::endl;
+                return false;
+            }
+            explicit_vr = transfer_syntax == EXPLICIT_VR_LITTLE_ENDIAN;
+            break;
+        // Elements too short for their value read as 0, so the image is refused below
+        case TAG_SAMPLES_PER_PIXEL:
+            samples = ReadShort(data, element, 0);
+            break;
+        case TAG_PHOTOMETRIC_INTERPRETATION:
+            window.inverted = ReadText(data, element) == "MONOCHROME1";
+            break;
+        case TAG_ROWS:
+            rows = ReadShort(data, element, 0);
+            break;
+        case TAG_COLUMNS:
+            cols = ReadShort(data, element, 0);
+            break;
+        case TAG_BITS_ALLOCATED:
+            bits_allocated = ReadShort(data, element, 0);
+            break;
+        case TAG_PIXEL_REPRESENTATION:
+            pixel_representation = ReadShort(data, element, 0);
+            break;
+        case TAG_WINDOW_CENTER:
+            window.center = ReadNumber(data, element, 0);
+            break;
+        case TAG_WINDOW_WIDTH:
+            window.width = ReadNumber(data, element, 0);
+            break;
+        case TAG_RESCALE_INTERCEPT:
+            window.intercept = ReadNumber(data, element, 0);
+            break;
+        case TAG_RESCALE_SLOPE:
+            window.slope = ReadNumber(data, element, 1);
+            break;
+        case TAG_PIXEL_DATA:
+            // Compressed pixels are stored in fragments of undefined length
+            if (element.length == UNDEFINED_LENGTH) {
+                std::cout << path << ": compressed pixel data is not supported" << std::endl;
+                return false;
+            }
+            pixel_offset = element.value;
+            frame_bytes = element.length;
+            found = true;
+            break;
+        }
+
+        if (element.length != UNDEFINED_LENGTH)
+            offset = element.value + element.length;
+        else if (!SkipTo(data, size, element.value, explicit_vr, TAG_SEQUENCE_END, 0, offset))
+            break;
+    }
+
+    if (!found) {
+        std::cout << path << ": no pixel data found" << std::endl;
+        return false;
+    }
+    if (rows <= 0 || cols <= 0 || samples != 1 || (bits_allocated != 8 && bits_allocated != 16)) {
+        std::cout << path << ": only grayscale images of 8 or 16 bits are supported" << std::endl;
+        return false;
+    }
+    if ((size_t)rows * cols * (bits_allocated / 8) > frame_bytes) {
+        std::cout << path << ": pixel data is shorter than the image" << std::endl;
+        return false;
+    }
+
+    if (bits_allocated == 8)
+        pixels = WrapPixels(bytes, pixel_offset, rows, cols, CV_8U);
+    else
+        pixels = WrapPixels(bytes, pixel_offset, rows, cols, pixel_representation ? CV_16S : CV_16U);
+
+    return true;
+}
+
+// Read a raw frame: pixels stored row by row, little-endian, after a header of offset bytes
+// INPUT: path -> path of the file
+// INPUT: size -> size of the frame
+// INPUT: depth -> CV_8U or CV_16U
+// OUTPUT: pixels -> stored values, sharing the mapped file
+// INPUT: offset -> bytes before the frame
+// OUTPUT: false if the file cannot be read or is shorter than the frame
+bool DicomReader::ReadRaw(const std::string& path, const cv::Size& size, const int& depth,
+                          cv::Mat& pixels, const size_t& offset) {
+    cv::Mat bytes;
+
+    if (size.width <= 0 || size.height <= 0 || (depth != CV_8U && depth != CV_16U))
+        return false;
+    if (!MapFile(path, bytes))
+        return false;
+    if (bytes.total() < offset || bytes.total() - offset < (size_t)size.area() * CV_ELEM_SIZE(depth)) {
+        std::cout << path << " is shorter than a " << size.width << "x" << size.height << " frame" << std::endl;
+        return false;
+    }
+
+    pixels = WrapPixels(bytes, offset, size.height, size.width, depth);
+
+    return true;
+}
+
+// Get the layout of raw frames from the DENTALBIOMETRY_RAW_FORMAT environment variable, e.g. 2880x1504x16
+// OUTPUT: size -> size of a frame
+// OUTPUT: depth -> CV_8U or CV_16U
+// OUTPUT: false if the variable is not set or invalid
+bool DicomReader::GetRawFormat(cv::Size& size, int& depth) {
+    const char *format = std::getenv(RAW_FORMAT_VARIABLE);
+    int width, height, bits;
+
+    if (format == 0 || std::sscanf(format, "%dx%dx%d", &width, &height, &bits) != 3
+            || width <= 0 || height <= 0 || (bits != 8 && bits != 16)) {
+        std::cout << "Set " << RAW_FORMAT_VARIABLE << " to <width>x<height>x<8|16> to read raw frames" << std::endl;
+        return false;
+    }
+
+    size = cv::Size(width, height);
+    depth = (bits == 8) ? CV_8U : CV_16U;
+
+    return true;
+}
+
+// Map pixels to 8 bit gray levels through a display window, as the DICOM linear VOI function does.
+// Without a stored window, the range of the pixels is stretched to the gray levels.
+// 8 bit pixels that need no mapping are returned as they are, sharing their data.
+cv::Mat DicomReader::ApplyWindow(const cv::Mat& pixels, const DisplayWindow& window) {
+    double center, width, minimum, maximum, alpha, beta;
+    cv::Mat output;
+
+    if (pixels.depth() == CV_8U && window.width <= 0 && window.slope == 1 && window.intercept == 0 && !window.inverted)
+        return pixels;
+
+    center = window.center;
+    width = window.width;
+    if (width <= 0) {
+        cv::minMaxLoc(pixels, &minimum, &maximum);
+        minimum = minimum * window.slope + window.intercept;
+        maximum = maximum * window.slope + window.intercept;
+        if (minimum > maximum)
+            std::swap(minimum, maximum);
+        width = maximum - minimum + 1;
+        center = (minimum + maximum) / 2 + 0.5;
+    }
+    width = std::max(width, 2.0);
+
+    // Gray level = ((modality value - (center - 0.5)) / (width - 1) + 0.5) * 255, saturated
+    alpha = window.slope * 255 / (width - 1);
+    beta = ((window.intercept - (center - 0.5)) / (width - 1) + 0.5) * 255;
+    if (window.inverted) {
+        alpha = -alpha;
+        beta = 255 - beta;
+    }
+    pixels.convertTo(output, CV_8U, alpha, beta);
+
+    return output;
+}
+
+// Read an image as 8 bit gray levels: DICOM and raw files with this reader, other formats with cv::imread
+// INPUT: path -> path of the file
+// OUTPUT: image -> gray levels. Shares the mapped file when no mapping is needed.
+// OUTPUT: window -> display window of a DICOM file, or the default one
+// OUTPUT: false if the file cannot be read
+bool DicomReader::ReadGrayscale(const std::string& path, cv::Mat& image, DisplayWindow& window) {
+    cv::Mat pixels;
+    cv::Size size;
+    int depth;
+
+    window = DisplayWindow();
+    if (IsDicom(path)) {
+        if (!Read(path, pixels, window))
+            return false;
+    } else if (IsRaw(path)) {
+        if (!GetRawFormat(size, depth) || !ReadRaw(path, size, depth, pixels))
+            return false;
+    } else {
+        image = cv::imread(path, cv::IMREAD_GRAYSCALE);
+        return !image.empty();
+    }
+
+    image = ApplyWindow(pixels, window);
+
+    return true;
+}
+
+// Map a whole file as a row of bytes. The file is unmapped when the last image sharing it is released.
+// Without mmap the file is read instead.
+bool DicomReader::MapFile(const std::string& path, cv::Mat& bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat info;
+    cv::UMatData *u;
+    void *data;
+    int fd;
+
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::perror(path.c_str());
+        return false;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size <= 0 || info.st_size > INT_MAX) {
+        std::cout << "Cannot map " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    // Private pages: writes to the image are copied and never reach the file
+    data = mmap(0, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::perror(path.c_str());
+        return false;
+    }
+    // The whole frame is read right after, so start reading ahead now
+    madvise(data, info.st_size, MADV_WILLNEED);
+
+    u = new cv::UMatData(MappedFiles());
+    u->data = u->origdata = (uchar*)data;
+    u->size = info.st_size;
+    u->refcount = 1;
+    bytes = cv::Mat(1, (int)info.st_size, CV_8U, data);
+    bytes.u = u;
+
+    return true;
+#else
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    std::streamoff size;
+
+    if (!file)
+        return false;
+    size = file.tellg();
+    if (size <= 0 || size > INT_MAX)
+        return false;
+    bytes.create(1, (int)size, CV_8U);
+    file.seekg(0);
+
+    return (bool)file.read((char*)bytes.data, size);
+#endif
+}
+
+// Wrap bytes of a mapped file as an image sharing the mapping
+// INPUT: bytes -> mapped file
+// INPUT: offset -> offset of the first pixel
+// INPUT: rows, cols, type -> layout of the image. Rows are stored without padding.
+// OUTPUT: image keeping the mapping alive
+cv::Mat DicomReader::WrapPixels(const cv::Mat& bytes, const size_t& offset, const int& rows, const int& cols, const int& type) {
+    cv::Mat image(rows, cols, type, bytes.data + offset);
+
+    image.u = bytes.u;
+    CV_XADD(&image.u->refcount, 1);
+
+    return image;
+}
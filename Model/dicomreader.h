@@ -0,0 +1,58 @@
+#ifndef DICOMREADER_H
+#define DICOMREADER_H
+
+#include <cstddef>
+#include <string>
+#include <opencv2/core.hpp>
+
+// Mapping of stored pixel values to display gray levels, from a DICOM header
+struct DisplayWindow {
+    DisplayWindow() : center(0), width(0), slope(1), intercept(0), inverted(false) {}
+    // Center of the window, in modality values
+    double center;
+    // Width of the window, in modality values. 0 = no window stored: the whole range of the pixels is shown.
+    double width;
+    // Modality values are slope * stored value + intercept
+    double slope;
+    double intercept;
+    // Flag for MONOCHROME1 images, where the lowest value is white
+    bool inverted;
+};
+
+// Reader of uncompressed little-endian DICOM files and raw headerless frames.
+// Files are memory-mapped and the pixels are wrapped as a cv::Mat without a copy; the file is
+// unmapped when the last image sharing the pixels is released. Pages are private, so writing
+// to the image never changes the file.
+class DicomReader
+{
+public:
+    // Check if a file starts with the DICOM preamble and prefix
+    static bool IsDicom(const std::string&);
+
+    // Check if a file name is a raw frame (.raw)
+    static bool IsRaw(const std::string&);
+
+    // Read the first frame of a DICOM file as an 8 or 16 bit image, with its display window
+    static bool Read(const std::string&, cv::Mat&, DisplayWindow&);
+
+    // Read a raw frame of a given size and depth (CV_8U or CV_16U), after a header of offset bytes
+    static bool ReadRaw(const std::string&, const cv::Size&, const int&, cv::Mat&, const size_t& = 0);
+
+    // Get the layout of raw frames from the DENTALBIOMETRY_RAW_FORMAT environment variable
+    static bool GetRawFormat(cv::Size&, int&);
+
+    // Map pixels to 8 bit gray levels through a display window
+    static cv::Mat ApplyWindow(const cv::Mat&, const DisplayWindow&);
+
+    // Read an image as 8 bit gray levels: DICOM and raw files with this reader, other formats with cv::imread
+    static bool ReadGrayscale(const std::string&, cv::Mat&, DisplayWindow&);
+
+private:
+    // Map a whole file as a row of bytes
+    static bool MapFile(const std::string&, cv::Mat&);
+
+    // Wrap bytes of a mapped file as an image sharing the mapping
+    static cv::Mat WrapPixels(const cv::Mat&, const size_t&, const int&, const int&, const int&);
+};
+
+#endif // DICOMREADER_H
@@ -1,7 +1,14 @@
 #include <iostream>
 #include <opencv2/imgproc.hpp>
+#include "cpudispatch.h"
 #include "filters.h"
 #include "histogram.h"
+#include "threadpool.h"
+
+namespace {
+// Images below this number of pixels are not worth splitting among OpenCV threads
+const size_t MIN_PIXELS_WITHIN_IMAGE = 2000000;
+}
 
 
 // Apply median filter on input image
@@ -9,8 +16,6 @@ cv::Mat Filters::Median(const cv::Mat& input, const int& kernel_size) {
     std::cout << "Applying median filter with kernel size " << kernel_size << std::endl;
     cv::Mat output;
 
-    input.copyTo(output);
-
     cv::medianBlur(input, output, kernel_size);
 
     return output;
@@ -21,8 +26,6 @@ cv::Mat Filters::Bilateral(const cv::Mat& input, const int& sigmas) {
     std::cout << "Applying bilateral filer with sigma " << sigmas << std::endl;
     cv::Mat output;
 
-    input.copyTo(output);
-
     cv::bilateralFilter(input, output, 0, sigmas, sigmas);
 
     return output;
@@ -119,7 +122,6 @@ cv::Mat Filters::PolygonBinarization(const cv::Mat& input, const cv::Point* pts,
     cv::Mat             mask;
     cv::Mat             masked;
     cv::Point           topleft, botright;
-    std::vector<int>    values;
     std::vector<int>    histogram;
 
     int i, j, thr;
@@ -154,14 +156,11 @@ cv::Mat Filters::PolygonBinarization(const cv::Mat& input, const cv::Point* pts,
     cv::fillConvexPoly(mask, pts, npts, 255);
 
 
-    // Store value of pixels inside polygon
-    for (i = topleft.x; i <= botright.x; i++)
-        for (j = topleft.y; j <= botright.y; j++)
-            if (mask.at<uchar>(cv::Point(i,j)) == 255)
-                values.push_back(input.at<uchar>(cv::Point(i, j)));
-
-    // Get histogram from values
-    histogram = Histogram::GetHistogram(values);
+    // Get histogram of the pixels inside polygon, one row of its bounding box at a time
+    histogram.assign(256, 0);
+    for (j = topleft.y; j <= botright.y; j++)
+        CpuDispatch::get().masked_histogram(input.ptr<uchar>(j) + topleft.x, mask.ptr<uchar>(j) + topleft.x,
+                                            botright.x - topleft.x + 1, histogram.data());
     // Get static threshold from histogram and relative threshold
     thr = Histogram::GetThreshold(histogram, pct_thr);
     std::cout << "Static threshold: " << thr << std::endl;
@@ -242,3 +241,71 @@ cv::Mat Filters::Sobel(const cv::Mat& input, const int& k_size, const int& d_typ
 
     return output;
 }
+
+// Apply median filter on each image of a batch
+std::vector<cv::Mat> Filters::Median(const std::vector<cv::Mat>& inputs, const int& kernel_size, const BatchStrategy& strategy) {
+    int k = kernel_size;
+    return FilterBatch(inputs, [k](const cv::Mat& input) { return Median(input, k); }, strategy);
+}
+
+// Apply bilateral filter on each image of a batch
+std::vector<cv::Mat> Filters::Bilateral(const std::vector<cv::Mat>& inputs, const int& sigmas, const BatchStrategy& strategy) {
+    int sigma = sigmas;
+    return FilterBatch(inputs, [sigma](const cv::Mat& input) { return Bilateral(input, sigma); }, strategy);
+}
+
+// Apply sobel filter on each image of a batch
+std::vector<cv::Mat> Filters::Sobel(const std::vector<cv::Mat>& inputs, const int& k_size, const int& d_type, const BatchStrategy& strategy) {
+    int k = k_size, d = d_type;
+    return FilterBatch(inputs, [k, d](const cv::Mat& input) { return Sobel(input, k, d); }, strategy);
+}
+
+// Choose how to filter a batch.
+// With at least one image per thread, filtering whole images in parallel keeps every thread busy without
+// any splitting overhead. With fewer images, large ones are split among OpenCV threads instead.
+// INPUT: inputs -> images of the batch
+// INPUT: n_threads -> number of threads available
+// OUTPUT: BATCH_ACROSS_IMAGES or BATCH_WITHIN_IMAGES
+Filters::BatchStrategy Filters::ChooseBatchStrategy(const std::vector<cv::Mat>& inputs, const int& n_threads) {
+    size_t pixels = 0;
+    int i;
+
+    if (inputs.empty() || (int)inputs.size() >= n_threads)
+        return BATCH_ACROSS_IMAGES;
+
+    for (i = 0; i < (int)inputs.size(); i++)
+        pixels += inputs.at(i).total();
+
+    return (pixels / inputs.size() >= MIN_PIXELS_WITHIN_IMAGE) ? BATCH_WITHIN_IMAGES : BATCH_ACROSS_IMAGES;
+}
+
+// Apply a filter on each image of a batch.
+// No OpenCV state is changed, so concurrent batches and filters do not affect each other.
+// Across images, each image is filtered by a pool task. When the pool is OpenCV's parallel backend
+// (see ThreadPool::RegisterOpenCVBackend), OpenCV loops inside it run on the pool as well, without new threads.
+// The calling thread filters images as well (see ThreadPool::ParallelFor), so a batch can be run from a pool task.
+// An exception thrown by the filter is rethrown once the other images being filtered are done.
+std::vector<cv::Mat> Filters::FilterBatch(const std::vector<cv::Mat>& inputs, const std::function<cv::Mat(const cv::Mat&)>& filter, BatchStrategy strategy) {
+    std::vector<cv::Mat> outputs;
+    int n_threads, i;
+
+    n_threads = ThreadPool::getInstance()->getNumThreads();
+    if (strategy == BATCH_AUTO)
+        strategy = ChooseBatchStrategy(inputs, n_threads);
+
+    // One image at a time, split among OpenCV threads
+    if (strategy == BATCH_WITHIN_IMAGES) {
+        for (i = 0; i < (int)inputs.size(); i++)
+            outputs.push_back(filter(inputs.at(i)));
+        return outputs;
+    }
+
+    outputs.resize(inputs.size());
+    ThreadPool::getInstance()->ParallelFor(0, (int)inputs.size(), [&inputs, &outputs, &filter](int begin, int end) {
+        int j;
+        for (j = begin; j < end; j++)
+            outputs.at(j) = filter(inputs.at(j));
+    }, (int)inputs.size());
+
+    return outputs;
+}
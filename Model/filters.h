@@ -1,11 +1,20 @@
 #ifndef FILTERS_H
 #define FILTERS_H
 
+#include <functional>
+#include <vector>
 #include <opencv2/core.hpp>
 
 class Filters
 {
 public:
+    // How the images of a batch are filtered in parallel
+    enum BatchStrategy {
+        BATCH_AUTO,             // chosen by ChooseBatchStrategy
+        BATCH_ACROSS_IMAGES,    // one image per pool thread
+        BATCH_WITHIN_IMAGES     // one image at a time, OpenCV threads split each image
+    };
+
     // Apply median filter on input image
     static cv::Mat Median(const cv::Mat&, const int&);
 
@@ -39,9 +48,25 @@ public:
     // Apply sobel filter to input image
     static cv::Mat Sobel(const cv::Mat&, const int& = 3, const int& = 0);
 
+    //// BATCHES ////
+    // Apply median filter on each image of a batch
+    static std::vector<cv::Mat> Median(const std::vector<cv::Mat>&, const int&, const BatchStrategy& = BATCH_AUTO);
+
+    // Apply bilateral filter on each image of a batch
+    static std::vector<cv::Mat> Bilateral(const std::vector<cv::Mat>&, const int&, const BatchStrategy& = BATCH_AUTO);
+
+    // Apply sobel filter on each image of a batch
+    static std::vector<cv::Mat> Sobel(const std::vector<cv::Mat>&, const int& = 3, const int& = 0, const BatchStrategy& = BATCH_AUTO);
+
+    // Choose how to filter a batch on a number of threads
+    static BatchStrategy ChooseBatchStrategy(const std::vector<cv::Mat>&, const int&);
+
 private:
     // Disallow creating an instance of this object
     Filters() {}
+
+    // Apply a filter on each image of a batch
+    static std::vector<cv::Mat> FilterBatch(const std::vector<cv::Mat>&, const std::function<cv::Mat(const cv::Mat&)>&, BatchStrategy);
 };
 
 #endif // FILTERS_H
@@ -1,10 +1,13 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
 #include <iomanip>
 #include <vector>
 #include <opencv2/core.hpp>
+#include "cpudispatch.h"
 #include "helpers.h"
 #include "spline.h"
 
@@ -102,8 +105,8 @@ std::string Helpers::GetCurrentDateTimeAsString() {
 
 // Get standard deviation of a vector of discrete values
 double Helpers::DiscreteStandardDeviation(const std::vector<int> &v) {
-    double mean, std_dev;
-    int n, sum_of_distance, i;
+    double mean, std_dev, sum_of_distance;
+    int n, i;
 
     n = v.size();
     mean = 0;
@@ -125,6 +128,33 @@ double Helpers::DiscreteStandardDeviation(const std::vector<int> &v) {
 
 }
 
+// Get standard deviation of the derivatives of the grayscale profile of a vector of points.
+// Same result as DiscreteStandardDeviation(DeriveVector(GrayscaleProfile(img, p), d)).
+// INPUT: img -> grayscale image
+// INPUT: p -> points to sample
+// INPUT: d -> distance between values to derive
+double Helpers::ProfileDerivativeStandardDeviation(const cv::Mat& img, const std::vector<cv::Point>& p, const int& d) {
+    // Sampled pixels. Reused between calls so the inner loop of neck detection does not allocate.
+    static thread_local std::vector<uchar> profile;
+    int n;
+
+    n = p.size();
+    profile.resize(n);
+    CpuDispatch::get().gather(img.data, img.step, img.dataend - img.data, p.data(), n, profile.data());
+
+    return DerivativeStandardDeviation(profile.data(), n, d);
+}
+
+// Get standard deviation of the derivatives of a profile of pixel values.
+// Same result as DiscreteStandardDeviation(DeriveVector(profile, d)), computed in one pass
+// with 64-bit sums and no intermediate vectors of int, by the kernel of the CPU level (see CpuDispatch).
+// INPUT: profile -> pixel values
+// INPUT: n -> number of values
+// INPUT: d -> distance between values to derive
+double Helpers::DerivativeStandardDeviation(const uchar* profile, const int& n, const int& d) {
+    return CpuDispatch::get().derivative_standard_deviation(profile, n, d);
+}
+
 // Derive the values of a vector.
 // INPUT: v -> Vector to derive.
 // INPUT: d -> distance between values to derive.
@@ -222,25 +252,25 @@ std::vector<int> Helpers::GrayscaleProfile(const cv::Mat &img, cv::Point p1, cv:
 
 // Get the grayscale profile of a vector of points
 std::vector<int> Helpers::GrayscaleProfile(const cv::Mat &img, const std::vector<cv::Point> &p) {
-    std::vector<int> profile;
-    int i;
+    // Sampled pixels. Reused between calls.
+    static thread_local std::vector<uchar> pixels;
 
-    for (i = 0; i < (int)p.size(); i++)
-        profile.push_back(img.at<uchar>(p.at(i)));
+    pixels.resize(p.size());
+    CpuDispatch::get().gather(img.data, img.step, img.dataend - img.data, p.data(), (int)p.size(), pixels.data());
 
-    return profile;
+    return std::vector<int>(pixels.begin(), pixels.end());
 }
 
 // Fit a Spline function line to a group of jaw points
-std::vector<cv::Point> Helpers::FitSpline(const std::vector<cv::Point>& v, const int& min_x, const int& max_x, const int& subsamples) {
+Curve Helpers::FitSpline(const std::vector<cv::Point>& v, const int& min_x, const int& max_x, const int& subsamples) {
     // Loop iterator
     int i;
     // Size of input Vector
     int n;
     // Distance between samples
     int d;
-    // Ouput vector of points
-    std::vector<cv::Point> curve;
+    // Output curve, one row per column in [min_x, max_x)
+    Curve curve(min_x, std::max(0, max_x - min_x));
     // Input vector of x coordinates
     std::vector<double> X;
     // Input vector of y coordinates
@@ -269,24 +299,73 @@ std::vector<cv::Point> Helpers::FitSpline(const std::vector<cv::Point>& v, const
     spline.set_points(X, Y);
 
     for (i = min_x; i < max_x; i++)
-        curve.push_back(cv::Point(i, spline(i)));
+        curve.setY(i - min_x, (int)spline(i));
 
     return curve;
 }
 
 // Get the sum of the pixel's value in a current pixel's neighborhood
 int Helpers::SumOfNeighbors(const cv::Mat& img, const cv::Point& p, const int& k_size) {
+    int half = k_size / 2;
 
-    int sum;
-    int x, y;
+    // Window of (2 * half + 1) x (2 * half + 1) pixels centered at p, without p
+    return CpuDispatch::get().window_sum(img.ptr<uchar>(p.y - half) + p.x - half, img.step, 2 * half + 1)
+            - img.ptr<uchar>(p.y)[p.x];
+}
 
-    sum = img.at<uchar>(p) * -1;
-    for (x = -1 * (k_size / 2); x <= (k_size / 2); x++)
-        for (y = -1 * (k_size / 2); y <= (k_size / 2); y++)
-            sum += img.at<uchar>(
-                        cv::Point(
-                            p.x + x,
-                            p.y + y));
+// Get the index of the first value in a row of pixels equal to or above a threshold.
+// Compares 64 (AVX-512), 32 (AVX2) or 16 (SSE4.2) pixels at a time and stops at the first block with a hit.
+// INPUT: row -> pointer to the first pixel of the row
+// INPUT: n -> number of pixels in the row
+// INPUT: thr -> intensity threshold
+// OUTPUT: index of the first pixel >= thr, or -1 if there is none
+int Helpers::FirstIndexAboveThreshold(const uchar* row, const int& n, const uchar& thr) {
+    return CpuDispatch::get().first_index_above_threshold(row, n, thr);
+}
+
+// Get the brightest pixels of an image above a threshold, spaced by a minimum distance.
+// Pixels are bucketed by intensity, then taken from the brightest bucket down, skipping those
+// too close to a pixel already taken. A bright area gives one pixel instead of a cluster.
+// INPUT: image -> grayscale image
+// INPUT: thr -> intensity threshold
+// INPUT: n -> maximum number of pixels
+// INPUT: min_distance -> minimum distance between two pixels
+// OUTPUT: pixels sorted from brightest to darkest, ties in scan order
+std::vector<cv::Point> Helpers::BrightestPixels(const cv::Mat& image, const uchar& thr, const int& n, const int& min_distance) {
+    std::vector< std::vector<cv::Point> > buckets(256);
+    std::vector<cv::Point> pixels;
+    const uchar *row;
+    cv::Point candidate;
+    int x, y, found, value, i, j, dx, dy;
+    bool spaced;
+
+    // Every pixel above the threshold, found many at a time
+    for (y = 0; y < image.rows; y++) {
+        row = image.ptr<uchar>(y);
+        x = 0;
+        while (x < image.cols) {
+            found = FirstIndexAboveThreshold(row + x, image.cols - x, thr);
+            if (found < 0)
+                break;
+            x += found;
+            buckets.at(row[x]).push_back(cv::Point(x, y));
+            x++;
+        }
+    }
+
+    for (value = 255; value >= thr && (int)pixels.size() < n; value--) {
+        for (i = 0; i < (int)buckets.at(value).size() && (int)pixels.size() < n; i++) {
+            candidate = buckets.at(value).at(i);
+            spaced = true;
+            for (j = 0; j < (int)pixels.size() && spaced; j++) {
+                dx = candidate.x - pixels.at(j).x;
+                dy = candidate.y - pixels.at(j).y;
+                spaced = dx * dx + dy * dy >= min_distance * min_distance;
+            }
+            if (spaced)
+                pixels.push_back(candidate);
+        }
+    }
 
-    return sum;
+    return pixels;
 }
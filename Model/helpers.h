@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <opencv2/core.hpp>
+#include "curve.h"
 
 class Helpers
 {
@@ -28,6 +29,12 @@ public:
     // Get standard deviation of a vector of discrete values
     static double DiscreteStandardDeviation(const std::vector<int>&);
 
+    // Get standard deviation of the derivatives of the grayscale profile of a vector of points
+    static double ProfileDerivativeStandardDeviation(const cv::Mat&, const std::vector<cv::Point>&, const int& = 1);
+
+    // Get standard deviation of the derivatives of a profile of pixel values
+    static double DerivativeStandardDeviation(const uchar*, const int&, const int& = 1);
+
     // Get derivatives vector of an input vector of values
     static std::vector<int> DeriveVector(const std::vector<int>&, const int& = 1);
 
@@ -44,11 +51,17 @@ public:
     static std::vector<int> GrayscaleProfile(const cv::Mat&, const std::vector<cv::Point>&);
 
     // Fit a Spline function line to a group of points
-    static std::vector<cv::Point> FitSpline(const std::vector<cv::Point>&, const int&, const int&, const int& = -1);
+    static Curve FitSpline(const std::vector<cv::Point>&, const int&, const int&, const int& = -1);
 
     // Get the sum of the pixel's value in a current pixel's neighborhood
     static int SumOfNeighbors(const cv::Mat&, const cv::Point&, const int&);
 
+    // Get the index of the first value in a row of pixels equal to or above a threshold
+    static int FirstIndexAboveThreshold(const uchar*, const int&, const uchar&);
+
+    // Get the brightest pixels of an image above a threshold, spaced by a minimum distance
+    static std::vector<cv::Point> BrightestPixels(const cv::Mat&, const uchar&, const int&, const int&);
+
 private:
     // Disallow creating an instance of this object
     Helpers() {}
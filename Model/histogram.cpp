@@ -1,19 +1,21 @@
 #include <iostream>
+#include "cpudispatch.h"
 #include "histogram.h"
 
 // Get histogram of an image
 std::vector<int> Histogram::GetHistogram(cv::Mat& input) {
     std::cout << "Obtaining histogram..." << std::endl;
 
-    std::vector<int> hist;
-    cv::Mat_<uchar>::iterator it = input.begin<uchar>();
+    std::vector<int> hist(256, 0);
     int i;
 
-    for (i = 0; i < 256; i++)
-        hist.push_back(0);
-
-    for (it; it != input.end<uchar>(); ++it)
-        hist[*it]++;
+    // One run over the whole buffer if there are no gaps between rows
+    if (input.isContinuous()) {
+        CpuDispatch::get().histogram(input.data, (int)input.total(), hist.data());
+        return hist;
+    }
+    for (i = 0; i < input.rows; i++)
+        CpuDispatch::get().histogram(input.ptr<uchar>(i), input.cols, hist.data());
 
     return hist;
 }
@@ -0,0 +1,182 @@
+#include "livewire.h"
+#include <algorithm>
+#include <climits>
+
+namespace {
+// Offsets of the 8-neighborhood. Odd directions are diagonal.
+const int NEIGHBOR_DX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int NEIGHBOR_DY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+// Parent value of the seed and of unreached pixels
+const uchar NO_PARENT = 255;
+// Largest step weight: a diagonal step into a pixel of cost 255
+const int MAX_STEP_WEIGHT = (256 * 3) / 2;
+}
+
+// Set the gradient image the cost image is derived from.
+// Bright gradient pixels (edges) are cheap to step into.
+// INPUT: gradient -> 8-bit gradient image (e.g. Sobel output)
+// INPUT: roi -> region of interest where the search is done. Empty means the whole image.
+void LiveWire::SetImage(const cv::Mat& gradient, const cv::Rect& roi) {
+    const uchar *gradient_row;
+    uchar *cost_row;
+    int x, y;
+
+    _roi = roi.area() > 0 ? roi & cv::Rect(0, 0, gradient.cols, gradient.rows) : cv::Rect(0, 0, gradient.cols, gradient.rows);
+
+    _cost.create(_roi.height, _roi.width, CV_8U);
+    for (y = 0; y < _roi.height; y++) {
+        gradient_row = gradient.ptr<uchar>(_roi.y + y) + _roi.x;
+        cost_row = _cost.ptr<uchar>(y);
+        for (x = 0; x < _roi.width; x++)
+            cost_row[x] = 255 - gradient_row[x];
+    }
+
+    _seed = cv::Point(-1, -1);
+    _n_queued = 0;
+}
+
+// Start a new shortest-path tree from a seed pixel.
+// INPUT: seed -> seed pixel in image coordinates
+// OUTPUT: false if the seed is outside the region of interest
+bool LiveWire::SetSeed(const cv::Point& seed) {
+    int i, index;
+
+    if (_cost.empty() || !InRegion(seed))
+        return false;
+
+    _seed = seed;
+    _distance.create(_roi.height, _roi.width, CV_32S);
+    _distance.setTo(cv::Scalar(INT_MAX));
+    _parent.create(_roi.height, _roi.width, CV_8U);
+    _parent.setTo(cv::Scalar(NO_PARENT));
+    _settled = cv::Mat::zeros(_roi.height, _roi.width, CV_8U);
+
+    _buckets.resize(MAX_STEP_WEIGHT + 1);
+    for (i = 0; i < (int)_buckets.size(); i++)
+        _buckets.at(i).clear();
+
+    index = (seed.y - _roi.y) * _roi.width + (seed.x - _roi.x);
+    _distance.ptr<int>()[index] = 0;
+    _buckets.at(0).push_back(index);
+    _current_distance = 0;
+    _n_queued = 1;
+
+    return true;
+}
+
+// Settle up to n pixels of the shortest-path tree, closest ones first.
+// The tree grows outward from the seed, so paths to nearby pixels are available first.
+// INPUT: n -> max pixels to settle. -1 means no limit.
+// OUTPUT: true while there are pixels left to settle
+bool LiveWire::GrowTree(const int& n) {
+    int *distance;
+    uchar *parent, *settled;
+    const uchar *cost;
+    vector<int> *bucket;
+    int n_settled, index, x, y, nx, ny, neighbor, weight, d;
+
+    distance = _distance.ptr<int>();
+    parent = _parent.ptr<uchar>();
+    settled = _settled.ptr<uchar>();
+    cost = _cost.ptr<uchar>();
+    n_settled = 0;
+
+    while (_n_queued > 0 && (n < 0 || n_settled < n)) {
+        bucket = &_buckets.at(_current_distance % _buckets.size());
+        if (bucket->empty()) {
+            _current_distance++;
+            continue;
+        }
+
+        index = bucket->back();
+        bucket->pop_back();
+        _n_queued--;
+
+        // Entries left behind by a later improvement are already settled
+        if (settled[index])
+            continue;
+        settled[index] = 1;
+        n_settled++;
+
+        x = index % _roi.width;
+        y = index / _roi.width;
+        for (d = 0; d < 8; d++) {
+            nx = x + NEIGHBOR_DX[d];
+            ny = y + NEIGHBOR_DY[d];
+            if (nx < 0 || ny < 0 || nx >= _roi.width || ny >= _roi.height)
+                continue;
+
+            neighbor = ny * _roi.width + nx;
+            if (settled[neighbor])
+                continue;
+
+            weight = cost[neighbor] + 1;
+            if (d % 2 == 1)
+                weight = (weight * 3) / 2;
+
+            if (distance[index] + weight < distance[neighbor]) {
+                distance[neighbor] = distance[index] + weight;
+                parent[neighbor] = (uchar)d;
+                _buckets.at(distance[neighbor] % _buckets.size()).push_back(neighbor);
+                _n_queued++;
+            }
+        }
+    }
+
+    return _n_queued > 0;
+}
+
+// Settle every pixel of the region of interest
+void LiveWire::ComputeTree() {
+    GrowTree(-1);
+}
+
+// Check if the shortest path to a pixel is already known
+bool LiveWire::IsSettled(const cv::Point& p) {
+    if (_settled.empty() || !InRegion(p))
+        return false;
+    return _settled.at<uchar>(p.y - _roi.y, p.x - _roi.x) != 0;
+}
+
+// Get the shortest path from the seed to a settled pixel by following the parents back.
+// INPUT: target -> pixel in image coordinates
+// OUTPUT: path from seed to target in image coordinates. Empty if target is not settled.
+vector<cv::Point> LiveWire::GetPath(const cv::Point& target) {
+    vector<cv::Point> path;
+    cv::Point p;
+    uchar d;
+
+    if (!IsSettled(target))
+        return path;
+
+    p = cv::Point(target.x - _roi.x, target.y - _roi.y);
+    while (true) {
+        path.push_back(cv::Point(p.x + _roi.x, p.y + _roi.y));
+        d = _parent.at<uchar>(p.y, p.x);
+        if (d == NO_PARENT)
+            break;
+        p = cv::Point(p.x - NEIGHBOR_DX[d], p.y - NEIGHBOR_DY[d]);
+    }
+    reverse(path.begin(), path.end());
+
+    return path;
+}
+
+// Get the minimal-cost path between two pixels.
+// The tree only grows until the end pixel is settled.
+// OUTPUT: path from start to end in image coordinates. Empty if either pixel is outside the region.
+vector<cv::Point> LiveWire::MinimalPath(const cv::Point& start, const cv::Point& end) {
+    if (!InRegion(end) || !SetSeed(start))
+        return vector<cv::Point>();
+
+    while (!IsSettled(end) && GrowTree(1024))
+        ;
+
+    return GetPath(end);
+}
+
+// Check if a pixel lies inside the region of interest
+bool LiveWire::InRegion(const cv::Point& p) {
+    return p.x >= _roi.x && p.y >= _roi.y
+            && p.x < _roi.x + _roi.width && p.y < _roi.y + _roi.height;
+}
@@ -0,0 +1,76 @@
+#ifndef LIVEWIRE_H
+#define LIVEWIRE_H
+
+#include <iostream>
+#include <vector>
+#include <opencv2/core.hpp>
+
+using namespace std;
+
+class LiveWire
+{
+public:
+    // Empty default constructor
+    LiveWire() : _seed(-1, -1),
+        _current_distance(0),
+        _n_queued(0) {
+    }
+
+    // Set the gradient image the cost image is derived from. The search is restricted to the region of interest.
+    void SetImage(const cv::Mat&, const cv::Rect& = cv::Rect());
+
+    // Start a new shortest-path tree from a seed pixel
+    bool SetSeed(const cv::Point&);
+
+    // Settle up to n pixels of the shortest-path tree
+    bool GrowTree(const int& = -1);
+
+    // Settle every pixel of the region of interest
+    void ComputeTree();
+
+    // Check if the shortest path to a pixel is already known
+    bool IsSettled(const cv::Point&);
+
+    // Get the shortest path from the seed to a settled pixel
+    vector<cv::Point> GetPath(const cv::Point&);
+
+    // Get the minimal-cost path between two pixels
+    vector<cv::Point> MinimalPath(const cv::Point&, const cv::Point&);
+
+    // Get the region of interest
+    cv::Rect getRegion() {
+        return _roi;
+    }
+
+    // Get the seed of the current tree
+    cv::Point getSeed() {
+        return _seed;
+    }
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Cost of stepping into each pixel of the region of interest (low on edges)
+    cv::Mat _cost;
+    // Distance from the seed to each pixel
+    cv::Mat _distance;
+    // Direction from the parent of each pixel, or NO_PARENT
+    cv::Mat _parent;
+    // Flag of pixels whose distance is final
+    cv::Mat _settled;
+    // Region of interest in image coordinates
+    cv::Rect _roi;
+    // Seed of the current tree in image coordinates
+    cv::Point _seed;
+    // Circular bucket queue (Dial) of pixel indices, one bucket per distance modulo its size
+    vector< vector<int> > _buckets;
+    // Distance of the bucket being emptied
+    int _current_distance;
+    // Number of entries in the bucket queue
+    int _n_queued;
+
+    //// METHODS ////
+    // Check if a pixel lies inside the region of interest
+    bool InRegion(const cv::Point&);
+};
+
+#endif // LIVEWIRE_H
@@ -0,0 +1,163 @@
+#include "memorytracker.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+MemoryTracker *MemoryTracker::singleton = 0;
+
+namespace {
+// Innermost scope of each thread
+thread_local std::shared_ptr<MemoryTracker::Scope> current_scope;
+
+// Format bytes as megabytes
+std::string Megabytes(const size_t& bytes) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MB";
+    return text.str();
+}
+}
+
+// Make the tracker the default allocator of cv::Mat
+void MemoryTracker::install() {
+    if (singleton != 0)
+        return;
+    singleton = new MemoryTracker(cv::Mat::getDefaultAllocator());
+    cv::Mat::setDefaultAllocator(singleton);
+}
+
+// Install the tracker if the DENTALBIOMETRY_MEMORY_STATS environment variable is set
+void MemoryTracker::installIfRequested() {
+    if (std::getenv("DENTALBIOMETRY_MEMORY_STATS") != 0)
+        install();
+}
+
+// Get usage of all the buffers allocated since the tracker was installed
+MemoryUsage MemoryTracker::getTotal() {
+    if (singleton == 0)
+        return MemoryUsage();
+    std::lock_guard<std::mutex> lock(singleton->_mutex);
+    return singleton->_total;
+}
+
+// Get usage of a scope
+MemoryUsage MemoryTracker::getUsage(const std::shared_ptr<Scope>& scope) {
+    if (singleton == 0 || !scope)
+        return MemoryUsage();
+    std::lock_guard<std::mutex> lock(singleton->_mutex);
+    return scope->usage;
+}
+
+// Format usage as text
+std::string MemoryTracker::FormatUsage(const MemoryUsage& usage) {
+    std::ostringstream text;
+    text << "peak " << Megabytes(usage.peak_bytes) << ", live " << Megabytes(usage.live_bytes)
+         << ", " << usage.n_allocations << " allocations";
+    return text.str();
+}
+
+// Allocate a buffer with the base allocator and count it for the current scope of this thread.
+// The buffer is marked as ours, so it comes back to deallocate.
+cv::UMatData* MemoryTracker::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                      int flags, cv::UMatUsageFlags usage_flags) const {
+    std::shared_ptr<Scope> scope;
+    cv::UMatData *u;
+
+    u = _base->allocate(dims, sizes, type, data, step, flags, usage_flags);
+    if (u == 0 || (u->flags & cv::UMatData::USER_ALLOCATED))
+        return u;
+    u->currAllocator = this;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    AddBytes(_total, u->size);
+    for (scope = current_scope; scope; scope = scope->parent)
+        AddBytes(scope->usage, u->size);
+    _buffers[u] = std::make_pair(u->size, current_scope);
+
+    return u;
+}
+
+// Allocate device memory of a buffer. Nothing to count.
+bool MemoryTracker::allocate(cv::UMatData* u, int access_flags, cv::UMatUsageFlags usage_flags) const {
+    return _base->allocate(u, access_flags, usage_flags);
+}
+
+// Release a buffer, counting it for the scope it was allocated in, on whichever thread releases it
+void MemoryTracker::deallocate(cv::UMatData* u) const {
+    std::unordered_map< const cv::UMatData*, std::pair< size_t, std::shared_ptr<Scope> > >::iterator it;
+    std::shared_ptr<Scope> scope;
+
+    if (u == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        it = _buffers.find(u);
+        if (it != _buffers.end()) {
+            RemoveBytes(_total, it->second.first);
+            for (scope = it->second.second; scope; scope = scope->parent)
+                RemoveBytes(scope->usage, it->second.first);
+            _buffers.erase(it);
+        }
+    }
+
+    _base->deallocate(u);
+}
+
+// Private constructor
+MemoryTracker::MemoryTracker(cv::MatAllocator* base) : _base(base) {
+}
+
+// Add bytes to usage, updating its peak
+void MemoryTracker::AddBytes(MemoryUsage& usage, const size_t& bytes) {
+    usage.live_bytes += bytes;
+    usage.peak_bytes = std::max(usage.peak_bytes, usage.live_bytes);
+    usage.n_allocations++;
+}
+
+// Remove bytes from usage
+void MemoryTracker::RemoveBytes(MemoryUsage& usage, const size_t& bytes) {
+    usage.live_bytes -= bytes;
+    usage.n_deallocations++;
+}
+
+
+// Open a scope nested in the current scope of this thread
+MemoryScope::MemoryScope(const std::string& name) : _print(true) {
+    if (!MemoryTracker::isInstalled())
+        return;
+    _scope = std::make_shared<MemoryTracker::Scope>();
+    _scope->name = current_scope ? current_scope->name + "/" + name : name;
+    _scope->parent = current_scope;
+    _previous = current_scope;
+    current_scope = _scope;
+}
+
+// Continue a scope of another thread in this thread
+MemoryScope::MemoryScope(const std::shared_ptr<MemoryTracker::Scope>& scope) : _print(false) {
+    if (!MemoryTracker::isInstalled() || !scope)
+        return;
+    _scope = scope;
+    _previous = current_scope;
+    current_scope = _scope;
+}
+
+// Close the scope and print its usage
+MemoryScope::~MemoryScope() {
+    if (!_scope)
+        return;
+    current_scope = _previous;
+    if (_print)
+        std::cout << "Memory of " << _scope->name << ": " << MemoryTracker::FormatUsage(getUsage()) << std::endl;
+}
+
+// Get the current scope of this thread
+std::shared_ptr<MemoryTracker::Scope> MemoryScope::Current() {
+    return current_scope;
+}
+
+// Get usage of the scope so far
+MemoryUsage MemoryScope::getUsage() const {
+    return MemoryTracker::getUsage(_scope);
+}
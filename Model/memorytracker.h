@@ -0,0 +1,124 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <opencv2/core.hpp>
+
+// Memory used by the image buffers of a scope
+struct MemoryUsage {
+    MemoryUsage() : live_bytes(0), peak_bytes(0), n_allocations(0), n_deallocations(0) {}
+    // Bytes allocated in the scope and not released yet
+    size_t live_bytes;
+    // Max of live_bytes
+    size_t peak_bytes;
+    // Number of buffers allocated in the scope
+    size_t n_allocations;
+    // Number of those buffers released
+    size_t n_deallocations;
+};
+
+// cv::Mat allocator that counts the bytes of image buffers, in total and per scope (see MemoryScope),
+// so the memory cost of a study and of each of its stages can be measured.
+// Buffers are allocated by the allocator that was the default one when the tracker was installed.
+class MemoryTracker : public cv::MatAllocator
+{
+public:
+    // Counters of a scope. Kept alive by the buffers allocated in it, so late releases are counted too.
+    struct Scope {
+        // Path of the scope, e.g. "image.png/segmentation"
+        std::string name;
+        MemoryUsage usage;
+        // Enclosing scope. Allocations count for every enclosing scope too.
+        std::shared_ptr<Scope> parent;
+    };
+
+    // Make the tracker the default allocator of cv::Mat. Call before any thread allocates images.
+    // Buffers allocated before are not counted.
+    static void install();
+
+    // Install the tracker if the DENTALBIOMETRY_MEMORY_STATS environment variable is set
+    static void installIfRequested();
+
+    // Check if the tracker is installed
+    static bool isInstalled() {
+        return singleton != 0;
+    }
+
+    // Get usage of all the buffers allocated since the tracker was installed
+    static MemoryUsage getTotal();
+
+    // Get usage of a scope
+    static MemoryUsage getUsage(const std::shared_ptr<Scope>&);
+
+    // Format usage as text, e.g. "peak 12.5 MB, live 3.1 MB, 14 allocations"
+    static std::string FormatUsage(const MemoryUsage&);
+
+    //// cv::MatAllocator ////
+    cv::UMatData* allocate(int, const int*, int, void*, size_t*, int, cv::UMatUsageFlags) const;
+    bool allocate(cv::UMatData*, int, cv::UMatUsageFlags) const;
+    void deallocate(cv::UMatData*) const;
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Pointer to singleton. Never deleted, since buffers may outlive any owner.
+    static MemoryTracker *singleton;
+    // Allocator buffers are allocated with
+    cv::MatAllocator *_base;
+    // Guards the counters and _buffers
+    mutable std::mutex _mutex;
+    // Usage of all the buffers
+    mutable MemoryUsage _total;
+    // Size and innermost scope of each live buffer
+    mutable std::unordered_map< const cv::UMatData*, std::pair< size_t, std::shared_ptr<Scope> > > _buffers;
+
+    //// METHODS ////
+    // Private constructor
+    MemoryTracker(cv::MatAllocator*);
+
+    // Add bytes to usage, updating its peak
+    static void AddBytes(MemoryUsage&, const size_t&);
+
+    // Remove bytes from usage
+    static void RemoveBytes(MemoryUsage&, const size_t&);
+};
+
+// Scope whose image buffers are counted apart, e.g. a study or a stage of it.
+// Scopes nest per thread: a buffer counts for the innermost scope of the allocating thread and its parents.
+// Does nothing if the tracker was not installed when the scope opened.
+class MemoryScope
+{
+public:
+    // Open a scope nested in the current scope of this thread. Its usage is printed when it closes.
+    explicit MemoryScope(const std::string&);
+
+    // Continue a scope of another thread in this thread, e.g. in a task submitted from it. Prints nothing.
+    explicit MemoryScope(const std::shared_ptr<MemoryTracker::Scope>&);
+
+    // Close the scope
+    ~MemoryScope();
+
+    // Get the current scope of this thread, to continue it in another thread. Null if there is none.
+    static std::shared_ptr<MemoryTracker::Scope> Current();
+
+    // Get usage of the scope so far
+    MemoryUsage getUsage() const;
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Counters of this scope
+    std::shared_ptr<MemoryTracker::Scope> _scope;
+    // Current scope of the thread before this one
+    std::shared_ptr<MemoryTracker::Scope> _previous;
+    // Flag to print usage when the scope closes
+    bool _print;
+
+    // Disallow copies: scopes close in reverse order of opening
+    MemoryScope(const MemoryScope&);
+    MemoryScope& operator=(const MemoryScope&);
+};
+
+#endif // MEMORYTRACKER_H
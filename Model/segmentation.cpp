@@ -1,45 +1,245 @@
 #include "segmentation.h"
-#include "filters.h"
 #include "helpers.h"
+#include "histogram.h"
+#include "memorytracker.h"
+#include "threadpool.h"
 #include "visualizationhelpers.h"
 #include <opencv2/opencv.hpp>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+namespace {
+// Rows of the crown bands on the inner side of the crown curves (towards the other jaw)
+const int BAND_INNER_ROWS = 30;
+// Rows of the crown bands on the outer side of the crown curves (towards the necks).
+// Also the max translation of the crown curves when looking for the necks.
+const int BAND_OUTER_ROWS = 150;
+// Translation of the crown curves at each step of the necks search
+const int NECK_TRANSLATION_STEP = 5;
+// Columns skipped at each side of the crown curves by the binarization
+const int SEGMENT_MARGIN = 10;
+// Pyramid levels are not built below this height
+const int MIN_PYRAMID_ROWS = 128;
+// Names of the stages in memory statistics
+const char *STAGE_NAMES[] = { "input", "pyramid", "crown points", "crown curves", "crown bands", "necks curves",
+                              "crown binarization" };
+
+// Scale a full resolution pixel constant to a pyramid level, so the coarse stages cover the same anatomy.
+// At least 1 pixel.
+int LevelPixels(const int& pixels, const int& scale) {
+    return max(1, (int)round((double)pixels / scale));
+}
+
+// Hash the pixels of an image, 8 bytes at a time (FNV-1a on words).
+// Much cheaper than the stages it guards, and catches pixels changed in place under the same data pointer.
+uint64_t HashPixels(const cv::Mat& img) {
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t hash = 14695981039346656037ULL, word;
+    size_t row_bytes = img.cols * img.elemSize(), i;
+    const uchar *row;
+    int y;
+
+    for (y = 0; y < img.rows; y++) {
+        row = img.ptr<uchar>(y);
+        for (i = 0; i + sizeof(word) <= row_bytes; i += sizeof(word)) {
+            memcpy(&word, row + i, sizeof(word));
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < row_bytes; i++)
+            hash = (hash ^ row[i]) * prime;
+    }
 
+    return hash;
+}
+}
 
-// Run algorithm
+
+// Run algorithm.
+// Each stage caches its output and is only recomputed when its upstream output or its parameters changed,
+// so changing a late-stage parameter does not rerun the early stages.
 cv::Mat Segmentation::Process(const cv::Mat& input) {
     cout << "Running Segmentation..." << endl;
-    _image = input.clone();
-    _display_image = cv::Mat::zeros(input.cols, input.rows, CV_8UC3);
-    // Convert from grayscale to RGB for drawing purposes
-    cv::cvtColor(input, _display_image, CV_GRAY2RGB, 3);
-
-    // Define upper and lower crown points in image
-    DefineCrownPoints(_lineprofile_column_spacing, _lineprofile_derivative_distance);
-    // Remove crown points too far from avg row to be valid
-    RemoveAfarCrownPoints();
+    MemoryScope memory_scope("segmentation");
+    vector<double> parameters;
+    uint64_t input_hash;
+
+    // A different image is a new version of the input stage. The pixels are hashed too,
+    // since callers may change them in place and pass the same buffer again.
+    input_hash = HashPixels(input);
+    if (_stages[STAGE_INPUT].version == 0 || input.data != _image.data
+            || input.rows != _image.rows || input.cols != _image.cols || input_hash != _input_hash) {
+        MemoryScope stage_scope(STAGE_NAMES[STAGE_INPUT]);
+        _image = input;
+        _input_hash = input_hash;
+        _display_image = cv::Mat::zeros(input.cols, input.rows, CV_8UC3);
+        // Convert from grayscale to RGB for drawing purposes
+        cv::cvtColor(input, _display_image, CV_GRAY2RGB, 3);
+        MarkStageComputed(STAGE_INPUT, parameters);
+    }
+
+    parameters = { (double)_pyramid_levels };
+    if (StageIsDirty(STAGE_PYRAMID, parameters)) {
+        MemoryScope stage_scope(STAGE_NAMES[STAGE_PYRAMID]);
+        // Downsample the image for the coarse stages
+        BuildPyramid(_pyramid_levels);
+        MarkStageComputed(STAGE_PYRAMID, parameters);
+    }
+
+    parameters = { (double)_lineprofile_column_spacing, (double)_lineprofile_derivative_distance };
+    if (StageIsDirty(STAGE_CROWN_POINTS, parameters)) {
+        MemoryScope stage_scope(STAGE_NAMES[STAGE_CROWN_POINTS]);
+        // Define upper and lower crown points in the coarse image
+        DefineCrownPoints(LevelPixels(_lineprofile_column_spacing, _pyramid_scale),
+                          LevelPixels(_lineprofile_derivative_distance, _pyramid_scale));
+        // Remove crown points too far from avg row to be valid
+        RemoveAfarCrownPoints();
+        MarkStageComputed(STAGE_CROWN_POINTS, parameters);
+    }
     // Visualize crown points
 //    _display_image = VisualizationHelpers::DrawXAtPoints(_display_image, _crowns.first, cv::Vec3b(0, 0, 255));
 //    _display_image = VisualizationHelpers::DrawXAtPoints(_display_image, _crowns.second, cv::Vec3b(255, 0, 0));
 
-    // Adjust Spline curve to crown points
-    AdjustCrownsCurve(_spline_pct_sample_size);
+    parameters = { (double)_spline_pct_sample_size };
+    if (StageIsDirty(STAGE_CROWN_CURVES, parameters)) {
+        MemoryScope stage_scope(STAGE_NAMES[STAGE_CROWN_CURVES]);
+        // Adjust Spline curve to crown points
+        AdjustCrownsCurve(_spline_pct_sample_size);
+        // Refine the curves at full resolution
+        if (_pyramid_scale > 1)
+            RefineCrownsCurve(_lineprofile_column_spacing, _lineprofile_derivative_distance, _spline_pct_sample_size);
+        else
+            _crown_curves = _coarse_crown_curves;
+        MarkStageComputed(STAGE_CROWN_CURVES, parameters);
+    }
     // Visualize crown curves
-//    _display_image = VisualizationHelpers::DrawVector(_display_image, _crown_curves.first, cv::Vec3b(0, 225, 225));
-//    _display_image = VisualizationHelpers::DrawVector(_display_image, _crown_curves.second, cv::Vec3b(0, 225, 225));
+//    _display_image = VisualizationHelpers::DrawVector(_display_image, _crown_curves.first.ToPoints(), cv::Vec3b(0, 225, 225));
+//    _display_image = VisualizationHelpers::DrawVector(_display_image, _crown_curves.second.ToPoints(), cv::Vec3b(0, 225, 225));
+
+    parameters.clear();
+    if (StageIsDirty(STAGE_CROWN_BANDS, parameters)) {
+        MemoryScope stage_scope(STAGE_NAMES[STAGE_CROWN_BANDS]);
+        // Straighten the image along the crown curves
+        BuildCrownBands(_image, _crown_curves, 1, _crown_bands);
+        if (_pyramid_scale > 1)
+            BuildCrownBands(_coarse_image, _coarse_crown_curves, _pyramid_scale, _coarse_crown_bands);
+        MarkStageComputed(STAGE_CROWN_BANDS, parameters);
+    }
 
-    // Translate crown curves to find necks curve
-    AdjustNecksCurve(_neck_sd_threshold);
+    parameters = { (double)_neck_sd_threshold };
+    if (StageIsDirty(STAGE_NECKS_CURVES, parameters)) {
+        MemoryScope stage_scope(STAGE_NAMES[STAGE_NECKS_CURVES]);
+        // Translate crown curves to find necks curve
+        AdjustNecksCurve(_neck_sd_threshold);
+        MarkStageComputed(STAGE_NECKS_CURVES, parameters);
+    }
     // Visualize necks curves
-//    _display_image = VisualizationHelpers::DrawVector(_display_image, _necks_curves.first, cv::Vec3b(225, 0, 225));
-//    _display_image = VisualizationHelpers::DrawVector(_display_image, _necks_curves.second, cv::Vec3b(225, 0, 225));
-
-    // Binarize crowns to more easily find the gaps between teeth
-    BinarizeCrowns(_crown_binarization_n_segments, _crown_binarization_pct_threshold);
+//    _display_image = VisualizationHelpers::DrawVector(_display_image, _necks_curves.first.ToPoints(), cv::Vec3b(225, 0, 225));
+//    _display_image = VisualizationHelpers::DrawVector(_display_image, _necks_curves.second.ToPoints(), cv::Vec3b(225, 0, 225));
+
+    parameters = { (double)_crown_binarization_n_segments, (double)_crown_binarization_pct_threshold };
+    if (StageIsDirty(STAGE_CROWN_BINARIZATION, parameters)) {
+        MemoryScope stage_scope(STAGE_NAMES[STAGE_CROWN_BINARIZATION]);
+        // Binarize crowns to more easily find the gaps between teeth
+        BinarizeCrowns(_crown_binarization_n_segments, _crown_binarization_pct_threshold);
+        MarkStageComputed(STAGE_CROWN_BINARIZATION, parameters);
+    }
 
     // Adjust
 //    ShowDisplayImage();
 
-    return _image;
+    return _binarized_image;
+}
+
+// Check if a stage must be recomputed.
+// A stage is dirty when it never ran, when its upstream stage produced a new output since,
+// or when it ran with different parameters.
+bool Segmentation::StageIsDirty(const Stage& stage, const vector<double>& parameters) {
+    const StageCache& cache = _stages[stage];
+
+    return cache.version == 0
+            || cache.upstream_version != _stages[stage - 1].version
+            || cache.parameters != parameters;
+}
+
+// Record that a stage was recomputed from the current upstream output with the given parameters
+void Segmentation::MarkStageComputed(const Stage& stage, const vector<double>& parameters) {
+    StageCache& cache = _stages[stage];
+
+    cache.upstream_version = (stage == STAGE_INPUT) ? 0 : _stages[stage - 1].version;
+    cache.parameters = parameters;
+    cache.version = ++_last_version;
+}
+
+// Downsample the input image for the coarse stages.
+// Levels are not built below MIN_PYRAMID_ROWS rows.
+// INPUT: levels -> number of times the image is halved. 0 works at full resolution.
+void Segmentation::BuildPyramid(const int& levels) {
+    cv::Mat next;
+    int i;
+
+    _coarse_image = _image;
+    _pyramid_scale = 1;
+    for (i = 0; i < levels && _coarse_image.rows / 2 >= MIN_PYRAMID_ROWS; i++) {
+        cv::pyrDown(_coarse_image, next);
+        _coarse_image = next;
+        _pyramid_scale *= 2;
+    }
+}
+
+// Upsample a coarse curve to the columns of the input image, interpolating linearly between coarse columns
+Curve Segmentation::UpsampleCurve(const Curve& coarse) {
+    Curve curve(0, _image.cols);
+    double xc, y;
+    int x, x0, x1;
+
+    if (coarse.empty())
+        return curve;
+
+    for (x = 0; x < _image.cols; x++) {
+        // Column of the coarse curve at the center of full resolution column x
+        xc = min((double)coarse.size() - 1, max(0.0, (x + 0.5) / _pyramid_scale - 0.5));
+        x0 = (int)xc;
+        x1 = min(coarse.size() - 1, x0 + 1);
+        y = coarse.y(x0) + (coarse.y(x1) - coarse.y(x0)) * (xc - x0);
+        curve.setY(x, (int)round((y + 0.5) * _pyramid_scale - 0.5));
+    }
+    curve.Clamp(0, _image.rows - 1);
+
+    return curve;
+}
+
+// Search crown points at full resolution near a curve.
+// At every column_spacing column, the row of the min (or max) derivative within window rows of the curve is a point.
+// INPUT: curve -> upsampled coarse curve
+// INPUT: column_spacing -> column spacing between points
+// INPUT: dd -> derivative distance
+// INPUT: window -> rows searched at each side of the curve
+// INPUT: minimum -> true to keep the min derivative (upper crowns), false for the max (lower crowns)
+// OUTPUT: crown points
+vector<cv::Point> Segmentation::RefineCurvePoints(const Curve& curve, const int& column_spacing, const int& dd,
+                                                  const int& window, const bool& minimum) {
+    vector<cv::Point> points;
+    int col, row, first_row, last_row, best_row, derivative, best_derivative;
+
+    for (col = 0; col < curve.size(); col += column_spacing) {
+        first_row = max(dd, curve.y(col) - window);
+        last_row = min(_image.rows - 1, curve.y(col) + window);
+        best_row = curve.y(col);
+        best_derivative = minimum ? INT_MAX : INT_MIN;
+
+        for (row = first_row; row <= last_row; row++) {
+            derivative = _image.ptr<uchar>(row)[col] - _image.ptr<uchar>(row - dd)[col];
+            if (minimum ? derivative < best_derivative : derivative > best_derivative) {
+                best_derivative = derivative;
+                best_row = row;
+            }
+        }
+
+        points.push_back(cv::Point(col, best_row));
+    }
+
+    return points;
 }
 
 // Obtain vertical line profiles of image
@@ -67,11 +267,13 @@ vector< pair< int, vector<int> > > Segmentation::DerivativeLineProfiles(const cv
 // Define upper and lower crown points
 void Segmentation::DefineCrownPoints(const int& column_spacing, const int& derivative_difference) {
     cout << "Defining Jaw Points... " << endl;
+    _crowns.first.clear();
+    _crowns.second.clear();
 
     // Obtain derivatives of the vertical line profiles of _image
     vector< pair< int, vector<int> > > line_profiles;
     line_profiles = DerivativeLineProfiles(
-                _image,
+                _coarse_image,
                 column_spacing,
                 derivative_difference);
 
@@ -170,166 +372,230 @@ void Segmentation::AdjustCrownsCurve(const float& pct_sample_size) {
     upper_curve_subsample_size = (int)_crowns.first.size() * pct_sample_size;
     lower_curve_subsample_size = (int)_crowns.second.size() * pct_sample_size;
 
-    _crown_curves.first = Helpers::FitSpline(_crowns.first, 0, _image.cols, upper_curve_subsample_size);
-    _crown_curves.second = Helpers::FitSpline(_crowns.second, 0, _image.cols, lower_curve_subsample_size);
+    _coarse_crown_curves.first = Helpers::FitSpline(_crowns.first, 0, _coarse_image.cols, upper_curve_subsample_size);
+    _coarse_crown_curves.second = Helpers::FitSpline(_crowns.second, 0, _coarse_image.cols, lower_curve_subsample_size);
+
+    // Keep the curves inside the image where the Spline overshoots
+    _coarse_crown_curves.first.Clamp(0, _coarse_image.rows - 1);
+    _coarse_crown_curves.second.Clamp(0, _coarse_image.rows - 1);
 }
 
-// Translate crowns curve to find teeth's neck
-void Segmentation::AdjustNecksCurve(const float& sd_thr) {
+// Refine the coarse crown curves at full resolution.
+// Crown points are searched again only within a few rows of the upsampled coarse curves.
+// INPUT: column_spacing -> column spacing between crown points at full resolution
+// INPUT: derivative_difference -> derivative distance at full resolution
+// INPUT: pct_sample_size -> sample size of crown points for adjusting Spline curve
+void Segmentation::RefineCrownsCurve(const int& column_spacing, const int& derivative_difference, const float& pct_sample_size) {
+    pair< vector<cv::Point>, vector<cv::Point> > points;
+    int window;
+
+    // A coarse row covers _pyramid_scale rows. Search one coarse row above and below.
+    window = 2 * _pyramid_scale;
+
+    points.first = RefineCurvePoints(UpsampleCurve(_coarse_crown_curves.first),
+                                     column_spacing, derivative_difference, window, true);
+    points.second = RefineCurvePoints(UpsampleCurve(_coarse_crown_curves.second),
+                                      column_spacing, derivative_difference, window, false);
+
+    _crown_curves.first = Helpers::FitSpline(points.first, 0, _image.cols, (int)points.first.size() * pct_sample_size);
+    _crown_curves.second = Helpers::FitSpline(points.second, 0, _image.cols, (int)points.second.size() * pct_sample_size);
+
+    // Keep the curves inside the image where the Spline overshoots
+    _crown_curves.first.Clamp(0, _image.rows - 1);
+    _crown_curves.second.Clamp(0, _image.rows - 1);
+}
 
-    // Get standard deviation of the derivatives of pixel values at initial position (crown curves) of upper and lower jaw
-    pair<double, double> initial_stddev;
-
-    initial_stddev.first = Helpers::DiscreteStandardDeviation(
-                Helpers::DeriveVector(
-                    Helpers::GrayscaleProfile(_image, _crown_curves.first)));
-    initial_stddev.second = Helpers::DiscreteStandardDeviation(
-                Helpers::DeriveVector(
-                    Helpers::GrayscaleProfile(_image, _crown_curves.second)));
-
-    // Translate upper curve upwards until the new standard deviation is lower than the sd_thr of the initial standard deviaiton
-    int i, j;
-    int max_translation =  150; // in pixels
-    int ppt = 5; // pixels per translation
-    pair< vector<cv::Point>, vector<cv::Point> > current_curves; // current curves at each translation
-    pair<double, double> current_stddev; // standard deviaion of the derivatives of pixel values at current curves
-
-    // Upper Jaw
-    current_curves.first = _crown_curves.first;
-    for (i = 0; i < max_translation; i += ppt) {
-
-        // Translate upper curve upwards
-        for (j = 0; j < (int)current_curves.first.size(); j++) {
-            // Make sure curve stays in bounds
-            if (current_curves.first.at(j).y - ppt >= 0)
-                current_curves.first.at(j).y -= ppt;
-            else
-                current_curves.first.at(j).y = 0;
+// Resample the image along each crown curve into a straightened band.
+// Row r of a band holds the pixels r - inner rows away from the crown curve, away from the other jaw.
+// Column x holds the pixels of image column x. Rows outside the image are clamped to the border.
+// INPUT: img -> image the curves are in
+// INPUT: curves -> crown curves <upper crowns curve, lower crowns curve>
+// INPUT: scale -> scale of _image relative to img
+// OUTPUT: bands -> crown bands <upper crowns band, lower crowns band>
+void Segmentation::BuildCrownBands(const cv::Mat& img, const pair<Curve, Curve>& curves, const int& scale,
+                                   pair<cv::Mat, cv::Mat>& bands) {
+    int inner_rows, outer_rows;
+
+    inner_rows = LevelPixels(BAND_INNER_ROWS, scale);
+    outer_rows = LevelPixels(BAND_OUTER_ROWS, scale);
+    bands.first.create(inner_rows + outer_rows + 1, img.cols, CV_8U);
+    bands.second.create(inner_rows + outer_rows + 1, img.cols, CV_8U);
+
+    // Rows are independent, so they are built in tiles on the shared pool
+    ThreadPool::getInstance()->ParallelFor(0, bands.first.rows, [&img, &curves, &bands, inner_rows](int begin, int end) {
+        Curve upper, lower;
+        int r, offset;
+
+        for (r = begin; r < end; r++) {
+            offset = r - inner_rows;
+
+            // Upper jaw bands go upwards
+            upper = curves.first;
+            upper.Translate(-offset, 0, img.rows - 1);
+            upper.Gather(img, bands.first.ptr<uchar>(r));
+
+            // Lower jaw bands go downwards
+            lower = curves.second;
+            lower.Translate(offset, 0, img.rows - 1);
+            lower.Gather(img, bands.second.ptr<uchar>(r));
         }
+    });
+}
 
-        // Get current standard deviation
-        current_stddev.first = Helpers::DiscreteStandardDeviation(
-                    Helpers::DeriveVector(
-                        Helpers::GrayscaleProfile(_image, current_curves.first)));
-
-        // Finish translating if current std dev is below sd_thr
-        if (current_stddev.first < initial_stddev.first * sd_thr)
-            break;
+// Translate crowns curve to find teeth's neck.
+// Each translation of a crown curve is a row of its crown band.
+// In pyramid mode the translation is found on the coarse bands and refined within one coarse step at full resolution.
+void Segmentation::AdjustNecksCurve(const float& sd_thr) {
+    const pair<cv::Mat, cv::Mat>& coarse_bands = (_pyramid_scale > 1) ? _coarse_crown_bands : _crown_bands;
+    pair<int, int> translation; // translation of the curves <upper jaw, lower jaw>
+    int inner_rows, max_translation, ppt;
+
+    // Translate upper curve upwards and lower curve downwards until the new standard deviation is lower than
+    // the sd_thr of the initial standard deviaiton
+    inner_rows = LevelPixels(BAND_INNER_ROWS, _pyramid_scale);
+    max_translation = LevelPixels(BAND_OUTER_ROWS, _pyramid_scale); // in pixels
+    ppt = LevelPixels(NECK_TRANSLATION_STEP, _pyramid_scale); // pixels per translation
+
+    translation.first = NeckTranslation(coarse_bands.first, inner_rows, sd_thr, ppt, max_translation, ppt);
+    translation.second = NeckTranslation(coarse_bands.second, inner_rows, sd_thr, ppt, max_translation, ppt);
+
+    // Refine at full resolution between the previous coarse step and the one found
+    if (_pyramid_scale > 1) {
+        inner_rows = BAND_INNER_ROWS;
+        max_translation = BAND_OUTER_ROWS;
+
+        translation.first = NeckTranslation(_crown_bands.first, inner_rows, sd_thr,
+                                            max(1, (translation.first - ppt) * _pyramid_scale + 1),
+                                            min(max_translation, translation.first * _pyramid_scale), 1);
+        translation.second = NeckTranslation(_crown_bands.second, inner_rows, sd_thr,
+                                             max(1, (translation.second - ppt) * _pyramid_scale + 1),
+                                             min(max_translation, translation.second * _pyramid_scale), 1);
     }
-    _necks_curves.first = current_curves.first;
-
-    // Lower Jaw
-    current_curves.second = _crown_curves.second;
-    for (i = 0; i < max_translation; i+= ppt) {
-
-        // Translate lower curve downwards
-        for (j = 0; j < (int)current_curves.second.size(); j++) {
-            // Make sure curve stays in bounds
-            if (current_curves.second.at(j).y + ppt < _image.rows)
-                current_curves.second.at(j).y += ppt;
-            else
-                current_curves.second.at(j).y = _image.rows - 1;
-        }
 
+    // Make sure curves stay in bounds
+    _necks_curves.first = _crown_curves.first;
+    _necks_curves.first.Translate(-translation.first, 0, _image.rows - 1);
+    _necks_curves.second = _crown_curves.second;
+    _necks_curves.second.Translate(translation.second, 0, _image.rows - 1);
+}
+
+// Find the first translation of a crown curve where the standard deviation of the derivatives of the pixel values
+// is lower than sd_thr of the one at the crown curve.
+// INPUT: band -> crown band
+// INPUT: inner_rows -> row of the crown curve in the band
+// INPUT: sd_thr -> standard deviation threshold
+// INPUT: first, last, step -> translations to try
+// OUTPUT: first translation below the threshold, or last if there is none
+int Segmentation::NeckTranslation(const cv::Mat& band, const int& inner_rows, const float& sd_thr,
+                                  const int& first, const int& last, const int& step) {
+    double initial_stddev, current_stddev;
+    int t;
+
+    initial_stddev = Helpers::DerivativeStandardDeviation(band.ptr<uchar>(inner_rows), band.cols);
+
+    for (t = first; t <= last; t += step) {
         // Get current standard deviation
-        current_stddev.second = Helpers::DiscreteStandardDeviation(
-                    Helpers::DeriveVector(
-                        Helpers::GrayscaleProfile(_image, current_curves.second)));
+        current_stddev = Helpers::DerivativeStandardDeviation(band.ptr<uchar>(inner_rows + t), band.cols);
 
         // Finish translating if current std dev is below sd_thr
-        if (current_stddev.second < initial_stddev.second * sd_thr)
-            break;
+        if (current_stddev < initial_stddev * sd_thr)
+            return t;
     }
-    _necks_curves.second = current_curves.second;
+
+    return last;
 }
 
 // Binarize crowns to more easily find the gaps between teeth
 void Segmentation::BinarizeCrowns(const int& n_segments, const float& pct_thr) {
     // Segment the space between the crowns curve and the necks curve in equal n_segments.
-    // Binarize each segment.
+    // Binarize each segment on the crown bands, where a segment is a rectangle.
 
-    // Distance of points at each side of current iteration point to use for the slope calculation.
-    float slope_half_distance = 10;
+    // Columns skipped at each side of the curves
+    int margin = SEGMENT_MARGIN;
+    // Rows of the crown bands at each side of the curves
+    int inner_rows = BAND_INNER_ROWS;
+    int outer_rows = BAND_OUTER_ROWS;
 
     // Length of each segment <upper jaw, lower jaw>.
     pair<int, int> segment_length;
-    // The segment lenght is the length of the curve minus the full slope distance divided by n_segments.
-    segment_length.first = ( (int)_crown_curves.first.size() - (slope_half_distance * 2) ) / n_segments;
-    segment_length.second = ( (int)_crown_curves.second.size() - (slope_half_distance * 2) ) / n_segments;
+    // The segment lenght is the length of the curve minus the margins divided by n_segments.
+    segment_length.first = ( _crown_curves.first.size() - (margin * 2) ) / n_segments;
+    segment_length.second = ( _crown_curves.second.size() - (margin * 2) ) / n_segments;
 
     // Maximum height of each segment <upper jaw, lower jaw>
     pair<int, int> max_segment_height;
-    // The maximum segment height is the 80% of the difference between crown and neck curves
-    max_segment_height.first = abs(_crown_curves.first.at(0).y - _necks_curves.first.at(0).y) * 0.7;
-    max_segment_height.second = abs(_crown_curves.second.at(0).y - _necks_curves.second.at(0).y) * 0.7;
-
-    float       slope; // Slope at iteration point.
-    bool        in_bounds; // Flag to determine if point is still inside the image.
-    cv::Point   cvp; // Current point in vertical scan.
-    cv::Point   upper_polygon[4]; // Points of the polygon of each upper jaw segment.
-    cv::Point   lower_polygon[4]; // Points of the polygon of each lower jaw segment.
-    int         n, i, j;
-
-    for (n = 1; n < n_segments; n++) {
-        // Upper Jaw
-        i = (n * segment_length.first) + slope_half_distance; // element position of current segment in crowns curve
-        in_bounds = true;
-        slope = Helpers::GetSlope(
-                    _crown_curves.first.at(i - slope_half_distance),
-                    _crown_curves.first.at(i + slope_half_distance));
-        // Iterate upwards
-        j = 0;
-        do {
-            j++;
-            cvp = cv::Point(
-                        _crown_curves.first.at(i).x + (j * slope),
-                        _crown_curves.first.at(i).y - j);
-            // Make sure vertical scan stays in bounds
-            if (cvp.x < 5 || cvp.x > _image.cols - 5 || cvp.y < 5)
-                in_bounds = false;
-        } while (j < max_segment_height.first && in_bounds);
-
-        if (n > 1) {
-            upper_polygon[0] = upper_polygon[1];
-            upper_polygon[3] = upper_polygon[2];
-        }
-        // Move point in the crowns curve 30 pixels inwards to better capture the crown
-        upper_polygon[1] = cv::Point(_crown_curves.first.at(i).x, _crown_curves.first.at(i).y + 30);
-        upper_polygon[2] = cvp;
+    // The maximum segment height is the 70% of the difference between crown and neck curves
+    max_segment_height.first = min(outer_rows, (int)(abs(_crown_curves.first.y(0) - _necks_curves.first.y(0)) * 0.7));
+    max_segment_height.second = min(outer_rows, (int)(abs(_crown_curves.second.y(0) - _necks_curves.second.y(0)) * 0.7));
 
-        if (n > 1)
-            _image = Filters::PolygonBinarization(_image, upper_polygon, 4, pct_thr, _image);
+    int n;
+
+    _crown_regions.first.clear();
+    _crown_regions.second.clear();
+    _binarized_image = _image.clone();
+
+    // Each segment goes from the inner side of the band (inwards to better capture the crown)
+    // up to the max segment height
+    for (n = 2; n < n_segments; n++) {
+        // Upper Jaw
+        _crown_regions.first.push_back(
+                    BinarizeBandSegment(_crown_bands.first, _crown_curves.first, -1,
+                                        cv::Rect((n - 1) * segment_length.first + margin, 0,
+                                                 segment_length.first + 1, inner_rows + max_segment_height.first + 1),
+                                        pct_thr));
 
         // Lower Jaw
-        i = (n * segment_length.second) + slope_half_distance; // element position of current segment in crowns curve
-        in_bounds = true;
-        slope = Helpers::GetSlope(
-                    _crown_curves.second.at(i - slope_half_distance),
-                    _crown_curves.second.at(i + slope_half_distance));
-        // Iterate downwards
-        j = 0;
-        do {
-            j++;
-            cvp = cv::Point(
-                        _crown_curves.second.at(i).x - (j * slope),
-                        _crown_curves.second.at(i).y + j);
-            // Make sure vertical scan stays in bounds
-            if (cvp.x < 5 || cvp.x > _image.cols - 5 || cvp.y > _image.rows - 5)
-                in_bounds = false;
-        } while(j < max_segment_height.first && in_bounds);
-
-        if (n > 1) {
-            lower_polygon[0] = lower_polygon[1];
-            lower_polygon[3] = lower_polygon[2];
-        }
+        _crown_regions.second.push_back(
+                    BinarizeBandSegment(_crown_bands.second, _crown_curves.second, 1,
+                                        cv::Rect((n - 1) * segment_length.second + margin, 0,
+                                                 segment_length.second + 1, inner_rows + max_segment_height.second + 1),
+                                        pct_thr));
+    }
+}
 
-        // Move point in the crowns curve 30 pixels inwards to better capture the crown
-        lower_polygon[1] = cv::Point(_crown_curves.second.at(i).x, _crown_curves.second.at(i).y - 30);
-        lower_polygon[2] = cvp;
+// Binarize a rectangle of a crown band and write it back to the binarized image.
+// The threshold is taken from the histogram of the rectangle, as in Filters::PolygonBinarization.
+// INPUT: band -> crown band
+// INPUT: curve -> crown curve the band was built from
+// INPUT: direction -> -1 if the band goes upwards in the image, 1 if it goes downwards
+// INPUT: segment -> rectangle of the band to binarize
+// INPUT: pct_thr -> percentage threshold of binarization
+// OUTPUT: bounding region of the segment in the image
+cv::Rect Segmentation::BinarizeBandSegment(const cv::Mat& band, const Curve& curve, const int& direction, cv::Rect segment, const float& pct_thr) {
+    const uchar *band_row;
+    vector<int> values;
+    int r, x, y, thr, min_y, max_y, inner_rows;
+
+    segment &= cv::Rect(0, 0, band.cols, band.rows);
+    if (segment.area() == 0)
+        return cv::Rect();
+
+    // Store value of pixels inside the segment
+    values.reserve(segment.area());
+    for (r = segment.y; r < segment.y + segment.height; r++) {
+        band_row = band.ptr<uchar>(r);
+        values.insert(values.end(), band_row + segment.x, band_row + segment.x + segment.width);
+    }
 
-        if (n > 1)
-            _image = Filters::PolygonBinarization(_image, lower_polygon, 4, pct_thr, _image);
+    // Get static threshold from histogram and relative threshold
+    thr = Histogram::GetThreshold(Histogram::GetHistogram(values), pct_thr);
+
+    // Binarize the segment back into the image
+    inner_rows = BAND_INNER_ROWS;
+    min_y = _image.rows;
+    max_y = -1;
+    for (r = segment.y; r < segment.y + segment.height; r++) {
+        band_row = band.ptr<uchar>(r);
+        for (x = segment.x; x < segment.x + segment.width; x++) {
+            y = curve.y(x) + direction * (r - inner_rows);
+            y = std::max(0, std::min(_image.rows - 1, y));
+            _binarized_image.ptr<uchar>(y)[x] = band_row[x] > thr ? 255 : 0;
+            min_y = std::min(min_y, y);
+            max_y = std::max(max_y, y);
+        }
     }
+
+    return cv::Rect(segment.x, min_y, segment.width, max_y - min_y + 1);
 }
 
 //// HELPFUL VISUALIZATION METHODS ////
@@ -1,9 +1,11 @@
 #ifndef SEGMENTATION_H
 #define SEGMENTATION_H
 
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include <opencv2/core.hpp>
+#include "curve.h"
 
 using namespace std;
 
@@ -11,23 +13,40 @@ class Segmentation
 {
 public:
     // Empty default constructor
-    Segmentation() : _lineprofile_column_spacing(5),
+    Segmentation() : _pyramid_scale(1),
+        _lineprofile_column_spacing(5),
         _lineprofile_derivative_distance(5),
         _spline_pct_sample_size(0.2),
         _neck_sd_threshold(0.45),
         _crown_binarization_n_segments(30),
-        _crown_binarization_pct_threshold(0.25) {
-        cout << "Created instance of Segmentation." << endl;
+        _crown_binarization_pct_threshold(0.25),
+        _pyramid_levels(0),
+        _input_hash(0),
+        _last_version(0) {
     }
 
-    // Destructor
-    ~Segmentation() {
-        cout << "Destroyed instance of Segmentation." << endl;
+    // Copy constructor. Copies parameters only, not the results of a previous run.
+    Segmentation(const Segmentation& other) : _pyramid_scale(1),
+        _lineprofile_column_spacing(other._lineprofile_column_spacing),
+        _lineprofile_derivative_distance(other._lineprofile_derivative_distance),
+        _spline_pct_sample_size(other._spline_pct_sample_size),
+        _neck_sd_threshold(other._neck_sd_threshold),
+        _crown_binarization_n_segments(other._crown_binarization_n_segments),
+        _crown_binarization_pct_threshold(other._crown_binarization_pct_threshold),
+        _pyramid_levels(other._pyramid_levels),
+        _input_hash(0),
+        _last_version(0) {
     }
 
     // Run algorithm
     cv::Mat Process(const cv::Mat&);
 
+    // Forget the input image, so the next run recomputes every stage.
+    // Changes to the input pixels are detected by Process; this forces a full run regardless.
+    void Invalidate() {
+        _stages[STAGE_INPUT].version = 0;
+    }
+
 
     //// SETTERS AND GETTERS ////
     // Set line profiles column spacing
@@ -96,19 +115,82 @@ public:
     float getCrownBinarizationPctThreshold() {
         return _crown_binarization_pct_threshold;
     }
+    // Set number of pyramid levels. Crown and neck curves are found on the image halved this many times
+    // and refined at full resolution. 0 works at full resolution only.
+    bool setPyramidLevels(const int& levels) {
+        if (levels < 0 || levels > 4)
+            return false;
+        _pyramid_levels = levels;
+        return true;
+    }
+    // Get number of pyramid levels
+    int getPyramidLevels() {
+        return _pyramid_levels;
+    }
+    // Get crown curves of the last run <upper crowns curve, lower crowns curve>
+    pair<Curve, Curve> getCrownCurves() {
+        return _crown_curves;
+    }
+    // Get necks curves of the last run <upper necks curve, lower necks curve>
+    pair<Curve, Curve> getNecksCurves() {
+        return _necks_curves;
+    }
+    // Get bounding regions of the binarized crown segments of both jaws
+    vector<cv::Rect> getCrownRegions() {
+        vector<cv::Rect> regions(_crown_regions.first);
+        regions.insert(regions.end(), _crown_regions.second.begin(), _crown_regions.second.end());
+        return regions;
+    }
 
 private:
+    //// STAGES ////
+    // Stages of the algorithm, each one depends on the previous one
+    enum Stage {
+        STAGE_INPUT,                // input image
+        STAGE_PYRAMID,              // BuildPyramid
+        STAGE_CROWN_POINTS,         // DefineCrownPoints + RemoveAfarCrownPoints
+        STAGE_CROWN_CURVES,         // AdjustCrownsCurve + RefineCrownsCurve
+        STAGE_CROWN_BANDS,          // BuildCrownBands
+        STAGE_NECKS_CURVES,         // AdjustNecksCurve
+        STAGE_CROWN_BINARIZATION,   // BinarizeCrowns
+        N_STAGES
+    };
+    // Cache key of the output of a stage
+    struct StageCache {
+        StageCache() : version(0), upstream_version(0) {}
+        // Version of the output. 0 if the stage never ran.
+        long version;
+        // Version of the upstream output it was computed from
+        long upstream_version;
+        // Parameters it was computed with
+        vector<double> parameters;
+    };
+
     //// INTERNAL OBJECTS ////
-    // Local copy of input image for processing
+    // Input image for processing. Not modified.
     cv::Mat _image;
+    // Copy of _image with the crowns binarized
+    cv::Mat _binarized_image;
     // Local copy of _image for drawing and displaying
     cv::Mat _display_image;
-    // Pair of vectors with crown points <upper crowns, lower crowns>
+    // Downsampled _image the coarse stages work on. Same as _image without pyramid levels.
+    cv::Mat _coarse_image;
+    // Scale of _image relative to _coarse_image
+    int _pyramid_scale;
+    // Pair of vectors with crown points in _coarse_image <upper crowns, lower crowns>
     pair< vector<cv::Point>, vector<cv::Point> > _crowns;
-    // Pair of vectors with crown curve points <upper crowns curve, lower crowns curve>
-    pair< vector<cv::Point>, vector<cv::Point> > _crown_curves;
-    // Pair of vectors with neck curve points <upper necks curve, lower necks curve>
-    pair< vector<cv::Point>, vector<cv::Point> > _necks_curves;
+    // Pair of crown curves in _coarse_image <upper crowns curve, lower crowns curve>
+    pair<Curve, Curve> _coarse_crown_curves;
+    // Pair of crown curves <upper crowns curve, lower crowns curve>
+    pair<Curve, Curve> _crown_curves;
+    // Pair of images straightened along the coarse crown curves. Only built with pyramid levels.
+    pair<cv::Mat, cv::Mat> _coarse_crown_bands;
+    // Pair of images straightened along the crown curves <upper crowns band, lower crowns band>
+    pair<cv::Mat, cv::Mat> _crown_bands;
+    // Pair of neck curves <upper necks curve, lower necks curve>
+    pair<Curve, Curve> _necks_curves;
+    // Pair of vectors with bounding regions of binarized crown segments <upper crowns, lower crowns>
+    pair< vector<cv::Rect>, vector<cv::Rect> > _crown_regions;
 
     //// PARAMETERS ////
     // Column spacing between line profiles
@@ -123,8 +205,33 @@ private:
     int _crown_binarization_n_segments;
     // Percanetage threhsold for binariation of crowns
     float _crown_binarization_pct_threshold;
+    // Number of pyramid levels for the coarse stages
+    int _pyramid_levels;
+
+    //// STAGE CACHE ////
+    // Hash of the pixels of _image
+    uint64_t _input_hash;
+    // Cache key of each stage
+    StageCache _stages[N_STAGES];
+    // Last version given to a stage output
+    long _last_version;
 
     //// METHODS ////
+    // Check if a stage must be recomputed
+    bool StageIsDirty(const Stage&, const vector<double>&);
+
+    // Record that a stage was recomputed
+    void MarkStageComputed(const Stage&, const vector<double>&);
+
+    // Downsample the input image for the coarse stages
+    void BuildPyramid(const int&);
+
+    // Upsample a coarse curve to the columns of the input image
+    Curve UpsampleCurve(const Curve&);
+
+    // Search crown points at full resolution near a curve
+    vector<cv::Point> RefineCurvePoints(const Curve&, const int&, const int&, const int&, const bool&);
+
     // Obtain derivatives of the vertical line profiles of image
     vector <pair < int, vector<int> > > DerivativeLineProfiles(const cv::Mat&, const int&, const int&);
 
@@ -137,12 +244,24 @@ private:
     // Adjust Spline curve to crown points
     void AdjustCrownsCurve(const float&);
 
+    // Refine the coarse crown curves at full resolution
+    void RefineCrownsCurve(const int&, const int&, const float&);
+
+    // Resample the image along each crown curve into a straightened band
+    void BuildCrownBands(const cv::Mat&, const pair<Curve, Curve>&, const int&, pair<cv::Mat, cv::Mat>&);
+
     // Translate crowns curve to find teeth's neck
     void AdjustNecksCurve(const float&);
 
+    // Find the first translation of a crown curve where the standard deviation drops below the threshold
+    int NeckTranslation(const cv::Mat&, const int&, const float&, const int&, const int&, const int&);
+
     // Binarize crowns to more easily find the gaps between teeth
     void BinarizeCrowns(const int&, const float&);
 
+    // Binarize a rectangle of a crown band and write it back to the binarized image
+    cv::Rect BinarizeBandSegment(const cv::Mat&, const Curve&, const int&, cv::Rect, const float&);
+
     // Show display image
     void ShowDisplayImage();
 
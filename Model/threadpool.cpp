@@ -0,0 +1,262 @@
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#if defined(__has_include)
+#if __has_include(<opencv2/core/parallel/parallel_backend.hpp>)
+#include <opencv2/core/parallel/parallel_backend.hpp>
+#define HAVE_OPENCV_PARALLEL_BACKEND
+#endif
+#endif
+
+ThreadPool *ThreadPool::singleton = 0;
+std::mutex ThreadPool::singleton_mutex;
+
+namespace {
+// Sub-ranges of a ParallelFor per thread, so threads that finish early take more
+const int CHUNKS_PER_THREAD = 4;
+
+// Pool and index of the calling worker thread
+thread_local ThreadPool *current_pool = 0;
+thread_local int current_index = -1;
+
+// Range of a ParallelFor. Shared with the helper tasks, which may start after the loop is done.
+struct ParallelRange {
+    std::function<void(int, int)> body;
+    int begin;
+    int end;
+    int chunk_size;
+    int n_chunks;
+    // Index of the next chunk to run
+    std::atomic<int> next;
+    // Flag set when a chunk throws. The chunks left are skipped.
+    std::atomic<bool> failed;
+    // First exception thrown by a chunk, rethrown by the caller
+    std::exception_ptr error;
+    // Number of chunks run or skipped
+    int n_done;
+    // Guards n_done and error
+    std::mutex mutex;
+    // Wakes the caller when every chunk is run
+    std::condition_variable done;
+};
+
+// Run chunks of a range until none is left.
+// Exceptions are kept for the caller, so they never escape a pool worker, and every chunk
+// is still counted, so the caller waits for the chunks running before it rethrows.
+void RunChunks(const std::shared_ptr<ParallelRange>& range) {
+    std::exception_ptr error;
+    int i, begin;
+
+    while ((i = range->next++) < range->n_chunks) {
+        if (!range->failed) {
+            begin = range->begin + i * range->chunk_size;
+            try {
+                range->body(begin, std::min(range->end, begin + range->chunk_size));
+            } catch (...) {
+                error = std::current_exception();
+                range->failed = true;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(range->mutex);
+        if (error && !range->error)
+            range->error = error;
+        error = nullptr;
+        if (++range->n_done == range->n_chunks)
+            range->done.notify_all();
+    }
+}
+
+#ifdef HAVE_OPENCV_PARALLEL_BACKEND
+// OpenCV parallel backend running cv::parallel_for_ on the pool, so OpenCV loops inside pool tasks
+// share the pool threads instead of starting threads of their own.
+// The calling thread works too, so OpenCV sees one thread more than the pool has.
+class PoolParallelBackend : public cv::parallel::ParallelForAPI
+{
+public:
+    void parallel_for(int tasks, FN_parallel_for_body_cb_t body_callback, void* callback_data) {
+        ThreadPool::getInstance()->ParallelFor(0, tasks, [body_callback, callback_data](int begin, int end) {
+            body_callback(begin, end, callback_data);
+        }, tasks);
+    }
+
+    int getThreadNum() const {
+        return ThreadPool::getThreadIndex() + 1;
+    }
+
+    int getNumThreads() const {
+        return (int)std::max(1u, std::thread::hardware_concurrency()) + 1;
+    }
+
+    // The pool has a fixed size
+    int setNumThreads(int) {
+        return getNumThreads();
+    }
+
+    const char *getName() const {
+        return "dentalbiometry";
+    }
+};
+#endif
+}
+
+// Start n_threads workers (at least one)
+ThreadPool::ThreadPool(int n_threads) : _n_pending(0), _stop(false) {
+    int i;
+
+    if (n_threads < 1)
+        n_threads = 1;
+
+    // Queues first, since workers steal from each other as soon as they start
+    for (i = 0; i < n_threads; i++)
+        _queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue));
+    for (i = 0; i < n_threads; i++)
+        _workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+// Finish pending tasks and join workers
+ThreadPool::~ThreadPool() {
+    int i;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+
+    for (i = 0; i < (int)_workers.size(); i++)
+        _workers.at(i).join();
+}
+
+// Run body on consecutive sub-ranges of [begin, end) on the pool and the calling thread.
+// Returns when every sub-range is done. Can be called from a pool task: sub-ranges no other thread
+// took are run by the caller, and the ones taken are already running, so it never waits for a queued task.
+// If body throws, the sub-ranges not started are skipped and the first exception is rethrown here,
+// once no thread runs body any more.
+// INPUT: begin, end -> range
+// INPUT: body -> function run on each sub-range [sub-begin, sub-end)
+// INPUT: n_chunks -> number of sub-ranges. 0 = a few per thread.
+void ThreadPool::ParallelFor(const int& begin, const int& end, const std::function<void(int, int)>& body, int n_chunks) {
+    std::shared_ptr<ParallelRange> range;
+    int i;
+
+    if (end <= begin)
+        return;
+    if (n_chunks <= 0)
+        n_chunks = CHUNKS_PER_THREAD * (getNumThreads() + 1);
+
+    range = std::make_shared<ParallelRange>();
+    range->body = body;
+    range->begin = begin;
+    range->end = end;
+    range->chunk_size = (end - begin + n_chunks - 1) / n_chunks;
+    range->n_chunks = (end - begin + range->chunk_size - 1) / range->chunk_size;
+    range->next = 0;
+    range->failed = false;
+    range->n_done = 0;
+
+    // A single chunk is not worth a task
+    for (i = 1; i < std::min(range->n_chunks, getNumThreads() + 1); i++)
+        Push([range]() { RunChunks(range); });
+    RunChunks(range);
+
+    std::unique_lock<std::mutex> lock(range->mutex);
+    range->done.wait(lock, [&range]() { return range->n_done == range->n_chunks; });
+    if (range->error)
+        std::rethrow_exception(range->error);
+}
+
+// Get index of the calling worker thread, or -1 if it is not a worker of the pool
+int ThreadPool::getThreadIndex() {
+    return current_index;
+}
+
+// Queue a task: on the queue of the calling worker, or on the shared queue
+void ThreadPool::Push(std::function<void()> task) {
+    if (current_pool == this) {
+        std::lock_guard<std::mutex> lock(_queues.at(current_index)->mutex);
+        _queues.at(current_index)->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (current_pool != this)
+            _tasks.push_back(std::move(task));
+        _n_pending++;
+    }
+    _condition.notify_one();
+}
+
+// Take a task: the newest of the worker's own queue, the oldest shared one, or the oldest of another worker
+// INPUT: index -> index of the worker
+// OUTPUT: task -> task taken
+// OUTPUT: false if every queue is empty
+bool ThreadPool::Pop(const int& index, std::function<void()>& task) {
+    int i, victim;
+
+    {
+        std::lock_guard<std::mutex> lock(_queues.at(index)->mutex);
+        if (!_queues.at(index)->tasks.empty()) {
+            task = std::move(_queues.at(index)->tasks.back());
+            _queues.at(index)->tasks.pop_back();
+        }
+    }
+    if (!task) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_tasks.empty()) {
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+    }
+    for (i = 1; !task && i < (int)_queues.size(); i++) {
+        victim = (index + i) % _queues.size();
+        std::lock_guard<std::mutex> lock(_queues.at(victim)->mutex);
+        if (!_queues.at(victim)->tasks.empty()) {
+            task = std::move(_queues.at(victim)->tasks.front());
+            _queues.at(victim)->tasks.pop_front();
+        }
+    }
+    if (!task)
+        return false;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _n_pending--;
+    return true;
+}
+
+// Run tasks until the pool stops and every queue is empty
+void ThreadPool::WorkerLoop(int index) {
+    std::function<void()> task;
+
+    current_pool = this;
+    current_index = index;
+
+    while (true) {
+        if (Pop(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [this]() { return _stop || _n_pending > 0; });
+        if (_stop && _n_pending == 0)
+            return;
+    }
+}
+
+// Make the pool OpenCV's parallel backend, if the OpenCV version allows it (4.5.2 and later).
+// Older versions keep their own threads.
+// OUTPUT: true if the pool is OpenCV's parallel backend
+bool ThreadPool::RegisterOpenCVBackend() {
+#ifdef HAVE_OPENCV_PARALLEL_BACKEND
+    static std::once_flag registered;
+    std::call_once(registered, []() {
+        cv::parallel::setParallelForBackend(std::make_shared<PoolParallelBackend>());
+    });
+    return true;
+#else
+    return false;
+#endif
+}
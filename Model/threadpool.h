@@ -0,0 +1,117 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool shared by every parallel part of the project: background jobs, batch drivers,
+// per-tooth tracing, tiled stages and, where OpenCV allows it, OpenCV's own parallel loops.
+// Each worker has its own queue. Tasks submitted from a worker go to its queue and run newest first;
+// idle workers steal the oldest tasks of the others. Tasks submitted from other threads go to a shared queue.
+class ThreadPool
+{
+public:
+    // Get access to Singleton instance
+    static ThreadPool *getInstance() {
+        ThreadPool *instance;
+
+        // Creates the instance at first call
+        std::unique_lock<std::mutex> lock(singleton_mutex);
+        if (singleton == 0) {
+            singleton = new ThreadPool(std::thread::hardware_concurrency());
+            instance = singleton;
+            // Unlocked, since OpenCV may call back into the pool
+            lock.unlock();
+            RegisterOpenCVBackend();
+            return instance;
+        }
+        return singleton;
+    }
+
+    // Release singleton instance of this pool
+    static void destroy() {
+        std::lock_guard<std::mutex> lock(singleton_mutex);
+        if (singleton != 0) {
+            delete singleton;
+            singleton = 0;
+        }
+    }
+
+    // Queue a task and get a future to its result
+    template<class F>
+    std::future<typename std::result_of<F()>::type> Submit(F f) {
+        typedef typename std::result_of<F()>::type result_type;
+
+        std::shared_ptr< std::packaged_task<result_type()> > task =
+                std::make_shared< std::packaged_task<result_type()> >(f);
+        std::future<result_type> result = task->get_future();
+
+        Push([task]() { (*task)(); });
+
+        return result;
+    }
+
+    // Run body on consecutive sub-ranges of [begin, end) on the pool and the calling thread
+    void ParallelFor(const int&, const int&, const std::function<void(int, int)>&, int = 0);
+
+    // Get number of worker threads
+    int getNumThreads() {
+        return (int)_queues.size();
+    }
+
+    // Get index of the calling worker thread, or -1 if it is not a worker of the pool
+    static int getThreadIndex();
+
+private:
+    //// INTERNAL OBJECTS ////
+    // Queue of a worker
+    struct WorkerQueue {
+        std::deque< std::function<void()> > tasks;
+        std::mutex mutex;
+    };
+    // Pointer to singleton
+    static ThreadPool *singleton;
+    // Guards creation and destruction of singleton
+    static std::mutex singleton_mutex;
+    // Worker threads
+    std::vector<std::thread> _workers;
+    // Queue of each worker
+    std::vector< std::unique_ptr<WorkerQueue> > _queues;
+    // Tasks submitted from threads outside the pool
+    std::deque< std::function<void()> > _tasks;
+    // Guards _tasks, _n_pending and _stop
+    std::mutex _mutex;
+    // Wakes workers when a task is queued or the pool stops
+    std::condition_variable _condition;
+    // Number of queued tasks in all queues
+    int _n_pending;
+    // Flag telling workers to finish
+    bool _stop;
+
+    //// METHODS ////
+    // Private constructor
+    ThreadPool(int);
+
+    // Finish pending tasks and join workers
+    ~ThreadPool();
+
+    // Queue a task
+    void Push(std::function<void()>);
+
+    // Take a task: the newest of the worker's own queue, the oldest shared one, or the oldest of another worker
+    bool Pop(const int&, std::function<void()>&);
+
+    // Loop run by each worker thread
+    void WorkerLoop(int);
+
+    // Make the pool OpenCV's parallel backend, if the OpenCV version allows it
+    static bool RegisterOpenCVBackend();
+};
+
+#endif // THREADPOOL_H
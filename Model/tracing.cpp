@@ -1,23 +1,21 @@
 #include "tracing.h"
 #include "helpers.h"
+#include "livewire.h"
+#include "memorytracker.h"
+#include "threadpool.h"
 #include "visualizationhelpers.h"
 #include <opencv2/highgui.hpp>
 #include <opencv2/opencv.hpp>
 
 cv::Mat Tracing::Process(const cv::Mat& input) {
-    input.copyTo(_image);
+    // A new buffer, since the image returned by the last call may still be in use
+    _image = input.clone();
     _display_image = cv::Mat::zeros(input.cols, input.rows, CV_8UC3);
     // Convert from grayscale to RGB for drawing purposes
     cv::cvtColor(input, _display_image, CV_GRAY2RGB, 3);
 
-    // Find the first pixel from the where tracing starts and add it to vectors with slope and angle.
-    AddPixelValuesToVectors(
-                FindFirstContourPixel(
-                    _first_pixel_intensity_threshold,
-                    _first_pixel_inner_margin));
-
-    // Start off form the first pixel and trace the crown of the tooth down to the neck
-    TraceCrown(_crown_trace_max_pct_height, _crown_trace_extrapolation_distance, _crown_trace_extrapolation_mask);
+    // Trace the contour of the tooth
+    TraceContour();
 
     cv::imshow("display_image", _display_image);
 
@@ -25,17 +23,141 @@ cv::Mat Tracing::Process(const cv::Mat& input) {
 
 }
 
+// Run algorithm on each tooth region concurrently.
+// Each region is traced by its own copy of this object on a view of the input image, so no pixels are copied.
+// Can be called from a pool task, e.g. by a batch driver.
+// An exception thrown while tracing a tooth (e.g. a region outside input) is rethrown here,
+// once the other teeth being traced are done.
+// INPUT: input -> image to trace
+// INPUT: regions -> tooth regions inside input
+// OUTPUT: vector with the contour of each region, in input image coordinates
+vector< vector<cv::Point> > Tracing::ProcessTeeth(const cv::Mat& input, const vector<cv::Rect>& regions) {
+    cout << "Tracing " << regions.size() << " teeth..." << endl;
+    MemoryScope memory_scope("teeth tracing");
+    // Buffers of the tasks count for this scope, whichever worker runs them
+    shared_ptr<MemoryTracker::Scope> scope = MemoryScope::Current();
+    vector< vector<cv::Point> > contours(regions.size());
+    const Tracing *parameters = this;
+
+    // One tooth per sub-range. The whole set takes as long as the slowest tooth.
+    ThreadPool::getInstance()->ParallelFor(0, (int)regions.size(), [parameters, &input, &regions, &contours, scope](int begin, int end) {
+        MemoryScope task_scope(scope);
+        int i, j;
+
+        for (i = begin; i < end; i++) {
+            Tracing tooth_tracing(*parameters);
+            tooth_tracing._show_steps = false;
+            tooth_tracing._image = input(regions.at(i));
+
+            // Move contour from region coordinates to input image coordinates
+            contours.at(i) = tooth_tracing.TraceContour();
+            for (j = 0; j < (int)contours.at(i).size(); j++)
+                contours.at(i).at(j) += regions.at(i).tl();
+        }
+    }, (int)regions.size());
+
+    return contours;
+}
+
+// Trace the contour of the tooth in _image.
+// With more than one candidate first pixel, tracing starts from each one and the longest contour is kept.
+vector<cv::Point> Tracing::TraceContour() {
+    vector<cv::Point> seeds;
+    vector<cv::Point> best_contour;
+    vector<float> best_slopes;
+    vector<float> best_angles;
+    cv::Point first_pixel;
+    int i;
+
+    // Find the first pixel(s) from the where tracing starts
+    if (_first_pixel_n_candidates == 1) {
+        first_pixel = FindFirstContourPixel(
+                    _first_pixel_intensity_threshold,
+                    _first_pixel_inner_margin);
+        if (first_pixel.x >= 0)
+            seeds.push_back(first_pixel);
+    } else {
+        seeds = FindContourSeeds(
+                    _first_pixel_intensity_threshold,
+                    _first_pixel_inner_margin,
+                    _first_pixel_n_candidates);
+    }
+
+    // Nothing is traced if no pixel is above the threshold
+    for (i = 0; i < (int)seeds.size(); i++) {
+        _contour.clear();
+        _slopes.clear();
+        _angles.clear();
+
+        // Add the first pixel to vectors with slope and angle.
+        AddPixelValuesToVectors(seeds.at(i));
+
+        // Start off form the first pixel and trace the crown of the tooth down to the neck
+        if (_tracing_engine == 1)
+            TraceCrownMinimalPath(_crown_trace_max_pct_height);
+        else
+            TraceCrown(_crown_trace_max_pct_height, _crown_trace_extrapolation_distance, _crown_trace_extrapolation_mask);
+
+        if (_contour.size() > best_contour.size()) {
+            best_contour.swap(_contour);
+            best_slopes.swap(_slopes);
+            best_angles.swap(_angles);
+        }
+    }
+
+    _contour.swap(best_contour);
+    _slopes.swap(best_slopes);
+    _angles.swap(best_angles);
+
+    return _contour;
+}
+
 // Find the first pixel from where the tracing starts.
+// Each row is scanned through its row pointer, many pixels at a time.
+// OUTPUT: first pixel equal to or above intensity_thr, or (-1, -1) if there is none
 cv::Point Tracing::FindFirstContourPixel(const int& intensity_thr, const int& inner_margin) {
-    int x, y;
+    int x, y, width;
+
+    width = _image.cols - (2 * inner_margin);
+    if (width <= 0)
+        return cv::Point(-1, -1);
+
+    for (y = inner_margin; y < _image.rows - inner_margin; y++) {
+        x = Helpers::FirstIndexAboveThreshold(
+                    _image.ptr<uchar>(y) + inner_margin,
+                    width,
+                    (uchar)intensity_thr);
+        if (x >= 0)
+            return cv::Point(inner_margin + x, y);
+    }
 
-    for (y = inner_margin; y < _image.rows - inner_margin; y++)
-        for (x = inner_margin; x < _image.cols - inner_margin; x++)
-            if (_image.at<uchar>(cv::Point(x, y)) >= intensity_thr)
-                goto STOP;
-    STOP:
+    return cv::Point(-1, -1);
+}
 
-    return cv::Point(x, y);
+// Find the brightest candidate pixels from where the tracing can start.
+// Candidates are at least width / (2 * n_candidates) apart, so they can spread over the whole area
+// instead of clustering on the first bright row.
+// OUTPUT: candidate pixels sorted from brightest to darkest
+vector<cv::Point> Tracing::FindContourSeeds(const int& intensity_thr, const int& inner_margin, const int& n_candidates) {
+    vector<cv::Point> seeds;
+    int i, width, height;
+
+    width = _image.cols - (2 * inner_margin);
+    height = _image.rows - (2 * inner_margin);
+    if (width <= 0 || height <= 0)
+        return seeds;
+
+    seeds = Helpers::BrightestPixels(
+                _image(cv::Rect(inner_margin, inner_margin, width, height)),
+                (uchar)intensity_thr,
+                n_candidates,
+                max(1, width / (2 * n_candidates)));
+
+    // From the inner area to image coordinates
+    for (i = 0; i < (int)seeds.size(); i++)
+        seeds.at(i) += cv::Point(inner_margin, inner_margin);
+
+    return seeds;
 }
 
 // Trace the crown of the tooth down to the neck
@@ -78,9 +200,11 @@ void Tracing::TraceCrown(const float& max_height_pct, const int& extrapolation_d
         }
         counter++;
 
-        _display_image.at<cv::Vec3b>(_contour.back()) = cv::Vec3b(255, 255, 255);
-        cv::imshow("display_image", _display_image);
-        cv::waitKey(0);
+        if (_show_steps) {
+            _display_image.at<cv::Vec3b>(_contour.back()) = cv::Vec3b(255, 255, 255);
+            cv::imshow("display_image", _display_image);
+            cv::waitKey(0);
+        }
     } while (_contour.back().x < max_height);
 
     // Reverse all vector so the beginning of the right side trace appends to the left side trace.
@@ -120,12 +244,76 @@ void Tracing::TraceCrown(const float& max_height_pct, const int& extrapolation_d
         }
         counter++;
 
-        _display_image.at<cv::Vec3b>(_contour.back()) = cv::Vec3b(255, 255, 255);
-        cv::imshow("display_image", _display_image);
-        cv::waitKey(0);
+        if (_show_steps) {
+            _display_image.at<cv::Vec3b>(_contour.back()) = cv::Vec3b(255, 255, 255);
+            cv::imshow("display_image", _display_image);
+            cv::waitKey(0);
+        }
     } while (_contour.back().x < max_height);
 }
 
+// Trace the crown of the tooth down to the neck with minimal-cost paths on the gradient image.
+// One shortest-path tree is grown from the first pixel over the crown band, the rows from the first pixel
+// down to max height, then the paths to the brightest pixels at max height on each side are backtracked.
+// Cost is O(pixels of the band) and does not drift.
+void Tracing::TraceCrownMinimalPath(const float& max_height_pct) {
+    LiveWire livewire;
+    vector<cv::Point> left_side;
+    vector<cv::Point> right_side;
+    cv::Point first_pixel;
+    cv::Rect crown_band;
+    int max_height;
+    int i;
+
+    first_pixel = _contour.back();
+    max_height = min((int)(max_height_pct * _image.rows), _image.rows - 1);
+    if (max_height <= first_pixel.y)
+        return;
+
+    // The first pixel is the topmost pixel of the tooth above the intensity threshold, so the crown lies below it.
+    // Livewire takes and returns points in _image coordinates, so they need no offset.
+    crown_band = cv::Rect(0, first_pixel.y, _image.cols, max_height - first_pixel.y + 1);
+    livewire.SetImage(_image, crown_band);
+    livewire.SetSeed(first_pixel);
+    livewire.ComputeTree();
+
+    // Paths from the first pixel to the ends of each side
+    if (first_pixel.x > 0)
+        left_side = livewire.GetPath(BrightestPixelInRow(max_height, 0, first_pixel.x - 1));
+    if (first_pixel.x < _image.cols - 1)
+        right_side = livewire.GetPath(BrightestPixelInRow(max_height, first_pixel.x + 1, _image.cols - 1));
+
+    // Left side goes down from the first pixel, as in TraceCrown
+    for (i = 1; i < (int)left_side.size(); i++)
+        AddPixelValuesToVectors(left_side.at(i));
+
+    // Reverse all vector so the beginning of the right side trace appends to the left side trace.
+    reverse(_contour.begin(), _contour.end());
+    reverse(_slopes.begin(), _slopes.end());
+    reverse(_angles.begin(), _angles.end());
+
+    for (i = 1; i < (int)right_side.size(); i++)
+        AddPixelValuesToVectors(right_side.at(i));
+
+    if (_show_steps)
+        for (i = 0; i < (int)_contour.size(); i++)
+            _display_image.at<cv::Vec3b>(_contour.at(i)) = cv::Vec3b(255, 255, 255);
+}
+
+// Find the brightest pixel of a row between two columns (both included)
+cv::Point Tracing::BrightestPixelInRow(const int& row, const int& min_col, const int& max_col) {
+    const uchar *pixels;
+    int x, brightest_col;
+
+    pixels = _image.ptr<uchar>(row);
+    brightest_col = min_col;
+    for (x = min_col + 1; x <= max_col; x++)
+        if (pixels[x] > pixels[brightest_col])
+            brightest_col = x;
+
+    return cv::Point(brightest_col, row);
+}
+
 // From input pixel obtain slope and angle, and append all to their respective vectors.
 void Tracing::AddPixelValuesToVectors(const cv::Point& pixel) {
     _contour.push_back(pixel);
@@ -10,23 +10,35 @@ class Tracing
 {
 public:
     // Empty default constructor
-    Tracing(): _slope_angle_distance(3),
+    Tracing(): _show_steps(true),
+        _slope_angle_distance(3),
         _first_pixel_intensity_threshold(20),
         _first_pixel_inner_margin(20),
+        _first_pixel_n_candidates(1),
         _crown_trace_max_pct_height(0.7),
         _crown_trace_extrapolation_distance(2),
-        _crown_trace_extrapolation_mask(3) {
-        cout << "Created instance of Tracing." << endl;
+        _crown_trace_extrapolation_mask(3),
+        _tracing_engine(0) {
     }
 
-    // Destructor
-    ~Tracing() {
-        cout << "Destroyed instance of Tracing." << endl;
+    // Copy constructor. Copies parameters only, not the results of a previous run.
+    Tracing(const Tracing& other): _show_steps(other._show_steps),
+        _slope_angle_distance(other._slope_angle_distance),
+        _first_pixel_intensity_threshold(other._first_pixel_intensity_threshold),
+        _first_pixel_inner_margin(other._first_pixel_inner_margin),
+        _first_pixel_n_candidates(other._first_pixel_n_candidates),
+        _crown_trace_max_pct_height(other._crown_trace_max_pct_height),
+        _crown_trace_extrapolation_distance(other._crown_trace_extrapolation_distance),
+        _crown_trace_extrapolation_mask(other._crown_trace_extrapolation_mask),
+        _tracing_engine(other._tracing_engine) {
     }
 
     // Run algorithm
     cv::Mat Process(const cv::Mat&);
 
+    // Run algorithm on each tooth region concurrently
+    vector< vector<cv::Point> > ProcessTeeth(const cv::Mat&, const vector<cv::Rect>&);
+
 
     //// SETTERS AND GETTERS ////
     // Set slope and angle distance measurement.
@@ -62,6 +74,17 @@ public:
     int getFirstPixelInnerMargin() {
         return _first_pixel_inner_margin;
     }
+    // Set number of candidate first pixels to start tracing from.
+    bool setFirstPixelNumCandidates(const int& n) {
+        if (n < 1 || n > 100)
+            return false;
+        _first_pixel_n_candidates = n;
+        return true;
+    }
+    // Get number of candidate first pixels to start tracing from.
+    int getFirstPixelNumCandidates() {
+        return _first_pixel_n_candidates;
+    }
     // Set relative max height of crown tracing
     bool setCrownTracingMaxPctHeight(const float& h) {
         if (h <= 0 || h >= 1)
@@ -95,6 +118,17 @@ public:
     int getCrownTracingExtrapolationMask() {
         return _crown_trace_extrapolation_mask;
     }
+    // Set tracing engine (0 = greedy, 1 = minimal path)
+    bool setTracingEngine(const int& e) {
+        if (e < 0 || e > 1)
+            return false;
+        _tracing_engine = e;
+        return true;
+    }
+    // Get tracing engine (0 = greedy, 1 = minimal path)
+    int getTracingEngine() {
+        return _tracing_engine;
+    }
 
 private:
     //// INTERNAL OBJECTS ////
@@ -108,6 +142,8 @@ private:
     vector<float> _slopes;
     // Vector of angles at each point in contour.
     vector<float> _angles;
+    // Flag to display each traced pixel. Disabled when tracing teeth concurrently.
+    bool _show_steps;
 
 
     //// PARAMETERS ////
@@ -117,21 +153,37 @@ private:
     int _first_pixel_intensity_threshold;
     // Inner margin of image delimiting the area where the first pixel of the contour will be searched for.
     int _first_pixel_inner_margin;
+    // Number of candidate first pixels to start tracing from. The longest contour is kept.
+    int _first_pixel_n_candidates;
     // Max height of crown tracing in pct relative to image height
     float _crown_trace_max_pct_height;
     // Extrapolation distance for crown tracing
     int _crown_trace_extrapolation_distance;
     // Mask where fittest pixel in extrapolated neighborhood is found for crown tracing
     int _crown_trace_extrapolation_mask;
+    // Tracing engine: 0 = greedy walk, 1 = minimal-cost path
+    int _tracing_engine;
 
     //// METHODS ////
+    // Trace the contour of the tooth in _image
+    vector<cv::Point> TraceContour();
+
     // Find the first pixel from where the tracing starts
     cv::Point FindFirstContourPixel(const int&, const int&);
 
+    // Find the brightest candidate pixels from where the tracing can start, spread over the image
+    vector<cv::Point> FindContourSeeds(const int&, const int&, const int&);
+
     // Trace the crown of the tooth down to the neck
     // Only works with lower jaw teeth
     void TraceCrown(const float&, const int&, const int&);
 
+    // Trace the crown of the tooth down to the neck with minimal-cost paths
+    void TraceCrownMinimalPath(const float&);
+
+    // Find the brightest pixel of a row between two columns
+    cv::Point BrightestPixelInRow(const int&, const int&, const int&);
+
     // From input pixel obtain slope and angle, and append all to their respective vectors.
     void AddPixelValuesToVectors(const cv::Point&);
 
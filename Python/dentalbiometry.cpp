@@ -0,0 +1,461 @@
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <opencv2/core.hpp>
+#include "Model/curve.h"
+#include "Model/filters.h"
+#include "Model/helpers.h"
+#include "Model/histogram.h"
+#include "Model/segmentation.h"
+#include "Model/tracing.h"
+
+namespace py = pybind11;
+
+// Python bindings of the Model layer.
+// Images go both ways without copies: NumPy arrays are wrapped in cv::Mat headers,
+// and resulting cv::Mat are exposed as NumPy arrays that keep the Mat buffer alive.
+// The GIL is released while processing, so Python threads run in parallel.
+// Filters, Helpers and Histogram are safe to call from several threads at once.
+// Segmentation and Tracing instances are not: use one instance per thread.
+
+namespace {
+// NumPy array of 8-bit pixels, copied only when it is not C-contiguous
+typedef py::array_t<uchar, py::array::c_style> ImageArray;
+// NumPy array of integer coordinates
+typedef py::array_t<int, py::array::c_style | py::array::forcecast> PointArray;
+
+// Check that an argument is an array of 8-bit pixels. Other types are rejected instead of
+// being cast, which would silently truncate e.g. float or 16-bit images.
+ImageArray CheckImage(const py::array& array) {
+    if (!py::isinstance< py::array_t<uchar> >(array))
+        throw py::type_error("Expected an image of dtype uint8, got " + std::string(py::str(array.dtype())));
+
+    return ImageArray::ensure(array);
+}
+
+// Check that an argument is an array of integer coordinates. Float coordinates are rejected instead of truncated.
+PointArray CheckPoints(const py::array& array) {
+    if (array.dtype().kind() != 'i' && array.dtype().kind() != 'u')
+        throw py::type_error("Expected points of an integer dtype, got " + std::string(py::str(array.dtype())));
+
+    return PointArray::ensure(array);
+}
+
+// Wrap a NumPy array of shape (rows, cols) or (rows, cols, channels) in a cv::Mat header.
+// The header points to the array buffer, so the array must outlive it.
+cv::Mat ArrayToMat(const ImageArray& array) {
+    int channels;
+
+    if (array.ndim() != 2 && array.ndim() != 3)
+        throw std::invalid_argument("Expected an image of shape (rows, cols) or (rows, cols, channels)");
+    channels = (array.ndim() == 3) ? (int)array.shape(2) : 1;
+    if (channels < 1 || channels > CV_CN_MAX)
+        throw std::invalid_argument("Invalid number of channels");
+
+    return cv::Mat((int)array.shape(0), (int)array.shape(1), CV_MAKETYPE(CV_8U, channels),
+                   (void*)array.data(), (size_t)array.strides(0));
+}
+
+// Get the NumPy type of the depth of a cv::Mat
+py::dtype DepthToDtype(const int& depth) {
+    switch (depth) {
+    case CV_8U: return py::dtype::of<uchar>();
+    case CV_8S: return py::dtype::of<schar>();
+    case CV_16U: return py::dtype::of<ushort>();
+    case CV_16S: return py::dtype::of<short>();
+    case CV_32S: return py::dtype::of<int>();
+    case CV_32F: return py::dtype::of<float>();
+    case CV_64F: return py::dtype::of<double>();
+    default: throw std::invalid_argument("Unsupported image depth");
+    }
+}
+
+// Expose a cv::Mat as a NumPy array without copying its pixels.
+// The array owns a copy of the header, which holds a reference to the pixels.
+py::array MatToArray(cv::Mat mat) {
+    std::vector<py::ssize_t> shape, strides;
+    cv::Mat *owner;
+
+    if (mat.empty())
+        return py::array(py::dtype::of<uchar>(), std::vector<py::ssize_t>(2, 0));
+    // Pixels the Mat does not own (e.g. the buffer of an input array) are copied, or they could be freed under the array
+    if (mat.u == 0)
+        mat = mat.clone();
+
+    shape.push_back(mat.rows);
+    shape.push_back(mat.cols);
+    strides.push_back((py::ssize_t)mat.step[0]);
+    strides.push_back((py::ssize_t)mat.elemSize());
+    if (mat.channels() > 1) {
+        shape.push_back(mat.channels());
+        strides.push_back((py::ssize_t)mat.elemSize1());
+    }
+
+    owner = new cv::Mat(mat);
+    py::capsule base(owner, [](void *p) { delete (cv::Mat*)p; });
+
+    return py::array(DepthToDtype(mat.depth()), shape, strides, owner->data, base);
+}
+
+// Convert a NumPy array of integers of shape (n, 2) to points
+std::vector<cv::Point> ArrayToPoints(const py::array& input) {
+    PointArray array = CheckPoints(input);
+    std::vector<cv::Point> points;
+    const int *xy;
+    py::ssize_t i;
+
+    if (array.ndim() != 2 || array.shape(1) != 2)
+        throw std::invalid_argument("Expected points of shape (n, 2)");
+
+    xy = array.data();
+    points.reserve(array.shape(0));
+    for (i = 0; i < array.shape(0); i++)
+        points.push_back(cv::Point(xy[2 * i], xy[2 * i + 1]));
+
+    return points;
+}
+
+// Check that an image has a single channel, as the grayscale helpers expect
+void CheckGrayscale(const cv::Mat& img) {
+    if (img.channels() != 1)
+        throw py::value_error("Expected a grayscale image of shape (rows, cols)");
+}
+
+// Check that every point lies inside an image
+void CheckInside(const cv::Mat& img, const std::vector<cv::Point>& points) {
+    cv::Rect bounds(0, 0, img.cols, img.rows);
+    size_t i;
+
+    for (i = 0; i < points.size(); i++)
+        if (!bounds.contains(points[i]))
+            throw py::index_error("Point (" + std::to_string(points[i].x) + ", " + std::to_string(points[i].y)
+                                  + ") is outside the image");
+}
+
+// Convert points to a NumPy array of shape (n, 2)
+py::array_t<int> PointsToArray(const std::vector<cv::Point>& points) {
+    py::array_t<int> array(std::vector<py::ssize_t>{(py::ssize_t)points.size(), 2});
+    int *xy = array.mutable_data();
+    size_t i;
+
+    for (i = 0; i < points.size(); i++) {
+        xy[2 * i] = points[i].x;
+        xy[2 * i + 1] = points[i].y;
+    }
+
+    return array;
+}
+
+// Convert (x, y, width, height) tuples to rectangles
+std::vector<cv::Rect> TuplesToRects(const std::vector< std::tuple<int, int, int, int> >& tuples) {
+    std::vector<cv::Rect> rects;
+    size_t i;
+
+    for (i = 0; i < tuples.size(); i++)
+        rects.push_back(cv::Rect(std::get<0>(tuples[i]), std::get<1>(tuples[i]),
+                                 std::get<2>(tuples[i]), std::get<3>(tuples[i])));
+
+    return rects;
+}
+
+// Convert rectangles to (x, y, width, height) tuples
+std::vector< std::tuple<int, int, int, int> > RectsToTuples(const std::vector<cv::Rect>& rects) {
+    std::vector< std::tuple<int, int, int, int> > tuples;
+    size_t i;
+
+    for (i = 0; i < rects.size(); i++)
+        tuples.push_back(std::make_tuple(rects[i].x, rects[i].y, rects[i].width, rects[i].height));
+
+    return tuples;
+}
+
+// Property with a bool setter of the Model: a rejected value raises ValueError instead of being ignored
+template <typename T, typename C>
+void DefineParameter(py::class_<C>& cls, const char *name, T (C::*getter)(), bool (C::*setter)(const T&)) {
+    cls.def_property(name, getter, [name, setter](C& self, const T& value) {
+        if (!(self.*setter)(value))
+            throw py::value_error(std::string("Value out of range for ") + name);
+    });
+}
+}
+
+PYBIND11_MODULE(dentalbiometry, m) {
+    m.doc() = "Dental panoramic x-ray segmentation";
+
+    //// CURVE ////
+    py::class_<Curve>(m, "Curve")
+        .def(py::init<>())
+        .def("__len__", &Curve::size)
+        .def_property_readonly("first_column", &Curve::getFirstColumn)
+        .def_property_readonly("rows", [](const Curve& c) {
+            return py::array_t<short>(c.size(), c.data());
+        }, "Row of each column, as a copy")
+        .def("to_points", [](const Curve& c) {
+            return PointsToArray(c.ToPoints());
+        }, "Valid elements as an array of shape (n, 2)");
+
+    //// FILTERS ////
+    py::module filters = m.def_submodule("filters", "Image filters. Every filter returns a new image.");
+    filters.def("median", [](const py::array& image, int k) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::Median(input, k);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("k_size"));
+    filters.def("bilateral", [](const py::array& image, int k) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::Bilateral(input, k);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("k_size"));
+    filters.def("contrast_enhancement", [](const py::array& image, float w, float h, int shape) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::ContrastEnhancement(input, w, h, shape);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("width"), py::arg("height"), py::arg("shape") = 0);
+    filters.def("top_hat", [](const py::array& image, float w, float h, int shape) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::TopHat(input, w, h, shape);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("width"), py::arg("height"), py::arg("shape") = 0);
+    filters.def("bottom_hat", [](const py::array& image, float w, float h, int shape) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::BottomHat(input, w, h, shape);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("width"), py::arg("height"), py::arg("shape") = 0);
+    filters.def("closing", [](const py::array& image, int w, int h, int shape) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::Closing(input, w, h, shape);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("width"), py::arg("height"), py::arg("shape") = 0);
+    filters.def("erode", [](const py::array& image, int w, int h, int shape) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::Erode(input, w, h, shape);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("width"), py::arg("height"), py::arg("shape") = 0);
+    filters.def("binarization", [](const py::array& image, float pct) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::Binarization(input, pct);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("pct_threshold"));
+    filters.def("polygon_binarization", [](const py::array& image, const py::array& polygon,
+                                           float pct, py::object base) {
+        ImageArray pixels = CheckImage(image), base_pixels;
+        cv::Mat input = ArrayToMat(pixels), output, base_mat;
+        std::vector<cv::Point> points = ArrayToPoints(polygon);
+        if (points.size() < 3)
+            throw py::value_error("Expected a polygon of at least 3 points");
+        CheckInside(input, points);
+        if (!base.is_none()) {
+            base_pixels = CheckImage(base.cast<py::array>());
+            base_mat = ArrayToMat(base_pixels);
+            if (base_mat.size() != input.size() || base_mat.type() != input.type())
+                throw py::value_error("Expected a base image of the shape of the input image");
+        }
+        {
+            py::gil_scoped_release release;
+            output = Filters::PolygonBinarization(input, points.data(), (int)points.size(), pct, base_mat);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("polygon"), py::arg("pct_threshold"), py::arg("base") = py::none(),
+       "Binarize the pixels of image inside a convex polygon, with a threshold from their histogram. "
+       "The result is a copy of base, or of image if no base is given, with the binarized polygon painted on it.");
+    filters.def("local_binarization", [](const py::array& image, float pct, int n_rows, int n_cols) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::LocalBinarization(input, pct, n_rows, n_cols);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("pct_threshold"), py::arg("n_rows"), py::arg("n_cols"));
+    filters.def("sobel", [](const py::array& image, int k, int direction) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            output = Filters::Sobel(input, k, direction);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("k_size") = 3, py::arg("direction") = 0);
+
+    //// HELPERS ////
+    py::module helpers = m.def_submodule("helpers", "Geometry and line profile helpers");
+    helpers.def("slope", [](int x1, int y1, int x2, int y2) {
+        return Helpers::GetSlope(cv::Point(x1, y1), cv::Point(x2, y2));
+    }, py::arg("x1"), py::arg("y1"), py::arg("x2"), py::arg("y2"));
+    helpers.def("angle", [](int x1, int y1, int x2, int y2, bool degrees) {
+        return Helpers::GetAngle(cv::Point(x1, y1), cv::Point(x2, y2), degrees);
+    }, py::arg("x1"), py::arg("y1"), py::arg("x2"), py::arg("y2"), py::arg("degrees") = true);
+    helpers.def("discrete_standard_deviation", &Helpers::DiscreteStandardDeviation, py::arg("values"));
+    helpers.def("derive_vector", &Helpers::DeriveVector, py::arg("values"), py::arg("distance") = 1);
+    helpers.def("grayscale_profile", [](const py::array& image, const py::array& points) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels);
+        std::vector<cv::Point> p = ArrayToPoints(points);
+        CheckGrayscale(input);
+        CheckInside(input, p);
+        return Helpers::GrayscaleProfile(input, p);
+    }, py::arg("image"), py::arg("points"));
+    helpers.def("profile_derivative_standard_deviation", [](const py::array& image, const py::array& points, int d) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels);
+        std::vector<cv::Point> p = ArrayToPoints(points);
+        CheckGrayscale(input);
+        CheckInside(input, p);
+        py::gil_scoped_release release;
+        return Helpers::ProfileDerivativeStandardDeviation(input, p, d);
+    }, py::arg("image"), py::arg("points"), py::arg("distance") = 1);
+    helpers.def("fit_spline", [](const py::array& points, int min_x, int max_x, int subsamples) {
+        std::vector<cv::Point> p = ArrayToPoints(points);
+        size_t i;
+        // Checked before the GIL is released: the spline asserts on these and subsamples of 0 divides by zero
+        if (p.size() < 3)
+            throw py::value_error("Expected at least 3 points");
+        if (subsamples != -1 && (subsamples < 3 || subsamples > (int)p.size()))
+            throw py::value_error("subsamples must be -1 or between 3 and the number of points");
+        for (i = 1; i < p.size(); i++)
+            if (p[i].x <= p[i - 1].x)
+                throw py::value_error("Expected points of strictly increasing x");
+        py::gil_scoped_release release;
+        return Helpers::FitSpline(p, min_x, max_x, subsamples);
+    }, py::arg("points"), py::arg("min_x"), py::arg("max_x"), py::arg("subsamples") = -1);
+    helpers.def("sum_of_neighbors", [](const py::array& image, int x, int y, int k) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels);
+        int half = k / 2;
+        CheckGrayscale(input);
+        if (k < 1)
+            throw py::value_error("k_size must be positive");
+        if (x - half < 0 || y - half < 0 || x + half >= input.cols || y + half >= input.rows)
+            throw py::index_error("Neighborhood of the pixel reaches outside the image");
+        return Helpers::SumOfNeighbors(input, cv::Point(x, y), k);
+    }, py::arg("image"), py::arg("x"), py::arg("y"), py::arg("k_size"));
+
+    //// HISTOGRAM ////
+    py::module histogram = m.def_submodule("histogram", "Grayscale histograms");
+    histogram.def("histogram", [](const py::array& image) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels);
+        py::gil_scoped_release release;
+        return Histogram::GetHistogram(input);
+    }, py::arg("image"));
+    histogram.def("histogram_of_values", [](const std::vector<int>& values) {
+        return Histogram::GetHistogram(values);
+    }, py::arg("values"));
+    histogram.def("threshold", &Histogram::GetThreshold, py::arg("histogram"), py::arg("pct"));
+
+    //// SEGMENTATION ////
+    py::class_<Segmentation> segmentation(m, "Segmentation");
+    segmentation.def(py::init<>());
+    segmentation.def("process", [](Segmentation& self, const py::array& image, bool keep_stages) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels), output;
+        {
+            py::gil_scoped_release release;
+            if (!keep_stages)
+                self.Invalidate();
+            output = self.Process(input);
+        }
+        return MatToArray(output);
+    }, py::arg("image"), py::arg("keep_stages") = false,
+       "Run the algorithm on a grayscale image. With keep_stages, stages whose parameters did not change since "
+       "the last run on the same array with unchanged pixels are reused.");
+    segmentation.def("invalidate", &Segmentation::Invalidate);
+    segmentation.def_property_readonly("crown_curves", &Segmentation::getCrownCurves);
+    segmentation.def_property_readonly("necks_curves", &Segmentation::getNecksCurves);
+    segmentation.def_property_readonly("crown_regions", [](Segmentation& self) {
+        return RectsToTuples(self.getCrownRegions());
+    });
+    DefineParameter<int>(segmentation, "column_spacing",
+                         &Segmentation::getLineProfileColumnSpacing, &Segmentation::setLineProfileColumnSpacing);
+    DefineParameter<int>(segmentation, "derivative_distance",
+                         &Segmentation::getLineProfileDerivativeDistance, &Segmentation::setLineProfileDerivativeDistance);
+    DefineParameter<float>(segmentation, "spline_pct_sample_size",
+                           &Segmentation::getSplinePctSampleSize, &Segmentation::setSplinePctSampleSize);
+    DefineParameter<float>(segmentation, "neck_sd_threshold",
+                           &Segmentation::getNecksCurvesStdDevThreshold, &Segmentation::setNecksCurvesStdDevThreshold);
+    DefineParameter<int>(segmentation, "binarization_n_segments",
+                         &Segmentation::getCrownBinarizationNumOfSegments, &Segmentation::setCrownBinarizationNumOfSegments);
+    DefineParameter<float>(segmentation, "binarization_pct_threshold",
+                           &Segmentation::getCrownBinarizationPctThreshold, &Segmentation::setCrownBinarizationPctThreshold);
+    DefineParameter<int>(segmentation, "pyramid_levels",
+                         &Segmentation::getPyramidLevels, &Segmentation::setPyramidLevels);
+
+    //// TRACING ////
+    py::class_<Tracing> tracing(m, "Tracing");
+    tracing.def(py::init<>());
+    tracing.def("process_teeth", [](Tracing& self, const py::array& image, const std::vector< std::tuple<int, int, int, int> >& regions) {
+        ImageArray pixels = CheckImage(image);
+        cv::Mat input = ArrayToMat(pixels);
+        std::vector<cv::Rect> rects = TuplesToRects(regions);
+        std::vector< std::vector<cv::Point> > contours;
+        py::list output;
+        size_t i;
+        CheckGrayscale(input);
+        for (i = 0; i < rects.size(); i++) {
+            if (rects[i].width <= 0 || rects[i].height <= 0)
+                throw py::value_error("Expected regions of positive width and height");
+            if ((rects[i] & cv::Rect(0, 0, input.cols, input.rows)) != rects[i])
+                throw py::index_error("Region " + std::to_string(i) + " reaches outside the image");
+        }
+        {
+            py::gil_scoped_release release;
+            contours = self.ProcessTeeth(input, rects);
+        }
+        for (i = 0; i < contours.size(); i++)
+            output.append(PointsToArray(contours[i]));
+        return output;
+    }, py::arg("image"), py::arg("regions"),
+       "Trace each (x, y, width, height) tooth region concurrently. Returns one contour of shape (n, 2) per region.");
+    DefineParameter<int>(tracing, "slope_angle_distance",
+                         &Tracing::getSlopeAngleDistance, &Tracing::setSlopeAngleDistance);
+    DefineParameter<int>(tracing, "first_pixel_intensity_threshold",
+                         &Tracing::getFirstPixelIntensityThreshold, &Tracing::setFirstPixelIntensityThreshold);
+    DefineParameter<int>(tracing, "first_pixel_inner_margin",
+                         &Tracing::getFirstPixelInnerMargin, &Tracing::setFirstPixelInnerMargin);
+    DefineParameter<int>(tracing, "first_pixel_n_candidates",
+                         &Tracing::getFirstPixelNumCandidates, &Tracing::setFirstPixelNumCandidates);
+    DefineParameter<float>(tracing, "crown_tracing_max_pct_height",
+                           &Tracing::getCrownTracingMaxPctHeight, &Tracing::setCrownTracingMaxPctHeight);
+    DefineParameter<int>(tracing, "crown_tracing_extrapolation_distance",
+                         &Tracing::getCrownTracingExtrapolationDistance, &Tracing::setCrownTracingExtrapolationDistance);
+    DefineParameter<int>(tracing, "crown_tracing_extrapolation_mask",
+                         &Tracing::getCrownTracingExtrapolationMask, &Tracing::setCrownTracingExtrapolationMask);
+    DefineParameter<int>(tracing, "tracing_engine",
+                         &Tracing::getTracingEngine, &Tracing::setTracingEngine);
+}
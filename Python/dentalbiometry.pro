@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# Python module of the Model layer
+#
+# Build with: qmake && make
+# Then: PYTHONPATH=<build directory> python3 -c "import dentalbiometry"
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = dentalbiometry
+TEMPLATE = lib
+
+CONFIG += plugin no_plugin_name_prefix
+CONFIG -= qt
+
+include(../common.pri)
+
+# Python extension modules are named like dentalbiometry.cpython-311-x86_64-linux-gnu.so
+PYTHON = python3
+PYTHON_EXTENSION_SUFFIX = $$system($${PYTHON}-config --extension-suffix)
+QMAKE_EXTENSION_SHLIB = $$replace(PYTHON_EXTENSION_SUFFIX, ^\\., )
+QMAKE_CXXFLAGS += $$system($${PYTHON} -m pybind11 --includes) -fvisibility=hidden
+# Symbols of the interpreter are resolved when the module is imported
+macx: QMAKE_LFLAGS += -undefined dynamic_lookup
+
+# The core library is not position independent, so its sources are compiled into the module
+include(../Core/sources.pri)
+
+# POSIX shared memory of the processing service
+unix:!macx: LIBS += -lrt
+
+SOURCES += \
+    dentalbiometry.cpp
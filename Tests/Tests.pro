@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Behavioural tests of the core library, without Qt. `make check` runs them.
+#
+#-------------------------------------------------
+
+TARGET = tests
+TEMPLATE = app
+
+CONFIG += console testcase
+CONFIG -= qt app_bundle
+
+include(../common.pri)
+include(../Core/core.pri)
+
+HEADERS += \
+    test.h
+
+SOURCES += \
+    main.cpp \
+    tst_boundedqueue.cpp \
+    tst_cpudispatch.cpp \
+    tst_curve.cpp \
+    tst_dicomreader.cpp \
+    tst_helpers.cpp \
+    tst_livewire.cpp \
+    tst_segmentation.cpp \
+    tst_threadpool.cpp
@@ -0,0 +1,52 @@
+#include "test.h"
+#include <cstring>
+#include <exception>
+
+// Get the registered test cases
+std::vector<TestCase>& TestCases() {
+    static std::vector<TestCase> test_cases;
+    return test_cases;
+}
+
+// Get number of failed checks
+int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+// Run every test case, or those whose name is given as an argument
+int main(int argc, char *argv[])
+{
+    int n_failed = 0, n_run = 0, failures, i, j;
+    bool selected;
+
+    for (i = 0; i < (int)TestCases().size(); i++) {
+        selected = (argc < 2);
+        for (j = 1; j < argc && !selected; j++)
+            selected = std::strcmp(argv[j], TestCases().at(i).name) == 0;
+        if (!selected)
+            continue;
+
+        failures = TestFailures();
+        // An exception fails the test case, and the next ones still run
+        try {
+            TestCases().at(i).run();
+        } catch (const std::exception& e) {
+            TestFailures()++;
+            std::cout << TestCases().at(i).name << " threw: " << e.what() << std::endl;
+        } catch (...) {
+            TestFailures()++;
+            std::cout << TestCases().at(i).name << " threw" << std::endl;
+        }
+        n_run++;
+        if (TestFailures() != failures) {
+            n_failed++;
+            std::cout << "FAIL " << TestCases().at(i).name << std::endl;
+        } else {
+            std::cout << "PASS " << TestCases().at(i).name << std::endl;
+        }
+    }
+    std::cout << n_run - n_failed << " passed, " << n_failed << " failed" << std::endl;
+
+    return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <iostream>
+#include <vector>
+
+// Minimal test harness. Core is built without Qt, so the tests do not use QtTest.
+// TEST(name) defines a test case, registered at startup and run by main.
+// CHECK reports a failed condition and lets the test case go on.
+
+// Test case registered by TEST
+struct TestCase {
+    const char *name;
+    void (*run)();
+};
+
+// Get the registered test cases
+std::vector<TestCase>& TestCases();
+
+// Get number of failed checks
+int& TestFailures();
+
+// Register a test case from a static initializer
+struct TestRegistration {
+    TestRegistration(const char *name, void (*run)()) {
+        TestCase test_case = {name, run};
+        TestCases().push_back(test_case);
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            TestFailures()++; \
+            std::cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+        } \
+    } while (0)
+
+// Check that an expression throws an exception of a given type
+#define CHECK_THROWS(expression, type) \
+    do { \
+        bool thrown = false; \
+        try { \
+            expression; \
+        } catch (const type&) { \
+            thrown = true; \
+        } catch (...) { \
+        } \
+        if (!thrown) { \
+            TestFailures()++; \
+            std::cout << __FILE__ << ":" << __LINE__ << ": " #expression " did not throw " #type << std::endl; \
+        } \
+    } while (0)
+
+#endif // TEST_H
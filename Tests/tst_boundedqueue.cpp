@@ -0,0 +1,144 @@
+#include "test.h"
+#include "Model/boundedqueue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+// Time given to a thread to block before the test checks it is still blocked
+const std::chrono::milliseconds SETTLE_TIME(50);
+}
+
+// Items come out in the order they went in, and the capacity is at least one
+TEST(QueueKeepsOrder) {
+    BoundedQueue<int> queue(3);
+    int item;
+
+    CHECK(BoundedQueue<int>(0).getCapacity() == 1);
+    CHECK(!queue.TryPop(item));
+    CHECK(queue.Push(1));
+    CHECK(queue.Push(2));
+    CHECK(queue.Push(3));
+    CHECK(queue.getSize() == 3);
+    CHECK(queue.Pop(item) && item == 1);
+    CHECK(queue.TryPop(item) && item == 2);
+    CHECK(queue.Pop(item) && item == 3);
+    CHECK(queue.getSize() == 0);
+}
+
+// A producer blocks while the queue is full and goes on when an item is taken
+TEST(QueuePushBlocksWhileFull) {
+    BoundedQueue<int> queue(1);
+    std::atomic<bool> pushed(false);
+    std::thread producer;
+    int item;
+
+    CHECK(queue.Push(1));
+    producer = std::thread([&queue, &pushed]() {
+        pushed = queue.Push(2);
+    });
+    std::this_thread::sleep_for(SETTLE_TIME);
+    CHECK(!pushed);
+
+    CHECK(queue.Pop(item) && item == 1);
+    producer.join();
+    CHECK(pushed);
+    CHECK(queue.Pop(item) && item == 2);
+}
+
+// Closing wakes blocked consumers and producers. Items queued before are still taken, new ones are refused.
+TEST(QueueCloseWakesWaiters) {
+    BoundedQueue<int> empty_queue(1), full_queue(1);
+    std::atomic<int> popped(-1), pushed(-1);
+    std::thread consumer, producer;
+    int item;
+
+    consumer = std::thread([&empty_queue, &popped]() {
+        int value;
+        popped = empty_queue.Pop(value) ? 1 : 0;
+    });
+    CHECK(full_queue.Push(1));
+    producer = std::thread([&full_queue, &pushed]() {
+        pushed = full_queue.Push(2) ? 1 : 0;
+    });
+    std::this_thread::sleep_for(SETTLE_TIME);
+
+    empty_queue.Close();
+    full_queue.Close();
+    consumer.join();
+    producer.join();
+    CHECK(popped == 0);
+    CHECK(pushed == 0);
+
+    CHECK(!full_queue.Push(3));
+    CHECK(full_queue.Pop(item) && item == 1);
+    CHECK(!full_queue.Pop(item));
+}
+
+// A producer waiting for room gives up once its cancel flag is set
+TEST(QueuePushCancelled) {
+    BoundedQueue<int> queue(1);
+    std::atomic<bool> cancelled(false);
+    std::atomic<int> pushed(-1);
+    std::thread producer;
+    int item;
+
+    CHECK(queue.Push(1));
+    producer = std::thread([&queue, &cancelled, &pushed]() {
+        pushed = queue.Push(2, cancelled, std::chrono::milliseconds(5)) ? 1 : 0;
+    });
+    std::this_thread::sleep_for(SETTLE_TIME);
+    CHECK(pushed == -1);
+
+    cancelled = true;
+    producer.join();
+    CHECK(pushed == 0);
+    CHECK(queue.getSize() == 1);
+
+    // Not checked while there is room
+    CHECK(queue.Pop(item) && item == 1);
+    CHECK(queue.Push(3, cancelled, std::chrono::milliseconds(5)));
+}
+
+// Items of several producers all reach the consumers once, each producer's items in order
+TEST(QueueManyProducersAndConsumers) {
+    const int n_producers = 4, n_consumers = 3, n_items = 2000;
+    BoundedQueue<int> queue(8);
+    std::vector<std::thread> producers, consumers;
+    std::vector< std::vector<int> > received(n_consumers);
+    std::vector<int> counts(n_producers * n_items, 0), last(n_producers);
+    bool ordered;
+    int i, j;
+
+    for (i = 0; i < n_consumers; i++)
+        consumers.push_back(std::thread([&queue, &received, i]() {
+            int item;
+            while (queue.Pop(item))
+                received.at(i).push_back(item);
+        }));
+    for (i = 0; i < n_producers; i++)
+        producers.push_back(std::thread([&queue, i]() {
+            int j;
+            for (j = 0; j < n_items; j++)
+                queue.Push(i * n_items + j);
+        }));
+    for (i = 0; i < n_producers; i++)
+        producers.at(i).join();
+    queue.Close();
+    for (i = 0; i < n_consumers; i++)
+        consumers.at(i).join();
+
+    ordered = true;
+    for (i = 0; i < n_consumers; i++) {
+        std::fill(last.begin(), last.end(), -1);
+        for (j = 0; j < (int)received.at(i).size(); j++) {
+            counts.at(received.at(i).at(j))++;
+            ordered = ordered && received.at(i).at(j) > last.at(received.at(i).at(j) / n_items);
+            last.at(received.at(i).at(j) / n_items) = received.at(i).at(j);
+        }
+    }
+    CHECK(counts == std::vector<int>(n_producers * n_items, 1));
+    CHECK(ordered);
+}
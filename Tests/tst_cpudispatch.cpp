@@ -0,0 +1,122 @@
+#include "test.h"
+#include "Model/cpudispatch.h"
+#include "Model/filters.h"
+#include "Model/helpers.h"
+#include "Model/histogram.h"
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace {
+// Results of the callers of the pixel kernels on one image
+struct CallerResults {
+    std::vector<int> histogram;
+    std::vector<int> roi_histogram;
+    std::vector<int> profile;
+    std::vector<double> derivative_sds;
+    std::vector<int> neighbor_sums;
+    std::vector<int> first_indexes;
+    cv::Mat polygon_binarization;
+};
+
+// Random image whose width is not a multiple of any vector width, so every kernel has tails
+cv::Mat RandomImage() {
+    cv::Mat img(301, 517, CV_8U);
+    cv::RNG rng(1234);
+
+    rng.fill(img, cv::RNG::UNIFORM, 0, 256);
+
+    return img;
+}
+
+// Random points inside an image, ending with the corner pixels whose 32-bit words reach past the image
+std::vector<cv::Point> RandomPoints(const cv::Mat& img) {
+    std::vector<cv::Point> points;
+    cv::RNG rng(5678);
+    int i;
+
+    for (i = 0; i < 1000; i++)
+        points.push_back(cv::Point(rng.uniform(0, img.cols), rng.uniform(0, img.rows)));
+    points.push_back(cv::Point(img.cols - 2, img.rows - 1));
+    points.push_back(cv::Point(img.cols - 1, img.rows - 1));
+
+    return points;
+}
+
+// Run the Helpers, Histogram and Filters functions that use the kernels, at the active level
+CallerResults RunCallers(cv::Mat& img, const std::vector<cv::Point>& points) {
+    const cv::Point polygon[] = {cv::Point(20, 30), cv::Point(400, 10), cv::Point(500, 250), cv::Point(60, 290)};
+    CallerResults results;
+    cv::Mat roi = img(cv::Rect(3, 5, 301, 200));
+    int n, d, k, y;
+
+    results.histogram = Histogram::GetHistogram(img);
+    // Rows of a region are not contiguous, so they are counted one at a time
+    results.roi_histogram = Histogram::GetHistogram(roi);
+    results.profile = Helpers::GrayscaleProfile(img, points);
+
+    for (n = 0; n <= (int)points.size(); n += 37)
+        for (d = 1; d <= 9; d += 4)
+            results.derivative_sds.push_back(Helpers::ProfileDerivativeStandardDeviation(
+                img, std::vector<cv::Point>(points.end() - n, points.end()), d));
+
+    for (k = 1; k <= 67; k += 2)
+        results.neighbor_sums.push_back(Helpers::SumOfNeighbors(img, cv::Point(img.cols / 2, img.rows / 2), k));
+
+    for (y = 0; y < img.rows; y++)
+        results.first_indexes.push_back(Helpers::FirstIndexAboveThreshold(img.ptr<uchar>(y), img.cols,
+                                                                          (uchar)(200 + y % 56)));
+
+    results.polygon_binarization = Filters::PolygonBinarization(img, polygon, 4, 0.3);
+
+    return results;
+}
+
+// Check if two 8-bit images have the same pixels
+bool SameImage(const cv::Mat& a, const cv::Mat& b) {
+    return a.size() == b.size() && a.type() == b.type() && cv::norm(a, b, cv::NORM_INF) == 0;
+}
+}
+
+// Every level this CPU supports gives the results of the scalar kernels through the real callers,
+// including regions, profile tails and pixels at the end of the image
+TEST(KernelLevelsMatchScalar) {
+    CpuDispatch::Level original = CpuDispatch::getLevel();
+    cv::Mat img = RandomImage();
+    std::vector<cv::Point> points = RandomPoints(img);
+    CallerResults expected, results;
+    int level;
+
+    CHECK(CpuDispatch::setLevel(CpuDispatch::LEVEL_SCALAR));
+    expected = RunCallers(img, points);
+
+    for (level = CpuDispatch::LEVEL_SSE42; level <= CpuDispatch::getSupportedLevel(); level++) {
+        std::cout << "Level " << CpuDispatch::LevelName((CpuDispatch::Level)level) << std::endl;
+        CHECK(CpuDispatch::setLevel((CpuDispatch::Level)level));
+        results = RunCallers(img, points);
+
+        CHECK(results.histogram == expected.histogram);
+        CHECK(results.roi_histogram == expected.roi_histogram);
+        CHECK(results.profile == expected.profile);
+        CHECK(results.derivative_sds == expected.derivative_sds);
+        CHECK(results.neighbor_sums == expected.neighbor_sums);
+        CHECK(results.first_indexes == expected.first_indexes);
+        CHECK(SameImage(results.polygon_binarization, expected.polygon_binarization));
+    }
+
+    CpuDispatch::setLevel(original);
+}
+
+// Levels above the supported one are refused
+TEST(UnsupportedLevelIsRefused) {
+    CpuDispatch::Level original = CpuDispatch::getLevel();
+
+    if (CpuDispatch::getSupportedLevel() < CpuDispatch::LEVEL_AVX512)
+        CHECK(!CpuDispatch::setLevel((CpuDispatch::Level)(CpuDispatch::getSupportedLevel() + 1)));
+    CHECK(!CpuDispatch::setLevel(CpuDispatch::N_LEVELS));
+    CHECK(CpuDispatch::getLevel() == original);
+}
+
+// The kernel tables of every supported level agree with the scalar ones on random data
+TEST(KernelCrossCheck) {
+    CHECK(CpuDispatch::CrossCheck());
+}
@@ -0,0 +1,130 @@
+#include "test.h"
+#include "Model/curve.h"
+#include <climits>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace {
+// Curve with rows spread over [-60, 60), long enough for the vector loops and their remainders
+Curve SpreadCurve(const int& x0, const int& n) {
+    Curve curve(x0, n);
+    int i;
+
+    for (i = 0; i < n; i++)
+        curve.setY(i, (i * 37) % 120 - 60);
+
+    return curve;
+}
+
+// Image whose pixel values identify their row and column
+cv::Mat NumberedImage(const int& rows, const int& cols) {
+    cv::Mat img(rows, cols, CV_8U, cv::Scalar(0));
+    int x, y;
+
+    for (y = 0; y < rows; y++)
+        for (x = 0; x < cols; x++)
+            img.at<uchar>(y, x) = (uchar)((y * 41 + x) % 256);
+
+    return img;
+}
+}
+
+// Rows are translated then clamped to the bounds, saturating instead of wrapping around 16 bits
+TEST(CurveTranslateSaturates) {
+    const int n = 29;
+    Curve original = SpreadCurve(3, n), curve;
+    bool ok;
+    int i;
+
+    curve = original;
+    curve.Translate(25, 0, 49);
+    ok = true;
+    for (i = 0; i < n; i++)
+        ok = ok && curve.y(i) == std::min(49, std::max(0, original.y(i) + 25));
+    CHECK(ok);
+
+    // Far above and below the image
+    curve = original;
+    curve.Translate(-1000, 0, 49);
+    ok = true;
+    for (i = 0; i < n; i++)
+        ok = ok && curve.y(i) == 0;
+    CHECK(ok);
+    curve = original;
+    curve.Translate(1000, 0, 49);
+    ok = true;
+    for (i = 0; i < n; i++)
+        ok = ok && curve.y(i) == 49;
+    CHECK(ok);
+
+    // Beyond the range of the rows, with bounds beyond it too
+    curve = original;
+    curve.Translate(30000, INT_MIN, INT_MAX);
+    curve.Translate(30000, INT_MIN, INT_MAX);
+    ok = true;
+    for (i = 0; i < n; i++)
+        ok = ok && curve.y(i) == SHRT_MAX;
+    CHECK(ok);
+    curve = original;
+    curve.Translate(-30000, INT_MIN, INT_MAX);
+    curve.Translate(-30000, INT_MIN, INT_MAX);
+    ok = true;
+    for (i = 0; i < n; i++)
+        ok = ok && curve.y(i) == SHRT_MIN;
+    CHECK(ok);
+    CHECK(curve.getFirstColumn() == 3 && curve.size() == n);
+}
+
+// Clamping keeps rows inside the bounds and leaves the others
+TEST(CurveClamp) {
+    const int n = 21;
+    Curve original = SpreadCurve(0, n), curve = original;
+    bool ok;
+    int i;
+
+    curve.Clamp(-10, 10);
+    ok = true;
+    for (i = 0; i < n; i++)
+        ok = ok && curve.y(i) == std::min(10, std::max(-10, original.y(i)));
+    CHECK(ok);
+}
+
+// Gather reads the pixel under each element, through the dispatched kernel when there is no mask
+TEST(CurveGather) {
+    cv::Mat img = NumberedImage(60, 700);
+    Curve curve = SpreadCurve(5, 600);
+    std::vector<uchar> values;
+    bool ok;
+    int i;
+
+    curve.Translate(60, 0, 59);
+    curve.Gather(img, values);
+    CHECK(values.size() == 600);
+    ok = true;
+    for (i = 0; i < curve.size(); i++)
+        ok = ok && values.at(i) == img.at<uchar>(curve.y(i), 5 + i);
+    CHECK(ok);
+}
+
+// Invalid elements are skipped, and the values of the valid ones are packed in column order
+TEST(CurveGatherMask) {
+    cv::Mat img = NumberedImage(60, 320);
+    Curve curve = SpreadCurve(10, 300);
+    std::vector<uchar> values, expected;
+    uchar buffer[300];
+    int i;
+
+    curve.Clamp(0, 59);
+    CHECK(!curve.hasMask());
+    for (i = 0; i < curve.size(); i++) {
+        curve.setValid(i, i % 3 != 1);
+        if (curve.isValid(i))
+            expected.push_back(img.at<uchar>(curve.y(i), 10 + i));
+    }
+    CHECK(curve.hasMask());
+
+    curve.Gather(img, values);
+    CHECK(values == expected);
+    CHECK(curve.Gather(img, buffer) == (int)expected.size());
+    CHECK(std::vector<uchar>(buffer, buffer + expected.size()) == expected);
+}
@@ -0,0 +1,255 @@
+#include "test.h"
+#include "Model/dicomreader.h"
+#include <clocale>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <locale>
+#include <stdexcept>
+#include <string>
+#include <opencv2/core.hpp>
+
+namespace {
+// Transfer syntaxes written by the tests
+const std::string IMPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2";
+const std::string EXPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2.1";
+const std::string JPEG_BASELINE = "1.2.840.10008.1.2.4.50";
+// Length of sequences and items delimited by an end tag
+const uint32_t UNDEFINED_LENGTH = 0xFFFFFFFF;
+// File the tests write, in the working directory
+const char *TEST_FILE = "tst_dicomreader.dcm";
+
+// Little-endian bytes of a value
+std::string Bytes(const uint32_t& value, const int& n_bytes) {
+    std::string bytes;
+    int i;
+
+    for (i = 0; i < n_bytes; i++)
+        bytes += (char)((value >> (8 * i)) & 0xFF);
+    return bytes;
+}
+
+// Data element in explicit VR. Long VRs get a 4 byte length after 2 reserved bytes.
+std::string ExplicitElement(const uint16_t& group, const uint16_t& element, const std::string& vr,
+                            const std::string& value, const uint32_t& length = 0) {
+    bool long_vr = vr == "OB" || vr == "OW" || vr == "SQ" || vr == "UN" || vr == "UT";
+    uint32_t stored_length = (length != 0) ? length : (uint32_t)value.size();
+
+    return Bytes(group, 2) + Bytes(element, 2) + vr
+            + (long_vr ? Bytes(0, 2) + Bytes(stored_length, 4) : Bytes(stored_length, 2)) + value;
+}
+
+// Data element in implicit VR, also used for items and delimiters
+std::string ImplicitElement(const uint16_t& group, const uint16_t& element, const std::string& value,
+                            const uint32_t& length = 0) {
+    return Bytes(group, 2) + Bytes(element, 2) + Bytes((length != 0) ? length : (uint32_t)value.size(), 4) + value;
+}
+
+// Text value padded to an even length, as DICOM stores them
+std::string Text(const std::string& text) {
+    return (text.size() % 2 == 0) ? text : text + " ";
+}
+
+// Preamble, prefix and transfer syntax, followed by a data set
+std::string DicomFile(const std::string& transfer_syntax, const std::string& data_set) {
+    std::string syntax = transfer_syntax;
+
+    if (syntax.size() % 2 != 0)
+        syntax += '\0';
+    return std::string(128, '\0') + "DICM" + ExplicitElement(0x0002, 0x0010, "UI", syntax) + data_set;
+}
+
+// Image header of an explicit VR data set
+std::string ImageHeader(const int& rows, const int& cols, const int& bits_allocated, const int& pixel_representation) {
+    return ExplicitElement(0x0028, 0x0002, "US", Bytes(1, 2))
+            + ExplicitElement(0x0028, 0x0004, "CS", Text("MONOCHROME2"))
+            + ExplicitElement(0x0028, 0x0010, "US", Bytes(rows, 2))
+            + ExplicitElement(0x0028, 0x0011, "US", Bytes(cols, 2))
+            + ExplicitElement(0x0028, 0x0100, "US", Bytes(bits_allocated, 2))
+            + ExplicitElement(0x0028, 0x0103, "US", Bytes(pixel_representation, 2));
+}
+
+// Pixel data of 16 bit values 0, 1, 2...
+std::string Ramp16(const int& n) {
+    std::string pixels;
+    int i;
+
+    for (i = 0; i < n; i++)
+        pixels += Bytes(i, 2);
+    return pixels;
+}
+
+// Write a file and read it with DicomReader::Read
+bool ReadBytes(const std::string& bytes, cv::Mat& pixels, DisplayWindow& window) {
+    std::ofstream file(TEST_FILE, std::ios::binary | std::ios::trunc);
+    bool read;
+
+    file.write(bytes.data(), bytes.size());
+    file.close();
+    pixels.release();
+    read = DicomReader::Read(TEST_FILE, pixels, window);
+    std::remove(TEST_FILE);
+
+    return read;
+}
+}
+
+// Pixels are wrapped with the stored type, and the window, rescale and photometric interpretation are read
+TEST(DicomReadsPixelsAndWindow) {
+    cv::Mat pixels;
+    DisplayWindow window;
+    std::string data_set;
+
+    data_set = ExplicitElement(0x0028, 0x0002, "US", Bytes(1, 2))
+            + ExplicitElement(0x0028, 0x0004, "CS", Text("MONOCHROME1"))
+            + ExplicitElement(0x0028, 0x0010, "US", Bytes(2, 2))
+            + ExplicitElement(0x0028, 0x0011, "US", Bytes(3, 2))
+            + ExplicitElement(0x0028, 0x0100, "US", Bytes(16, 2))
+            + ExplicitElement(0x0028, 0x0103, "US", Bytes(0, 2))
+            + ExplicitElement(0x0028, 0x1050, "DS", Text("40.5\\60"))
+            + ExplicitElement(0x0028, 0x1051, "DS", Text(" 400"))
+            + ExplicitElement(0x0028, 0x1052, "DS", Text("-1024"))
+            + ExplicitElement(0x0028, 0x1053, "DS", Text("2.5"))
+            + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(6));
+
+    CHECK(ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, data_set), pixels, window));
+    CHECK(pixels.rows == 2 && pixels.cols == 3 && pixels.type() == CV_16U);
+    CHECK(!pixels.empty() && pixels.at<ushort>(0, 0) == 0 && pixels.at<ushort>(1, 2) == 5);
+    CHECK(window.center == 40.5);
+    CHECK(window.width == 400);
+    CHECK(window.intercept == -1024);
+    CHECK(window.slope == 2.5);
+    CHECK(window.inverted);
+}
+
+// Pixel representation 1 gives signed pixels, and 8 bit pixels are read as bytes
+TEST(DicomReadsPixelTypes) {
+    cv::Mat pixels;
+    DisplayWindow window;
+
+    CHECK(ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, ImageHeader(2, 2, 16, 1)
+                              + ExplicitElement(0x7FE0, 0x0010, "OW", Bytes(0xFFFF, 2) + Ramp16(3))),
+                    pixels, window));
+    CHECK(pixels.type() == CV_16S && !pixels.empty() && pixels.at<short>(0, 0) == -1);
+    // No window stored
+    CHECK(window.width == 0 && window.slope == 1 && !window.inverted);
+
+    CHECK(ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, ImageHeader(2, 2, 8, 0)
+                              + ExplicitElement(0x7FE0, 0x0010, "OB", "\x01\x02\x03\x04")),
+                    pixels, window));
+    CHECK(pixels.type() == CV_8U && !pixels.empty() && pixels.at<uchar>(1, 1) == 4);
+}
+
+// Implicit VR data sets are read, with the file meta group still in explicit VR
+TEST(DicomReadsImplicitVR) {
+    cv::Mat pixels;
+    DisplayWindow window;
+    std::string data_set;
+
+    data_set = ImplicitElement(0x0028, 0x0010, Bytes(2, 2))
+            + ImplicitElement(0x0028, 0x0011, Bytes(2, 2))
+            + ImplicitElement(0x0028, 0x0100, Bytes(16, 2))
+            + ImplicitElement(0x0028, 0x1050, Text("100"))
+            + ImplicitElement(0x7FE0, 0x0010, Ramp16(4));
+
+    CHECK(ReadBytes(DicomFile(IMPLICIT_VR_LITTLE_ENDIAN, data_set), pixels, window));
+    CHECK(pixels.rows == 2 && pixels.cols == 2 && pixels.type() == CV_16U);
+    CHECK(window.center == 100);
+}
+
+// Sequences of undefined length are skipped, and the elements of their items are not taken as the image header
+TEST(DicomSkipsSequences) {
+    cv::Mat pixels;
+    DisplayWindow window;
+    std::string item, data_set;
+
+    item = ImplicitElement(0xFFFE, 0xE000, "", UNDEFINED_LENGTH)
+            + ExplicitElement(0x0028, 0x0010, "US", Bytes(999, 2))
+            + ImplicitElement(0xFFFE, 0xE00D, "");
+    data_set = ImageHeader(2, 2, 16, 0)
+            + ExplicitElement(0x0008, 0x1140, "SQ", "", UNDEFINED_LENGTH) + item
+            + ImplicitElement(0xFFFE, 0xE0DD, "")
+            + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(4));
+
+    CHECK(ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, data_set), pixels, window));
+    CHECK(pixels.rows == 2 && pixels.cols == 2);
+}
+
+// Window values are read the same whatever the locale of the user, e.g. one with a decimal comma
+TEST(DicomParsesDecimalsInCLocale) {
+    const char *comma_locales[] = {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8"};
+    cv::Mat pixels;
+    DisplayWindow window;
+    std::string data_set;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(comma_locales) / sizeof(comma_locales[0])); i++) {
+        if (std::setlocale(LC_ALL, comma_locales[i]) == 0)
+            continue;
+        try {
+            std::locale::global(std::locale(comma_locales[i]));
+        } catch (const std::runtime_error&) {
+        }
+        break;
+    }
+
+    data_set = ImageHeader(1, 2, 16, 0)
+            + ExplicitElement(0x0028, 0x1050, "DS", Text("40.5"))
+            + ExplicitElement(0x0028, 0x1051, "DS", Text("1e3"))
+            + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(2));
+    CHECK(ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, data_set), pixels, window));
+    CHECK(window.center == 40.5);
+    CHECK(window.width == 1000);
+
+    std::setlocale(LC_ALL, "C");
+    std::locale::global(std::locale::classic());
+}
+
+// Header elements too short for their value refuse the image instead of reading past them
+TEST(DicomRejectsTruncatedElements) {
+    const uint16_t short_elements[] = {0x0002, 0x0010, 0x0011, 0x0100};
+    cv::Mat pixels;
+    DisplayWindow window;
+    std::string data_set;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(short_elements) / sizeof(short_elements[0])); i++) {
+        // One byte values after the good ones, followed by an element starting with a 0 byte,
+        // so reading two bytes would still find the value of the good element
+        data_set = ImageHeader(2, 2, 16, 0)
+                + ExplicitElement(0x0028, short_elements[i], "US", std::string(1, (i == 3) ? '\x10' : '\x01'))
+                + ExplicitElement(0x0000, 0x0000, "UL", Bytes(0, 4))
+                + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(4));
+        CHECK(!ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, data_set), pixels, window));
+    }
+
+    // An element longer than the rest of the file ends the header
+    data_set = ImageHeader(2, 2, 16, 0) + ExplicitElement(0x0028, 0x1050, "DS", "", 0xFFF0);
+    CHECK(!ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, data_set), pixels, window));
+}
+
+// Files this reader does not handle are refused
+TEST(DicomRejectsUnsupportedFiles) {
+    cv::Mat pixels;
+    DisplayWindow window;
+    std::string image;
+
+    image = ImageHeader(2, 2, 16, 0) + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(4));
+
+    // No DICM prefix
+    CHECK(!ReadBytes(std::string(200, '\0'), pixels, window));
+    // Compressed transfer syntax
+    CHECK(!ReadBytes(DicomFile(JPEG_BASELINE, image), pixels, window));
+    // Pixel data shorter than the image
+    CHECK(!ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, ImageHeader(2, 2, 16, 0)
+                               + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(3))), pixels, window));
+    // Color pixels
+    CHECK(!ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, ImageHeader(2, 2, 16, 0)
+                               + ExplicitElement(0x0028, 0x0002, "US", Bytes(3, 2))
+                               + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(12))), pixels, window));
+    // 32 bit pixels
+    CHECK(!ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, ImageHeader(2, 2, 32, 0)
+                               + ExplicitElement(0x7FE0, 0x0010, "OW", Ramp16(8))), pixels, window));
+    // No pixel data
+    CHECK(!ReadBytes(DicomFile(EXPLICIT_VR_LITTLE_ENDIAN, ImageHeader(2, 2, 16, 0)), pixels, window));
+}
@@ -0,0 +1,67 @@
+#include "test.h"
+#include "Model/helpers.h"
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace {
+// Check if every two pixels are at least min_distance apart
+bool Spaced(const std::vector<cv::Point>& pixels, const int& min_distance) {
+    cv::Point d;
+    int i, j;
+
+    for (i = 0; i < (int)pixels.size(); i++)
+        for (j = i + 1; j < (int)pixels.size(); j++) {
+            d = pixels.at(i) - pixels.at(j);
+            if (d.x * d.x + d.y * d.y < min_distance * min_distance)
+                return false;
+        }
+    return true;
+}
+
+// Check if pixels go from brightest to darkest
+bool Ordered(const cv::Mat& image, const std::vector<cv::Point>& pixels) {
+    int i;
+
+    for (i = 1; i < (int)pixels.size(); i++)
+        if (image.at<uchar>(pixels.at(i)) > image.at<uchar>(pixels.at(i - 1)))
+            return false;
+    return true;
+}
+}
+
+// A bright row gives spaced pixels instead of its first ones, after brighter pixels anywhere in the image
+TEST(BrightestPixelsSpreadAndOrdered) {
+    cv::Mat image(60, 100, CV_8U, cv::Scalar(0));
+    std::vector<cv::Point> pixels, expected;
+    int x;
+
+    for (x = 0; x < image.cols; x++)
+        image.at<uchar>(10, x) = 200;
+    image.at<uchar>(40, 50) = 250;
+    image.at<uchar>(50, 20) = 230;
+    image.at<uchar>(50, 25) = 240;
+
+    pixels = Helpers::BrightestPixels(image, 20, 5, 10);
+    expected.push_back(cv::Point(50, 40));
+    expected.push_back(cv::Point(25, 50));
+    expected.push_back(cv::Point(0, 10));
+    expected.push_back(cv::Point(10, 10));
+    expected.push_back(cv::Point(20, 10));
+    CHECK(pixels == expected);
+    CHECK(Spaced(pixels, 10));
+    CHECK(Ordered(image, pixels));
+}
+
+// Pixels below the threshold are never taken, and fewer pixels than asked are found if there are not enough
+TEST(BrightestPixelsThreshold) {
+    cv::Mat image(30, 70, CV_8U, cv::Scalar(19));
+    std::vector<cv::Point> pixels;
+
+    CHECK(Helpers::BrightestPixels(image, 20, 3, 1).empty());
+
+    image.at<uchar>(5, 5) = 20;
+    image.at<uchar>(25, 65) = 90;
+    pixels = Helpers::BrightestPixels(image, 20, 3, 1);
+    CHECK(pixels.size() == 2);
+    CHECK(pixels.at(0) == cv::Point(65, 25) && pixels.at(1) == cv::Point(5, 5));
+}
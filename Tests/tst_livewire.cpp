@@ -0,0 +1,176 @@
+#include "test.h"
+#include "Model/livewire.h"
+#include <climits>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace {
+// Gradient image with a fixed pattern of values over the whole range
+cv::Mat PatternGradient(const int& rows, const int& cols) {
+    cv::Mat gradient(rows, cols, CV_8U, cv::Scalar(0));
+    int x, y;
+
+    for (y = 0; y < rows; y++)
+        for (x = 0; x < cols; x++)
+            gradient.at<uchar>(y, x) = (uchar)((x * 37 + y * 91 + x * y * 13) % 256);
+
+    return gradient;
+}
+
+// Weight of a step into a neighbor pixel: its cost plus one, times 3/2 for diagonal steps
+int StepWeight(const cv::Mat& gradient, const cv::Point& from, const cv::Point& to) {
+    int weight = 255 - gradient.at<uchar>(to.y, to.x) + 1;
+
+    if (from.x != to.x && from.y != to.y)
+        weight = (weight * 3) / 2;
+    return weight;
+}
+
+// Cost of a path, or -1 if two consecutive pixels are not neighbors
+int PathCost(const cv::Mat& gradient, const std::vector<cv::Point>& path) {
+    cv::Point d;
+    int i, cost;
+
+    cost = 0;
+    for (i = 1; i < (int)path.size(); i++) {
+        d = path.at(i) - path.at(i - 1);
+        if (d.x < -1 || d.x > 1 || d.y < -1 || d.y > 1 || (d.x == 0 && d.y == 0))
+            return -1;
+        cost += StepWeight(gradient, path.at(i - 1), path.at(i));
+    }
+    return cost;
+}
+
+// Distance from the seed to every pixel, by Dijkstra with a binary heap
+std::vector<int> ReferenceDistances(const cv::Mat& gradient, const cv::Point& seed) {
+    typedef std::pair<int, int> Entry;
+    std::priority_queue< Entry, std::vector<Entry>, std::greater<Entry> > queue;
+    std::vector<int> distances(gradient.rows * gradient.cols, INT_MAX);
+    cv::Point p, q;
+    int dx, dy, distance;
+
+    distances.at(seed.y * gradient.cols + seed.x) = 0;
+    queue.push(Entry(0, seed.y * gradient.cols + seed.x));
+    while (!queue.empty()) {
+        distance = queue.top().first;
+        p = cv::Point(queue.top().second % gradient.cols, queue.top().second / gradient.cols);
+        queue.pop();
+        if (distance > distances.at(p.y * gradient.cols + p.x))
+            continue;
+        for (dy = -1; dy <= 1; dy++)
+            for (dx = -1; dx <= 1; dx++) {
+                q = cv::Point(p.x + dx, p.y + dy);
+                if ((dx == 0 && dy == 0) || q.x < 0 || q.y < 0 || q.x >= gradient.cols || q.y >= gradient.rows)
+                    continue;
+                if (distance + StepWeight(gradient, p, q) < distances.at(q.y * gradient.cols + q.x)) {
+                    distances.at(q.y * gradient.cols + q.x) = distance + StepWeight(gradient, p, q);
+                    queue.push(Entry(distances.at(q.y * gradient.cols + q.x), q.y * gradient.cols + q.x));
+                }
+            }
+    }
+
+    return distances;
+}
+
+// Check if the paths to every settled pixel start at the seed and cost the reference distance
+bool SettledPathsAreShortest(LiveWire& livewire, const cv::Mat& gradient, const std::vector<int>& distances) {
+    std::vector<cv::Point> path;
+    int x, y;
+
+    for (y = 0; y < gradient.rows; y++)
+        for (x = 0; x < gradient.cols; x++) {
+            if (!livewire.IsSettled(cv::Point(x, y)))
+                continue;
+            path = livewire.GetPath(cv::Point(x, y));
+            if (path.empty() || path.front() != livewire.getSeed() || path.back() != cv::Point(x, y)
+                    || PathCost(gradient, path) != distances.at(y * gradient.cols + x))
+                return false;
+        }
+    return true;
+}
+}
+
+// Distances run far past the 385 buckets of the queue. The heaviest steps (384, diagonal on a flat image)
+// land in the bucket just before the current one, and every path is still the shortest.
+TEST(LiveWireBucketWrapAround) {
+    cv::Mat flat(24, 31, CV_8U, cv::Scalar(0));
+    cv::Mat pattern = PatternGradient(24, 31);
+    LiveWire livewire;
+
+    livewire.SetImage(flat);
+    CHECK(livewire.SetSeed(cv::Point(12, 10)));
+    livewire.ComputeTree();
+    CHECK(SettledPathsAreShortest(livewire, flat, ReferenceDistances(flat, cv::Point(12, 10))));
+    CHECK(PathCost(flat, livewire.GetPath(cv::Point(0, 0))) > 385 * 10);
+
+    livewire.SetImage(pattern);
+    CHECK(livewire.SetSeed(cv::Point(3, 20)));
+    livewire.ComputeTree();
+    CHECK(SettledPathsAreShortest(livewire, pattern, ReferenceDistances(pattern, cv::Point(3, 20))));
+}
+
+// A tree grown a few pixels at a time has final paths for the pixels settled so far, and ends as a full run
+TEST(LiveWireIncrementalMatchesFullRun) {
+    cv::Mat gradient = PatternGradient(20, 26);
+    std::vector<int> distances = ReferenceDistances(gradient, cv::Point(7, 5));
+    LiveWire incremental, full;
+    bool partial_ok, growing;
+    int x, y;
+
+    full.SetImage(gradient);
+    full.SetSeed(cv::Point(7, 5));
+    full.ComputeTree();
+
+    incremental.SetImage(gradient);
+    incremental.SetSeed(cv::Point(7, 5));
+    partial_ok = true;
+    growing = true;
+    while (growing) {
+        growing = incremental.GrowTree(37);
+        partial_ok = partial_ok && SettledPathsAreShortest(incremental, gradient, distances);
+    }
+    CHECK(partial_ok);
+
+    for (y = 0; y < gradient.rows; y++)
+        for (x = 0; x < gradient.cols; x++)
+            CHECK(incremental.GetPath(cv::Point(x, y)) == full.GetPath(cv::Point(x, y)));
+}
+
+// Diagonal steps weigh 3/2 of a straight one, so they replace two straight steps but not one
+TEST(LiveWireDiagonalWeights) {
+    // Every pixel costs 1, so straight steps weigh 2 and diagonal ones 3
+    cv::Mat gradient(12, 12, CV_8U, cv::Scalar(254));
+    LiveWire livewire;
+
+    livewire.SetImage(gradient);
+    CHECK(livewire.SetSeed(cv::Point(1, 1)));
+    livewire.ComputeTree();
+
+    // Straight diagonal line
+    CHECK(livewire.GetPath(cv::Point(6, 6)).size() == 6);
+    CHECK(PathCost(gradient, livewire.GetPath(cv::Point(6, 6))) == 5 * 3);
+    // Straight row
+    CHECK(livewire.GetPath(cv::Point(6, 1)).size() == 6);
+    CHECK(PathCost(gradient, livewire.GetPath(cv::Point(6, 1))) == 5 * 2);
+    // Two diagonal and three straight steps
+    CHECK(livewire.GetPath(cv::Point(6, 3)).size() == 6);
+    CHECK(PathCost(gradient, livewire.GetPath(cv::Point(6, 3))) == 2 * 3 + 3 * 2);
+}
+
+// The tree is restricted to the region of interest, clipped to the image
+TEST(LiveWireRegionOfInterest) {
+    cv::Mat gradient = PatternGradient(30, 30);
+    LiveWire livewire;
+
+    livewire.SetImage(gradient, cv::Rect(20, -5, 20, 20));
+    CHECK(livewire.getRegion() == cv::Rect(20, 0, 10, 15));
+    CHECK(!livewire.SetSeed(cv::Point(5, 5)));
+    CHECK(livewire.SetSeed(cv::Point(25, 5)));
+    livewire.ComputeTree();
+    CHECK(livewire.IsSettled(cv::Point(29, 14)));
+    CHECK(!livewire.IsSettled(cv::Point(19, 5)));
+    CHECK(livewire.GetPath(cv::Point(25, 20)).empty());
+}
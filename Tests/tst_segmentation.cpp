@@ -0,0 +1,121 @@
+#include "test.h"
+#include "Model/segmentation.h"
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace {
+// Results of a segmentation run
+struct SegmentationResults {
+    cv::Mat binarized;
+    vector<cv::Point> upper_crowns;
+    vector<cv::Point> lower_crowns;
+    vector<cv::Point> upper_necks;
+    vector<cv::Point> lower_necks;
+    vector<cv::Rect> crown_regions;
+};
+
+// Panoramic-like image: two rows of bright teeth separated by a dark occlusal gap, on a noisy background
+cv::Mat SyntheticPanoramic(const int& teeth_width, const int& gap_row) {
+    cv::Mat img(400, 800, CV_8U, cv::Scalar(40));
+    cv::Mat noise(img.size(), CV_8U);
+    cv::RNG rng(4321);
+    int x;
+
+    for (x = 40; x + teeth_width < img.cols - 40; x += teeth_width + 6) {
+        img(cv::Rect(x, gap_row - 110, teeth_width, 100)).setTo(cv::Scalar(200));
+        img(cv::Rect(x, gap_row + 10, teeth_width, 100)).setTo(cv::Scalar(190));
+    }
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 20);
+    cv::add(img, noise, img);
+
+    return img;
+}
+
+// Run a segmentation and keep its results
+SegmentationResults Run(Segmentation& segmentation, const cv::Mat& img) {
+    SegmentationResults results;
+
+    results.binarized = segmentation.Process(img).clone();
+    results.upper_crowns = segmentation.getCrownCurves().first.ToPoints();
+    results.lower_crowns = segmentation.getCrownCurves().second.ToPoints();
+    results.upper_necks = segmentation.getNecksCurves().first.ToPoints();
+    results.lower_necks = segmentation.getNecksCurves().second.ToPoints();
+    results.crown_regions = segmentation.getCrownRegions();
+
+    return results;
+}
+
+// Check if a cached run gives the results of a run from scratch with the same parameters
+bool MatchesFreshRun(Segmentation& segmentation, const cv::Mat& img) {
+    // The copy has the parameters but none of the cached stages
+    Segmentation fresh(segmentation);
+    SegmentationResults cached = Run(segmentation, img), expected = Run(fresh, img);
+
+    return cached.binarized.size() == expected.binarized.size()
+            && cached.binarized.type() == expected.binarized.type()
+            && cv::norm(cached.binarized, expected.binarized, cv::NORM_INF) == 0
+            && cached.upper_crowns == expected.upper_crowns && cached.lower_crowns == expected.lower_crowns
+            && cached.upper_necks == expected.upper_necks && cached.lower_necks == expected.lower_necks
+            && cached.crown_regions == expected.crown_regions;
+}
+}
+
+// Changing any parameter recomputes the stages it affects and those after, and only gives fresh results
+TEST(StageCacheFollowsParameters) {
+    cv::Mat img = SyntheticPanoramic(40, 200);
+    Segmentation segmentation;
+
+    Run(segmentation, img);
+    CHECK(MatchesFreshRun(segmentation, img));
+
+    CHECK(segmentation.setCrownBinarizationPctThreshold(0.4));
+    CHECK(MatchesFreshRun(segmentation, img));
+    CHECK(segmentation.setCrownBinarizationNumOfSegments(12));
+    CHECK(MatchesFreshRun(segmentation, img));
+    CHECK(segmentation.setNecksCurvesStdDevThreshold(0.3));
+    CHECK(MatchesFreshRun(segmentation, img));
+    CHECK(segmentation.setSplinePctSampleSize(0.5));
+    CHECK(MatchesFreshRun(segmentation, img));
+    CHECK(segmentation.setLineProfileDerivativeDistance(3));
+    CHECK(MatchesFreshRun(segmentation, img));
+    CHECK(segmentation.setLineProfileColumnSpacing(8));
+    CHECK(MatchesFreshRun(segmentation, img));
+    CHECK(segmentation.setPyramidLevels(1));
+    CHECK(MatchesFreshRun(segmentation, img));
+    // Back to a value used before, with stages cached for another one
+    CHECK(segmentation.setPyramidLevels(0));
+    CHECK(MatchesFreshRun(segmentation, img));
+}
+
+// A new image, or the same buffer with pixels changed in place, recomputes every stage
+TEST(StageCacheFollowsInput) {
+    cv::Mat img = SyntheticPanoramic(40, 200);
+    Segmentation segmentation;
+
+    Run(segmentation, img);
+
+    // Same buffer, different pixels
+    SyntheticPanoramic(30, 220).copyTo(img);
+    CHECK(MatchesFreshRun(segmentation, img));
+
+    // Different buffer, same size
+    CHECK(MatchesFreshRun(segmentation, SyntheticPanoramic(50, 190)));
+
+    // Region of an image, not continuous
+    CHECK(MatchesFreshRun(segmentation, img(cv::Rect(0, 0, 600, 400))));
+}
+
+// Invalidate forces a full run, which gives the results of the cached one
+TEST(StageCacheInvalidate) {
+    cv::Mat img = SyntheticPanoramic(40, 200);
+    Segmentation segmentation;
+    SegmentationResults cached, recomputed;
+
+    cached = Run(segmentation, img);
+    segmentation.Invalidate();
+    recomputed = Run(segmentation, img);
+
+    CHECK(cv::norm(cached.binarized, recomputed.binarized, cv::NORM_INF) == 0);
+    CHECK(cached.upper_crowns == recomputed.upper_crowns && cached.lower_crowns == recomputed.lower_crowns);
+    CHECK(cached.crown_regions == recomputed.crown_regions);
+}
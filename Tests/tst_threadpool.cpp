@@ -0,0 +1,103 @@
+#include "test.h"
+#include "Model/threadpool.h"
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// Count the visits of every index of [begin, end) by a ParallelFor
+std::vector<int> CountVisits(const int& begin, const int& end, const int& n_chunks) {
+    std::vector< std::atomic<int> > visits(end > begin ? end - begin : 0);
+    std::vector<int> counts;
+    int i;
+
+    for (i = 0; i < (int)visits.size(); i++)
+        visits.at(i) = 0;
+    ThreadPool::getInstance()->ParallelFor(begin, end, [&visits, begin](int sub_begin, int sub_end) {
+        int j;
+        for (j = sub_begin; j < sub_end; j++)
+            visits.at(j - begin)++;
+    }, n_chunks);
+
+    for (i = 0; i < (int)visits.size(); i++)
+        counts.push_back(visits.at(i));
+    return counts;
+}
+}
+
+// Submitted tasks give their result through the future
+TEST(SubmitReturnsResult) {
+    std::future<int> result = ThreadPool::getInstance()->Submit([]() { return 6 * 7; });
+
+    CHECK(result.get() == 42);
+}
+
+// An exception thrown by a submitted task reaches the caller through the future, and the worker goes on
+TEST(SubmitPropagatesException) {
+    std::future<int> failed = ThreadPool::getInstance()->Submit([]() -> int {
+        throw std::runtime_error("task failed");
+    });
+
+    CHECK_THROWS(failed.get(), std::runtime_error);
+    CHECK(ThreadPool::getInstance()->Submit([]() { return 1; }).get() == 1);
+}
+
+// Every index is visited once, whatever the number of chunks, and an empty range runs nothing
+TEST(ParallelForVisitsEveryIndexOnce) {
+    const int n_chunks[] = {0, 1, 3, 7, 1000, 5000};
+    int i;
+
+    for (i = 0; i < (int)(sizeof(n_chunks) / sizeof(n_chunks[0])); i++)
+        CHECK(CountVisits(-5, 998, n_chunks[i]) == std::vector<int>(1003, 1));
+    CHECK(CountVisits(10, 10, 0).empty());
+    CHECK(CountVisits(10, 3, 0).empty());
+}
+
+// The first exception of a chunk is rethrown by the caller once no chunk runs, and the pool is still usable
+TEST(ParallelForRethrowsException) {
+    std::atomic<int> running(0);
+
+    CHECK_THROWS(ThreadPool::getInstance()->ParallelFor(0, 1000, [&running](int begin, int end) {
+        running++;
+        if (begin <= 500 && 500 < end) {
+            running--;
+            throw std::out_of_range("chunk failed");
+        }
+        running--;
+    }, 64), std::out_of_range);
+    CHECK(running == 0);
+
+    CHECK(CountVisits(0, 100, 0) == std::vector<int>(100, 1));
+}
+
+// ParallelFor inside pool tasks finishes even when every worker runs one, since callers run chunks themselves
+TEST(ParallelForNestedInTasks) {
+    std::vector< std::future<int> > results;
+    int i, total;
+
+    for (i = 0; i < 2 * ThreadPool::getInstance()->getNumThreads() + 1; i++)
+        results.push_back(ThreadPool::getInstance()->Submit([]() {
+            std::atomic<int> sum(0);
+            ThreadPool::getInstance()->ParallelFor(0, 100, [&sum](int begin, int end) {
+                sum += end - begin;
+            });
+            return sum.load();
+        }));
+
+    total = 0;
+    for (i = 0; i < (int)results.size(); i++)
+        total += results.at(i).get();
+    CHECK(total == 100 * (int)results.size());
+}
+
+// An exception of a nested ParallelFor reaches the future of the task that called it
+TEST(ParallelForExceptionInTask) {
+    std::future<void> failed = ThreadPool::getInstance()->Submit([]() {
+        ThreadPool::getInstance()->ParallelFor(0, 10, [](int, int) {
+            throw std::runtime_error("nested chunk failed");
+        });
+    });
+
+    CHECK_THROWS(failed.get(), std::runtime_error);
+}
@@ -1,83 +1,61 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "Controller/controller.h"
+#include "Model/threadpool.h"
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QMessageBox>
+#include <QSettings>
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+// Width of the proxy image used for live previews
+static const int PREVIEW_PROXY_WIDTH = 800;
+
+// Settings key of the last opened image
+static const char *LAST_IMAGE_KEY = "lastImage";
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    previewGeneration(std::make_shared<std::atomic<unsigned>>(0))
 {
     ui->setupUi(this);
 
-    //// SEGMENTATION PREPROCESSING DEFAULT PARAMETERS ////
-    ui->numMedianSegmentation->setValue(
-                Controller::getInstance()->getMedianKernelSizeSegmentation());
-    ui->numBilateralSegmentation->setValue(
-                Controller::getInstance()->getBilateralSigmaSegmentation());
-
-    //// SEGMENTATION DEFAULT PARAMETERS ////
-    ui->numSegmentationLineProfileColumnSpacing->setValue(
-                Controller::getInstance()->getSegmentationLineProfileColumnSpacing());
-    ui->numSegmentationLineProfileDerivativeDistance->setValue(
-                Controller::getInstance()->getSegmentationLineProfileDerivativeDistance());
-    ui->numSegmentationSplinePctSampleSize->setValue(
-                Controller::getInstance()->getSegmentationSplinePctSampleSize());
-    ui->numSegmentationNecksCurvesStdDevThreshold->setValue(
-                Controller::getInstance()->getSegmentationNecksCurvesStdDevThreshold());
-    ui->numSegmentationCrownBinarizationNumOfSegments->setValue(
-                Controller::getInstance()->getSegmentationCrownBinarizationNumOfSegments());
-    ui->numSegmentationCrownBinarizationPctThreshold->setValue(
-                Controller::getInstance()->getSegmentationCrownBinarizationPctThreshold());
-
-    //// SEGMENTATION PREPROCESSING DEFAULT PARAMETERS ////
-    ui->numMedianTracing->setValue(
-                Controller::getInstance()->getMedianKernelSizeTracing());
-    ui->numBilateralTracing->setValue(
-                Controller::getInstance()->getBilateralSigmaTracing());
-    ui->numSobelTracing->setValue(
-                Controller::getInstance()->getSobelKernelSizeTracing());
-    ui->cmbBilateralTracing->setCurrentIndex(
-                Controller::getInstance()->getSobelDerivativeType());
-
-    //// TRACING DEFAULT PARAMETERS ////
-    ui->numTracingSlopeAndAngleDistance->setValue(
-                Controller::getInstance()->getTracingSlopeAngleDistance());
-    ui->numTracingFirstPixelIntensityThreshold->setValue(
-                Controller::getInstance()->getTracingFirstPixelIntensityThreshold());
-    ui->numTracingFirstPixelInnerMargin->setValue(
-                Controller::getInstance()->getTracingFirstPixelInnerMargin());
-    ui->numTracingCrownTraceMaxPctHeight->setValue(
-                Controller::getInstance()->getTracingCrownTracingMaxPctHeight());
-    ui->numTracingCrownTraceExtrapolationDistance->setValue(
-                Controller::getInstance()->getTracingCrownTracingExtrapolationDistance());
-    ui->numTracingCrownTraceExtrapolationMaskSize->setValue(
-                Controller::getInstance()->getTracingCrownTracingExtrapolationMask());
-
-
-    //// CODE FOR TESTING - REMOVE WHEN DONE TESTING ////
-    QString filename = "/Users/regulrjoe/Documents/CIO/BiometriaDental/imgs/clean/cropped/0000012558_JOSE_ALBETO_SAUCEDO_Panorama_20161205112500.jpg";
-    Controller::getInstance()->setInputImage(filename.toUtf8().data());
-
-    ui->imgViewerSegmentation->showImage(
-                Controller::getInstance()->getFilteredImageSegmentation());
-    ui->btnApplyMedianSegmentation->setEnabled(true);
-    ui->btnApplyBilateralSegmentation->setEnabled(true);
-    ui->btnClearImageSegmentation->setEnabled(true);
-    ui->btnApplySegmentation->setEnabled(true);
-
-    ui->imgViewerTracing->showImage(
-                Controller::getInstance()->getFilteredImageTracing());
-    ui->btnApplyMedianTracing->setEnabled(true);
-    ui->btnApplyBilateralTracing->setEnabled(true);
-    ui->btnApplySobelTracing->setEnabled(true);
-    ui->btnClearImageTracing->setEnabled(true);
-    ui->btnApplyTracing->setEnabled(true);
-    /////////////////////////////////////////////////////
+    //// DEFAULT PARAMETERS ////
+    loadParameters();
+
+    //// DOCUMENTS ////
+    // One tab per document session
+    documentTabs = new QTabBar(this);
+    documentTabs->setTabsClosable(true);
+    documentTabs->setExpanding(false);
+    ui->mainToolBar->addWidget(documentTabs);
+    documentTabs->addTab(documentName(documents.getActiveSession()));
+    connect(documentTabs, SIGNAL(currentChanged(int)), this, SLOT(switchDocument(int)));
+    connect(documentTabs, SIGNAL(tabCloseRequested(int)), this, SLOT(closeDocument(int)));
+    sessionPoll.setInterval(50);
+    connect(&sessionPoll, SIGNAL(timeout()), this, SLOT(pollSessions()));
+    refreshDocument();
+
+    //// LIVE PREVIEW ////
+    previewDebounce.setSingleShot(true);
+    previewDebounce.setInterval(150);
+    connect(&previewDebounce, SIGNAL(timeout()), this, SLOT(runPreview()));
+    previewPoll.setInterval(30);
+    connect(&previewPoll, SIGNAL(timeout()), this, SLOT(pollPreviewRefinement()));
+    // Setting the default parameters above is not a change to preview
+    cancelPreview();
+
+    //// STARTUP ////
+    // Reopen the last image once the event loop runs, so the window shows up before anything is decoded
+    QTimer::singleShot(0, this, SLOT(openLastImage()));
 }
 
 MainWindow::~MainWindow()
 {
+    // The documents are deleted after, waiting for their background jobs
     delete ui;
 }
 
@@ -88,289 +66,654 @@ void MainWindow::on_actionOpen_Image_triggered()
     filename = QFileDialog::getOpenFileName(this,
                                             tr("Open an image file"),
                                             "~/",
-                                            tr("Image Files (*.png *.jpg *.jpeg *.bmp"));
-
-    if (filename != NULL) {
-        if (Controller::getInstance()->setInputImage(filename.toUtf8().data())) {
-            ui->imgViewerSegmentation->showImage(
-                        Controller::getInstance()->getFilteredImageSegmentation());
-            ui->btnApplyMedianSegmentation->setEnabled(true);
-            ui->btnApplyBilateralSegmentation->setEnabled(true);
-            ui->btnClearImageSegmentation->setEnabled(true);
-            ui->btnApplySegmentation->setEnabled(true);
-
-            ui->imgViewerTracing->showImage(
-                        Controller::getInstance()->getFilteredImageTracing());
-            ui->btnApplyMedianTracing->setEnabled(true);
-            ui->btnApplyBilateralTracing->setEnabled(true);
-            ui->btnApplySobelTracing->setEnabled(true);
-            ui->btnClearImageTracing->setEnabled(true);
-            ui->btnApplyTracing->setEnabled(true);
-        } else {
-            std::cout << "Image loading failed." << std::endl;
-            QMessageBox::warning(this, tr("Unable to open image"), tr("Select a valid image file."));
-        }
+                                            tr("Image Files (*.png *.jpg *.jpeg *.bmp *.dcm *.dicom *.raw)"));
+
+    if (filename != NULL)
+        openImage(filename);
+}
+
+void MainWindow::openLastImage()
+{
+    QString filename;
+
+    filename = QSettings("DentalBiometry", "DentalBiometry").value(LAST_IMAGE_KEY).toString();
+
+    // An image opened before startup finished takes precedence
+    if (!filename.isEmpty() && QFileInfo(filename).isFile()
+            && documents.getActiveSession()->getInputImage().empty() && !documents.getActiveSession()->isBusy())
+        openImage(filename);
+}
+
+void MainWindow::openImage(const QString &filename)
+{
+    std::vector<Controller*> sessions;
+    int index;
+
+    cancelPreview();
+
+    // Each image opens in its own document, unless the active one is still empty
+    if (!documents.getActiveSession()->getInputImage().empty() || documents.getActiveSession()->isBusy()) {
+        documents.createSession();
+        documentTabs->addTab(tr("Untitled"));
     }
+
+    // Decode on the worker pool. A reduced resolution image is shown first, and the document is refreshed when it is done.
+    documents.getActiveSession()->startLoading(filename.toUtf8().data());
+    ui->imgViewerTracing->clearLiveWire();
+    sessions = documents.getSessions();
+    // The reused empty document is not always the last tab
+    index = std::find(sessions.begin(), sessions.end(), documents.getActiveSession()) - sessions.begin();
+    documentTabs->setTabText(index, QFileInfo(filename).fileName());
+    documentTabs->setCurrentIndex(index);
+    refreshDocument();
+    sessionPoll.start();
+
+    QSettings("DentalBiometry", "DentalBiometry").setValue(LAST_IMAGE_KEY, filename);
+}
+
+void MainWindow::on_actionDental_Arch_Region_toggled(bool checked)
+{
+    // Applies to the next filter or segmentation of the active document
+    documents.getActiveSession()->setArchRegionEnabled(checked);
 }
 
+void MainWindow::on_actionUndo_Segmentation_triggered()
+{
+    cancelPreview();
+    if (!documents.getActiveSession()->undoSegmentation())
+        return;
+    ui->imgViewerSegmentation->showImage(
+                documents.getActiveSession()->getFilteredImageSegmentation());
+}
+
+void MainWindow::on_actionUndo_Tracing_triggered()
+{
+    cancelPreview();
+    if (!documents.getActiveSession()->undoTracing())
+        return;
+    ui->imgViewerTracing->showImage(
+                documents.getActiveSession()->getFilteredImageTracing());
+}
 
 void MainWindow::on_numMedianSegmentation_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setMedianKernelSizeSegmentation(arg1)) {
+    if (!documents.getActiveSession()->setMedianKernelSizeSegmentation(arg1)) {
         QMessageBox::warning(this,
                                  tr("Invalid Median Filter Kernel Size"),
                                  tr("Kernel size must be greater or equal to 3, lower or equal to 15, and odd."));
         ui->numMedianSegmentation->setValue(
-                    Controller::getInstance()->getMedianKernelSizeSegmentation());
+                    documents.getActiveSession()->getMedianKernelSizeSegmentation());
+    } else {
+        schedulePreview(Controller::PREVIEW_MEDIAN_SEGMENTATION);
     }
 }
 
 void MainWindow::on_numBilateralSegmentation_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setBilateralSigmaSegmentation(arg1)) {
+    if (!documents.getActiveSession()->setBilateralSigmaSegmentation(arg1)) {
         QMessageBox::warning(this,
                                  tr("Invalid Bilateral Filter Sigma"),
                                  tr("Sigma must be greater than 0 and lower or equal to 30."));
         ui->numBilateralSegmentation->setValue(
-                    Controller::getInstance()->getBilateralSigmaSegmentation());
+                    documents.getActiveSession()->getBilateralSigmaSegmentation());
+    } else {
+        schedulePreview(Controller::PREVIEW_BILATERAL_SEGMENTATION);
     }
 }
 
 void MainWindow::on_btnApplyMedianSegmentation_clicked()
 {
-    Controller::getInstance()->applyMedianSegmentation();
+    cancelPreview();
+    documents.getActiveSession()->applyMedianSegmentation();
     ui->imgViewerSegmentation->showImage(
-                Controller::getInstance()->getFilteredImageSegmentation());
+                documents.getActiveSession()->getFilteredImageSegmentation());
 }
 
 void MainWindow::on_btnApplyBilateralSegmentation_clicked()
 {
-    Controller::getInstance()->applyBilateralSegmentation();
+    cancelPreview();
+    documents.getActiveSession()->applyBilateralSegmentation();
     ui->imgViewerSegmentation->showImage(
-                Controller::getInstance()->getFilteredImageSegmentation());
+                documents.getActiveSession()->getFilteredImageSegmentation());
 }
 
 void MainWindow::on_btnClearImageSegmentation_clicked()
 {
-    Controller::getInstance()->resetImageSegmentation();
+    cancelPreview();
+    documents.getActiveSession()->resetImageSegmentation();
     ui->imgViewerSegmentation->showImage(
-                Controller::getInstance()->getFilteredImageSegmentation());
+                documents.getActiveSession()->getFilteredImageSegmentation());
 }
 
 void MainWindow::on_numSegmentationLineProfileColumnSpacing_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setSegmentationLineProfileColumnSpacing(arg1)) {
+    if (!documents.getActiveSession()->setSegmentationLineProfileColumnSpacing(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Column Spacing"),
                              tr("Column spacing must be greater than 0 and equal to or lower than 100."));
         ui->numSegmentationLineProfileColumnSpacing->setValue(
-                    Controller::getInstance()->getSegmentationLineProfileColumnSpacing());
+                    documents.getActiveSession()->getSegmentationLineProfileColumnSpacing());
+    } else {
+        schedulePreview(Controller::PREVIEW_SEGMENTATION);
     }
 }
 
 void MainWindow::on_numSegmentationLineProfileDerivativeDistance_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setSegmentationLineProfileDerivativeDistance(arg1)) {
+    if (!documents.getActiveSession()->setSegmentationLineProfileDerivativeDistance(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Derivative Distance"),
                              tr("Derivative distance must be greater than 0 and equal to or lower than 100."));
         ui->numSegmentationLineProfileDerivativeDistance->setValue(
-                    Controller::getInstance()->getSegmentationLineProfileDerivativeDistance());
+                    documents.getActiveSession()->getSegmentationLineProfileDerivativeDistance());
+    } else {
+        schedulePreview(Controller::PREVIEW_SEGMENTATION);
     }
 }
 
 void MainWindow::on_numSegmentationSplinePctSampleSize_valueChanged(double arg1)
 {
-    if (!Controller::getInstance()->setSegmentationSplinePctSampleSize((float)arg1)) {
+    if (!documents.getActiveSession()->setSegmentationSplinePctSampleSize((float)arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Spline Curve Percentage Sample Size"),
                              tr("The percentage sample size must be greater than 0.00 and equal to or lower than 1.00"));
         ui->numSegmentationSplinePctSampleSize->setValue(
-                    Controller::getInstance()->getSegmentationSplinePctSampleSize());
+                    documents.getActiveSession()->getSegmentationSplinePctSampleSize());
+    } else {
+        schedulePreview(Controller::PREVIEW_SEGMENTATION);
     }
 }
 
 void MainWindow::on_numSegmentationNecksCurvesStdDevThreshold_valueChanged(double arg1)
 {
-    if (!Controller::getInstance()->setSegmentationNecksCurvesStdDevThreshold((float)arg1)) {
+    if (!documents.getActiveSession()->setSegmentationNecksCurvesStdDevThreshold((float)arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Standard Deviation Threshold"),
                              tr("The standard deviation threhsold must be greater than 0.00 and lower than 1.00"));
         ui->numSegmentationNecksCurvesStdDevThreshold->setValue(
-                    Controller::getInstance()->getSegmentationNecksCurvesStdDevThreshold());
+                    documents.getActiveSession()->getSegmentationNecksCurvesStdDevThreshold());
+    } else {
+        schedulePreview(Controller::PREVIEW_SEGMENTATION);
     }
 }
 
 void MainWindow::on_numSegmentationCrownBinarizationNumOfSegments_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setSegmentationCrownBinarizationNumOfSegments(arg1)) {
+    if (!documents.getActiveSession()->setSegmentationCrownBinarizationNumOfSegments(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Number of Segments"),
                              tr("The number of segments must be greater than 0 and lower than 100."));
         ui->numSegmentationCrownBinarizationNumOfSegments->setValue(
-                    Controller::getInstance()->getSegmentationCrownBinarizationNumOfSegments());
+                    documents.getActiveSession()->getSegmentationCrownBinarizationNumOfSegments());
+    } else {
+        schedulePreview(Controller::PREVIEW_SEGMENTATION);
     }
 }
 
 void MainWindow::on_numSegmentationCrownBinarizationPctThreshold_valueChanged(double arg1)
 {
-    if (!Controller::getInstance()->setSegmentationCrownBinarizationPctThreshold((float)arg1)) {
+    if (!documents.getActiveSession()->setSegmentationCrownBinarizationPctThreshold((float)arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Percentage Threhsold"),
                              tr("The percentage threshold must be greater than 0 and lower than 1."));
         ui->numSegmentationCrownBinarizationPctThreshold->setValue(
-                    Controller::getInstance()->getSegmentationCrownBinarizationPctThreshold());
+                    documents.getActiveSession()->getSegmentationCrownBinarizationPctThreshold());
+    } else {
+        schedulePreview(Controller::PREVIEW_SEGMENTATION);
+    }
+}
+
+void MainWindow::on_numSegmentationPyramidLevels_valueChanged(int arg1)
+{
+    if (!documents.getActiveSession()->setSegmentationPyramidLevels(arg1)) {
+        QMessageBox::warning(this,
+                             tr("Invalid Pyramid Levels"),
+                             tr("The number of pyramid levels must be between 0 and 4."));
+        ui->numSegmentationPyramidLevels->setValue(
+                    documents.getActiveSession()->getSegmentationPyramidLevels());
+    } else {
+        schedulePreview(Controller::PREVIEW_SEGMENTATION);
     }
 }
 
 void MainWindow::on_btnApplySegmentation_clicked()
 {
-    Controller::getInstance()->runSegmentation();
-    ui->imgViewerSegmentation->showImage(
-                Controller::getInstance()->getFilteredImageSegmentation());
+    cancelPreview();
+    // Runs on the worker pool, so other documents can be reviewed meanwhile
+    documents.getActiveSession()->startSegmentation();
+    refreshDocument();
+    sessionPoll.start();
 }
 
 void MainWindow::on_numMedianTracing_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setMedianKernelSizeTracing(arg1)) {
+    if (!documents.getActiveSession()->setMedianKernelSizeTracing(arg1)) {
         QMessageBox::warning(this,
                                  tr("Invalid Median Filter Kernel Size"),
                                  tr("Kernel size must be greater than or equal to 3, lower or equal to 15, and odd."));
         ui->numMedianTracing->setValue(
-                    Controller::getInstance()->getMedianKernelSizeTracing());
+                    documents.getActiveSession()->getMedianKernelSizeTracing());
+    } else {
+        schedulePreview(Controller::PREVIEW_MEDIAN_TRACING);
     }
 }
 
 void MainWindow::on_numBilateralTracing_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setBilateralSigmaTracing(arg1)) {
+    if (!documents.getActiveSession()->setBilateralSigmaTracing(arg1)) {
         QMessageBox::warning(this,
                                  tr("Invalid Bilateral Filter Sigma"),
                                  tr("Sigma must be greater than 0 and lower or equal to 30."));
         ui->numBilateralTracing->setValue(
-                    Controller::getInstance()->getBilateralSigmaTracing());
+                    documents.getActiveSession()->getBilateralSigmaTracing());
+    } else {
+        schedulePreview(Controller::PREVIEW_BILATERAL_TRACING);
     }
 }
 
 void MainWindow::on_numSobelTracing_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setSobelKernelSizeTracing(arg1)) {
+    if (!documents.getActiveSession()->setSobelKernelSizeTracing(arg1)) {
         QMessageBox::warning(this,
                                  tr("Invalid Sobel Filter kernel size"),
                                  tr("Kernel size must be greater than or equal to 1 and lower than or equal to 15."));
         ui->numSobelTracing->setValue(
-                    Controller::getInstance()->getSobelKernelSizeTracing());
+                    documents.getActiveSession()->getSobelKernelSizeTracing());
+    } else {
+        schedulePreview(Controller::PREVIEW_SOBEL_TRACING);
     }
 }
 
 void MainWindow::on_cmbBilateralTracing_currentIndexChanged(int index)
 {
-    if (!Controller::getInstance()->setSobelDerivativeType(index)) {
+    if (!documents.getActiveSession()->setSobelDerivativeType(index)) {
         QMessageBox::warning(this,
                              tr("Invalid sobel derivative type"),
                              tr("Sobel derivative type must be 0, 1, or 2."));
         ui->cmbBilateralTracing->setCurrentIndex(
-                    Controller::getInstance()->getSobelDerivativeType());
+                    documents.getActiveSession()->getSobelDerivativeType());
+    } else {
+        schedulePreview(Controller::PREVIEW_SOBEL_TRACING);
     }
 }
 
 void MainWindow::on_btnApplyMedianTracing_clicked()
 {
-    Controller::getInstance()->applyMedianTracing();
+    cancelPreview();
+    documents.getActiveSession()->applyMedianTracing();
     ui->imgViewerTracing->showImage(
-                Controller::getInstance()->getFilteredImageTracing());
+                documents.getActiveSession()->getFilteredImageTracing());
 }
 
 void MainWindow::on_btnApplyBilateralTracing_clicked()
 {
-    Controller::getInstance()->applyBilateralTracing();
+    cancelPreview();
+    documents.getActiveSession()->applyBilateralTracing();
     ui->imgViewerTracing->showImage(
-                Controller::getInstance()->getFilteredImageTracing());
+                documents.getActiveSession()->getFilteredImageTracing());
 }
 
 void MainWindow::on_btnApplySobelTracing_clicked()
 {
-    Controller::getInstance()->applySobelTracing();
+    cancelPreview();
+    documents.getActiveSession()->applySobelTracing();
     ui->imgViewerTracing->showImage(
-                Controller::getInstance()->getFilteredImageTracing());
+                documents.getActiveSession()->getFilteredImageTracing());
 }
 
 void MainWindow::on_btnClearImageTracing_clicked()
 {
-    Controller::getInstance()->resetImageTracing();
+    cancelPreview();
+    documents.getActiveSession()->resetImageTracing();
     ui->imgViewerTracing->showImage(
-                Controller::getInstance()->getFilteredImageTracing());
+                documents.getActiveSession()->getFilteredImageTracing());
 }
 
 void MainWindow::on_numTracingSlopeAndAngleDistance_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setTracingSlopeAngleDistance(arg1)) {
+    if (!documents.getActiveSession()->setTracingSlopeAngleDistance(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Slope and Angle distance"),
                              tr("Slope and angle distance must be greather than 0."));
         ui->numTracingSlopeAndAngleDistance->setValue(
-                    Controller::getInstance()->getTracingSlopeAngleDistance());
+                    documents.getActiveSession()->getTracingSlopeAngleDistance());
     }
 }
 
 void MainWindow::on_numTracingFirstPixelIntensityThreshold_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setTracingFirstPixelIntensityThreshold(arg1)) {
+    if (!documents.getActiveSession()->setTracingFirstPixelIntensityThreshold(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Pixel Intensity Threshold"),
                              tr("Intensity threshold must be greather than 0, and lower than 256."));
         ui->numTracingFirstPixelIntensityThreshold->setValue(
-                    Controller::getInstance()->getTracingFirstPixelIntensityThreshold());
+                    documents.getActiveSession()->getTracingFirstPixelIntensityThreshold());
     }
 }
 
 void MainWindow::on_numTracingFirstPixelInnerMargin_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setTracingFirstPixelInnerMargin(arg1)) {
+    if (!documents.getActiveSession()->setTracingFirstPixelInnerMargin(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Inner Margin"),
                              tr("Inner margin must be equal to or greather than 0, and equal to or lower than 100."));
         ui->numTracingFirstPixelInnerMargin->setValue(
-                    Controller::getInstance()->getTracingFirstPixelInnerMargin());
+                    documents.getActiveSession()->getTracingFirstPixelInnerMargin());
+    }
+}
+
+void MainWindow::on_numTracingFirstPixelNumCandidates_valueChanged(int arg1)
+{
+    if (!documents.getActiveSession()->setTracingFirstPixelNumCandidates(arg1)) {
+        QMessageBox::warning(this,
+                             tr("Invalid Number of Candidates"),
+                             tr("Number of first pixel candidates must be greater than 0 and equal to or lower than 100."));
+        ui->numTracingFirstPixelNumCandidates->setValue(
+                    documents.getActiveSession()->getTracingFirstPixelNumCandidates());
     }
 }
 
 void MainWindow::on_numTracingCrownTraceMaxPctHeight_valueChanged(double arg1)
 {
-    if (!Controller::getInstance()->setTracingCrownTracingMaxPctHeight((float)arg1)) {
+    if (!documents.getActiveSession()->setTracingCrownTracingMaxPctHeight((float)arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Max % Height"),
                              tr("Max Percentage Height must be greathen than 0 and lower than 1."));
         ui->numTracingCrownTraceMaxPctHeight->setValue(
-                    Controller::getInstance()->getTracingCrownTracingMaxPctHeight());
+                    documents.getActiveSession()->getTracingCrownTracingMaxPctHeight());
     }
 }
 
 void MainWindow::on_numTracingCrownTraceExtrapolationDistance_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setTracingCrownTracingExtrapolationDistance(arg1)) {
+    if (!documents.getActiveSession()->setTracingCrownTracingExtrapolationDistance(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Extrapolation Distance"),
                              tr("Extrapolation distance must be greather than 0 and lower than 100."));
         ui->numTracingCrownTraceExtrapolationDistance->setValue(
-                    Controller::getInstance()->getTracingCrownTracingExtrapolationDistance());
+                    documents.getActiveSession()->getTracingCrownTracingExtrapolationDistance());
     }
 }
 
 void MainWindow::on_numTracingCrownTraceExtrapolationMaskSize_valueChanged(int arg1)
 {
-    if (!Controller::getInstance()->setTracingCrownTracingExtrapolationMask(arg1)) {
+    if (!documents.getActiveSession()->setTracingCrownTracingExtrapolationMask(arg1)) {
         QMessageBox::warning(this,
                              tr("Invalid Extrapolation Mask Size"),
                              tr("Extrapolation sask size must be equal to or greather than 3, and must be an odd number."));
         ui->numTracingCrownTraceExtrapolationMaskSize->setValue(
-                    Controller::getInstance()->getTracingCrownTracingExtrapolationMask());
+                    documents.getActiveSession()->getTracingCrownTracingExtrapolationMask());
+    }
+}
+
+void MainWindow::on_cmbTracingEngine_currentIndexChanged(int index)
+{
+    if (!documents.getActiveSession()->setTracingEngine(index)) {
+        QMessageBox::warning(this,
+                             tr("Invalid tracing engine"),
+                             tr("Tracing engine must be 0 or 1."));
+        ui->cmbTracingEngine->setCurrentIndex(
+                    documents.getActiveSession()->getTracingEngine());
     }
 }
 
 void MainWindow::on_btnApplyTracing_clicked()
 {
-    Controller::getInstance()->runTracing();
+    cancelPreview();
+    if (ui->chkTracingPerTooth->isChecked()) {
+        if (!documents.getActiveSession()->runTeethTracing()) {
+            QMessageBox::warning(this,
+                                 tr("No Tooth Regions"),
+                                 tr("Apply segmentation first to find the tooth regions to trace."));
+            return;
+        }
+    } else {
+        documents.getActiveSession()->runTracing();
+    }
     ui->imgViewerTracing->showImage(
-                Controller::getInstance()->getFilteredImageTracing());
+                documents.getActiveSession()->getFilteredImageTracing());
+}
+
+void MainWindow::on_chkTracingLiveWire_toggled(bool checked)
+{
+    // Left click sets livewire seeds on the tracing image, right click clears the contour
+    ui->imgViewerTracing->setLiveWireEnabled(checked);
+}
+
+void MainWindow::schedulePreview(Controller::PreviewKind kind)
+{
+    if (!ui->actionLive_Preview->isChecked())
+        return;
+
+    // Restart the wait on every change, so only the last value is previewed
+    previewKind = kind;
+    previewDebounce.start();
+}
+
+void MainWindow::runPreview()
+{
+    std::function<cv::Mat()> proxy_preview, refinement;
+    std::shared_ptr<std::atomic<unsigned>> generation;
+    unsigned refinement_generation;
+
+    // Show the change right away on a proxy image
+    proxy_preview = documents.getActiveSession()->makePreview(previewKind, PREVIEW_PROXY_WIDTH);
+    if (!proxy_preview)
+        return;
+    previewViewer(previewKind)->showImage(proxy_preview());
+
+    // Replace it with the full resolution result when it is done.
+    // Each preview starts a new generation. A refinement of an older one is skipped if it has not
+    // started yet, and its result is dropped if it has.
+    refinement = documents.getActiveSession()->makePreview(previewKind, 0);
+    generation = previewGeneration;
+    refinement_generation = ++*previewGeneration;
+    previewRefinementKind = previewKind;
+    previewRefinementGeneration = refinement_generation;
+    previewRefinement = ThreadPool::getInstance()->Submit([refinement, generation, refinement_generation]() -> cv::Mat {
+        if (*generation != refinement_generation)
+            return cv::Mat();
+        return refinement();
+    });
+    previewPoll.start();
+}
+
+void MainWindow::pollPreviewRefinement()
+{
+    cv::Mat image;
+
+    if (!previewRefinement.valid()) {
+        previewPoll.stop();
+        return;
+    }
+    if (previewRefinement.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    previewPoll.stop();
+    try {
+        image = previewRefinement.get();
+    } catch (const std::exception& e) {
+        std::cout << "Preview failed: " << e.what() << std::endl;
+        return;
+    }
+    // Parameters, document or applied result changed since the refinement started
+    if (previewRefinementGeneration != *previewGeneration || image.empty())
+        return;
+    previewViewer(previewRefinementKind)->showImage(image);
+}
+
+void MainWindow::cancelPreview()
+{
+    previewDebounce.stop();
+    previewPoll.stop();
+    ++*previewGeneration;
+    previewRefinement = std::future<cv::Mat>();
+}
+
+CQtOpenCVViewerGl *MainWindow::previewViewer(Controller::PreviewKind kind)
+{
+    if (kind <= Controller::PREVIEW_SEGMENTATION)
+        return ui->imgViewerSegmentation;
+    return ui->imgViewerTracing;
+}
+
+void MainWindow::switchDocument(int index)
+{
+    if (index < 0 || index >= (int)documents.getSessions().size())
+        return;
+
+    cancelPreview();
+    documents.setActiveSession(documents.getSessions().at(index));
+    loadParameters();
+    // Showing the parameters of the document is not a change to preview
+    cancelPreview();
+    // A contour traced on another document does not apply to this one
+    ui->imgViewerTracing->clearLiveWire();
+    refreshDocument();
+}
+
+void MainWindow::closeDocument(int index)
+{
+    if (index < 0 || index >= (int)documents.getSessions().size())
+        return;
+
+    cancelPreview();
+    // Deleted by pollSessions once its background jobs are done
+    documents.closeSession(documents.getSessions().at(index));
+    documentTabs->removeTab(index);
+    sessionPoll.start();
+
+    // Always keep one document open
+    if (documents.getSessions().empty()) {
+        documents.createSession();
+        documentTabs->addTab(tr("Untitled"));
+    }
+}
+
+void MainWindow::pollSessions()
+{
+    std::vector<Controller*> sessions;
+    bool busy;
+    int i;
+
+    sessions = documents.getSessions();
+    busy = false;
+
+    // Background documents keep processing and their results are committed here too
+    for (i = 0; i < (int)sessions.size(); i++) {
+        if (sessions.at(i)->collectResults()) {
+            documentTabs->setTabText(i, documentName(sessions.at(i)));
+            if (sessions.at(i) == documents.getActiveSession())
+                refreshDocument();
+            // A reduced resolution image is committed while the full image is still being read
+            if (sessions.at(i)->getInputImage().empty() && !sessions.at(i)->isBusy())
+                QMessageBox::warning(this, tr("Unable to open image"), tr("Select a valid image file."));
+        }
+        busy = busy || sessions.at(i)->isBusy();
+    }
+
+    if (!documents.collectClosedSessions() && !busy)
+        sessionPoll.stop();
+}
+
+void MainWindow::loadParameters()
+{
+    //// DENTAL ARCH REGION ////
+    ui->actionDental_Arch_Region->setChecked(
+                documents.getActiveSession()->getArchRegionEnabled());
+
+    //// SEGMENTATION PREPROCESSING PARAMETERS ////
+    ui->numMedianSegmentation->setValue(
+                documents.getActiveSession()->getMedianKernelSizeSegmentation());
+    ui->numBilateralSegmentation->setValue(
+                documents.getActiveSession()->getBilateralSigmaSegmentation());
+
+    //// SEGMENTATION PARAMETERS ////
+    ui->numSegmentationLineProfileColumnSpacing->setValue(
+                documents.getActiveSession()->getSegmentationLineProfileColumnSpacing());
+    ui->numSegmentationLineProfileDerivativeDistance->setValue(
+                documents.getActiveSession()->getSegmentationLineProfileDerivativeDistance());
+    ui->numSegmentationSplinePctSampleSize->setValue(
+                documents.getActiveSession()->getSegmentationSplinePctSampleSize());
+    ui->numSegmentationNecksCurvesStdDevThreshold->setValue(
+                documents.getActiveSession()->getSegmentationNecksCurvesStdDevThreshold());
+    ui->numSegmentationCrownBinarizationNumOfSegments->setValue(
+                documents.getActiveSession()->getSegmentationCrownBinarizationNumOfSegments());
+    ui->numSegmentationCrownBinarizationPctThreshold->setValue(
+                documents.getActiveSession()->getSegmentationCrownBinarizationPctThreshold());
+    ui->numSegmentationPyramidLevels->setValue(
+                documents.getActiveSession()->getSegmentationPyramidLevels());
+
+    //// TRACING PREPROCESSING PARAMETERS ////
+    ui->numMedianTracing->setValue(
+                documents.getActiveSession()->getMedianKernelSizeTracing());
+    ui->numBilateralTracing->setValue(
+                documents.getActiveSession()->getBilateralSigmaTracing());
+    ui->numSobelTracing->setValue(
+                documents.getActiveSession()->getSobelKernelSizeTracing());
+    ui->cmbBilateralTracing->setCurrentIndex(
+                documents.getActiveSession()->getSobelDerivativeType());
+
+    //// TRACING PARAMETERS ////
+    ui->numTracingSlopeAndAngleDistance->setValue(
+                documents.getActiveSession()->getTracingSlopeAngleDistance());
+    ui->numTracingFirstPixelIntensityThreshold->setValue(
+                documents.getActiveSession()->getTracingFirstPixelIntensityThreshold());
+    ui->numTracingFirstPixelInnerMargin->setValue(
+                documents.getActiveSession()->getTracingFirstPixelInnerMargin());
+    ui->numTracingFirstPixelNumCandidates->setValue(
+                documents.getActiveSession()->getTracingFirstPixelNumCandidates());
+    ui->numTracingCrownTraceMaxPctHeight->setValue(
+                documents.getActiveSession()->getTracingCrownTracingMaxPctHeight());
+    ui->numTracingCrownTraceExtrapolationDistance->setValue(
+                documents.getActiveSession()->getTracingCrownTracingExtrapolationDistance());
+    ui->numTracingCrownTraceExtrapolationMaskSize->setValue(
+                documents.getActiveSession()->getTracingCrownTracingExtrapolationMask());
+    ui->cmbTracingEngine->setCurrentIndex(
+                documents.getActiveSession()->getTracingEngine());
+}
+
+void MainWindow::refreshDocument()
+{
+    bool has_image, busy;
+
+    has_image = !documents.getActiveSession()->getInputImage().empty();
+    busy = documents.getActiveSession()->isBusy();
+
+    if (has_image) {
+        ui->imgViewerSegmentation->showImage(
+                    documents.getActiveSession()->getFilteredImageSegmentation());
+        ui->imgViewerTracing->showImage(
+                    documents.getActiveSession()->getFilteredImageTracing());
+    } else {
+        // Reduced resolution image while the image is read, nothing otherwise
+        ui->imgViewerSegmentation->showImage(
+                    documents.getActiveSession()->getLoadingPreview());
+        ui->imgViewerTracing->showImage(
+                    documents.getActiveSession()->getLoadingPreview());
+    }
+
+    // A busy document must not be modified until its background job is done
+    ui->groupBox->setEnabled(!busy);
+    ui->groupBox_2->setEnabled(!busy);
+    ui->groupBox_3->setEnabled(!busy);
+    ui->groupBox_4->setEnabled(!busy);
+
+    ui->btnApplyMedianSegmentation->setEnabled(has_image);
+    ui->btnApplyBilateralSegmentation->setEnabled(has_image);
+    ui->btnClearImageSegmentation->setEnabled(has_image && !busy);
+    ui->btnApplySegmentation->setEnabled(has_image);
+
+    ui->btnApplyMedianTracing->setEnabled(has_image);
+    ui->btnApplyBilateralTracing->setEnabled(has_image);
+    ui->btnApplySobelTracing->setEnabled(has_image);
+    ui->btnClearImageTracing->setEnabled(has_image && !busy);
+    ui->btnApplyTracing->setEnabled(has_image);
+}
+
+QString MainWindow::documentName(Controller *session)
+{
+    if (session->getName().empty())
+        return tr("Untitled");
+    return QString::fromStdString(session->getName());
 }
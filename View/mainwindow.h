@@ -2,6 +2,14 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QTabBar>
+#include <QTimer>
+#include <atomic>
+#include <future>
+#include <memory>
+#include "Controller/documentmanager.h"
+
+class CQtOpenCVViewerGl;
 
 namespace Ui {
 class MainWindow;
@@ -18,6 +26,14 @@ public:
 private slots:
     void on_actionOpen_Image_triggered();
 
+    void openLastImage();
+
+    void on_actionDental_Arch_Region_toggled(bool checked);
+
+    void on_actionUndo_Segmentation_triggered();
+
+    void on_actionUndo_Tracing_triggered();
+
     void on_numMedianSegmentation_valueChanged(int arg1);
 
     void on_numBilateralSegmentation_valueChanged(int arg1);
@@ -40,6 +56,8 @@ private slots:
 
     void on_numSegmentationCrownBinarizationPctThreshold_valueChanged(double arg1);
 
+    void on_numSegmentationPyramidLevels_valueChanged(int arg1);
+
     void on_btnApplySegmentation_clicked();
 
     void on_numMedianTracing_valueChanged(int arg1);
@@ -64,16 +82,77 @@ private slots:
 
     void on_numTracingFirstPixelInnerMargin_valueChanged(int arg1);
 
+    void on_numTracingFirstPixelNumCandidates_valueChanged(int arg1);
+
     void on_numTracingCrownTraceMaxPctHeight_valueChanged(double arg1);
 
     void on_numTracingCrownTraceExtrapolationDistance_valueChanged(int arg1);
 
     void on_numTracingCrownTraceExtrapolationMaskSize_valueChanged(int arg1);
 
+    void on_cmbTracingEngine_currentIndexChanged(int index);
+
     void on_btnApplyTracing_clicked();
 
+    void on_chkTracingLiveWire_toggled(bool checked);
+
+    void runPreview();
+
+    void switchDocument(int index);
+
+    void closeDocument(int index);
+
+    void pollSessions();
+
+    void pollPreviewRefinement();
+
 private:
     Ui::MainWindow *ui;
+
+    //// DOCUMENTS ////
+    // Open document sessions and the active one
+    DocumentManager documents;
+    // Tab of each document session, in creation order
+    QTabBar *documentTabs;
+    // Collects results of background jobs of every document
+    QTimer sessionPoll;
+
+    // Show the parameters of the active document
+    void loadParameters();
+
+    // Show the images of the active document and enable what can be used
+    void refreshDocument();
+
+    // Tab text of a document
+    QString documentName(Controller *session);
+
+    // Open an image in a new document, or in the active one if it is empty
+    void openImage(const QString &filename);
+
+    //// LIVE PREVIEW ////
+    // Waits for parameter changes to settle before previewing
+    QTimer previewDebounce;
+    // Checks if the full resolution preview is done
+    QTimer previewPoll;
+    // What the last changed parameter affects
+    Controller::PreviewKind previewKind;
+    // What the pending full resolution preview shows
+    Controller::PreviewKind previewRefinementKind;
+    // Full resolution preview running in the background
+    std::future<cv::Mat> previewRefinement;
+    // Generation of the latest preview, shared with the refinements so stale ones skip their work
+    std::shared_ptr<std::atomic<unsigned>> previewGeneration;
+    // Generation the pending refinement belongs to
+    unsigned previewRefinementGeneration;
+
+    // Preview a parameter change if live preview is on
+    void schedulePreview(Controller::PreviewKind kind);
+
+    // Drop pending previews so they do not replace an applied result
+    void cancelPreview();
+
+    // Viewer where a preview is shown
+    CQtOpenCVViewerGl *previewViewer(Controller::PreviewKind kind);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,32 @@
+# Settings shared by every project
+
+CONFIG += c++11 thread
+
+# OpenCV configuration
+QT_CONFIG -= no-pkg-config
+CONFIG += link_pkgconfig
+PKGCONFIG += opencv
+
+# Release profiles, e.g. qmake CONFIG+=release CONFIG+=ltcg CONFIG+=pgo_use
+#   ltcg            link-time optimization
+#   pgo_generate    instrumented build that writes profiles to PGO_DIR when run
+#   pgo_use         build optimized with the profiles in PGO_DIR
+# Benchmark/pgo.sh runs the whole sequence on a representative workload.
+# Profiles are matched to object files by path, so both builds must share the build directory.
+isEmpty(PGO_DIR): PGO_DIR = $$shadowed($$PWD)/pgo
+
+pgo_generate {
+    QMAKE_CXXFLAGS += -fprofile-generate=$$PGO_DIR -fprofile-update=atomic
+    QMAKE_LFLAGS += -fprofile-generate=$$PGO_DIR
+}
+pgo_use {
+    # Threads update counters concurrently, so profiles may be slightly inconsistent
+    QMAKE_CXXFLAGS += -fprofile-use=$$PGO_DIR -fprofile-correction
+    QMAKE_LFLAGS += -fprofile-use=$$PGO_DIR
+}
+
+# Drop unused code from release binaries, so worker binaries are smaller and load faster
+release:linux-g++* {
+    QMAKE_CXXFLAGS += -ffunction-sections -fdata-sections
+    QMAKE_LFLAGS += -Wl,--gc-sections
+}
@@ -1,8 +1,14 @@
 #include "mainwindow.h"
+#include "Controller/commandline.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    int status = RunCommandLine(argc, argv);
+
+    if (status >= 0)
+        return status;
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();